@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "enums.h"
+#include "instance_transform.h"
 #include "maple_asset_loader/maple_asset_loader.h"
 #include "maple_core/prng.h"
 #include "maple_logging/log_macros.h"
@@ -17,7 +18,10 @@
 #include "maple_renderer/render_graph.h"
 #include "maple_window/maple_window.h"
 #include "material_builder_data.h"
+#include "mesh_optimizer.h"
 #include "pool.h"
+#include "texture_compression.h"
+#include "vertex_compression.h"
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_RADIANS
@@ -77,6 +81,7 @@ void App::Init() {
     .AddOutput(RenderGraph::SWAPCHAIN_TARGET_NAME, {});
 
   mCompiledRenderGraph = graph.Compile();
+  mDrawPass = *mCompiledRenderGraph.FindPass("draw");
 
   struct Vertex {
     glm::vec3 pos;
@@ -148,28 +153,31 @@ void App::Init() {
     numVerts += 4;
   }
 
-  mMesh = mRenderer.CreateMesh({
+  auto optimizedMesh = OptimizeMesh({
     .verts = std::as_bytes(std::span<const Vertex>(verts)),
     .indices = indices,
     .numVerts = static_cast<uint32_t>(verts.size()),
   });
+  auto compressedVerts = CompressVertices(optimizedMesh.Data(), {.position = offsetof(Vertex, pos), .uv = offsetof(Vertex, uv)});
+  mMesh = mRenderer.CreateMesh(compressedVerts.Apply(optimizedMesh.Data()));
 
   mMaterial = mRenderer.CreateMaterial(
-    AssetLoader::LoadFileStr("assets/shaders/shader.slang"), "shader", {.rasterizer = {.cullMode = MaterialBuilderData::CullModeFlagBits::None}});
+    AssetLoader::LoadFileStr("assets/shaders/shader.slang"), "shader",
+    {.rasterizer = {.cullMode = MaterialBuilderData::CullModeFlagBits::None}, .samplers = {SamplerInfo{.maxAnisotropy = 8.0f}}});
 
-  std::array colorFormats = {Format::R8G8B8A8_SRGB, Format::B8G8R8A8_SRGB};
+  // the loaded texels are RGBA8, without BC7 they are uploaded as they are
+  std::array colorFormats = {Format::BC7_SRGB, Format::R8G8B8A8_SRGB};
   auto format = mRenderer.FindFirstSupportedTextureFormat(colorFormats);
   if (!format.has_value()) MAPLE_FATAL("failed to find suitable color format");
 
-  {
-    auto img = AssetLoader::LoadImage("assets/textures/texture.jpg");
-    mTex1 = mRenderer.CreateTexture(img.size, img.bytes, *format);
-  }
-
-  {
-    auto img = AssetLoader::LoadImage("assets/textures/viking_room.png");
-    mTex2 = mRenderer.CreateTexture(img.size, img.bytes, *format);
-  }
+  auto loadTexture = [&](const char* path) {
+    auto img = AssetLoader::LoadImage(path);
+    auto texture = GenerateMips(img.bytes, img.size, true);
+    if (*format != texture.format) texture = CompressTexture(texture, *format);
+    return mRenderer.CreateStreamedTexture(std::move(texture));
+  };
+  mTex1 = loadTexture("assets/textures/texture.jpg");
+  mTex2 = loadTexture("assets/textures/viking_room.png");
 
   mInput.Bind("forward", {{InputKey::W}, {InputKey::S, false}, {InputGamePadAxis::LeftY, false}});
   mInput.Bind("sideways", {{InputKey::D}, {InputKey::A, false}, {InputGamePadAxis::LeftX}});
@@ -242,7 +250,9 @@ void App::Run() {
     entities.Get(ent).rigidBody = mPhysics.CreateRigidBody(bodyInfo);
   }
 
-  std::vector<glm::mat4> instances;
+  std::vector<InstanceTransform> instances;
+  std::vector<glm::vec3> bodyPositions, bodyScales;
+  std::vector<glm::quat> bodyRotations;
 
   auto audioSamples = AssetLoader::LoadAudio("assets/explosion.wav");
   auto clip = mAudio.CreateClip({
@@ -259,6 +269,9 @@ void App::Run() {
 
   while (!mWindow.ShouldClose()) {
     instances.clear();
+    bodyPositions.clear();
+    bodyRotations.clear();
+    bodyScales.clear();
     mTime.BeginFrame();
     mInput.BeginFrame();
     mWindow.PollEvents();
@@ -289,10 +302,10 @@ void App::Run() {
     if (mInput.Value("click") > 0.5) {
       auto rayResult = mPhysics.Raycast(mCam.GetPosition(), mCam.Forward(), 1000.0f);
       if (rayResult != std::nullopt) {
-        instances.push_back(glm::scale(glm::translate(glm::mat4(1.0f), rayResult->position), glm::vec3(0.1f)));
+        instances.push_back(InstanceTransform::FromTRS(rayResult->position, glm::identity<glm::quat>(), glm::vec3(0.1f)));
         auto overlaps = mPhysics.OverlapSphere({.radius = 5}, rayResult->position);
         for (auto body : overlaps) {
-          instances.push_back(glm::scale(glm::translate(glm::mat4(1.0f), mPhysics.GetBodyPosition(body)), glm::vec3(2.0f)));
+          instances.push_back(InstanceTransform::FromTRS(mPhysics.GetBodyPosition(body), glm::identity<glm::quat>(), glm::vec3(2.0f)));
           if (mInput.Value("delete") < 0.5) continue;
           auto ent = mPhysics.GetBodyEntity(body);
           if (ent == floor) continue;
@@ -319,21 +332,22 @@ void App::Run() {
       MAPLE_ASSERT(e.transform.has_value() || e.rigidBody != 0, "entity required to have either a transform or rigidbody");
 
       auto physId = e.rigidBody;
-      glm::mat4 transform(1.0f);
-      transform = glm::translate(transform, mPhysics.GetBodyPosition(physId));
-      glm::mat4 rotation = glm::mat4_cast(mPhysics.GetBodyRotation(physId));
-      transform *= rotation;
+      glm::vec3 position = mPhysics.GetBodyPosition(physId);
+      glm::quat rotation = mPhysics.GetBodyRotation(physId);
       if (e.transform.has_value()) {
-        transform = glm::translate(transform, e.transform->pos);
-        glm::mat4 rotation = glm::mat4_cast(e.transform->orientation);
-        transform *= rotation;
+        position += rotation * e.transform->pos;
+        rotation *= e.transform->orientation;
       }
-      
-      if (e.scale.has_value()) transform = glm::scale(transform, e.scale.value());
 
-      instances.push_back(transform);
+      bodyPositions.push_back(position);
+      bodyRotations.push_back(rotation);
+      bodyScales.push_back(e.scale.value_or(glm::vec3(1.0f)));
     }
 
+    auto firstBodyInstance = instances.size();
+    instances.resize(firstBodyInstance + bodyPositions.size());
+    PackInstanceTransforms(bodyPositions, bodyRotations, bodyScales, std::span(instances).subspan(firstBodyInstance));
+
     auto [frameBufferX, frameBufferY] = mWindow.GetFrameBufferSize();
     Renderer::UBO ubo{
       .view = mCam.GetView(),
@@ -341,12 +355,12 @@ void App::Run() {
       .time = static_cast<float>(mTime.TimeSinceStart()),
     };
 
-    std::vector<std::variant<const std::string, TextureHndl>> usedResources = {mTex1};
+    std::vector<Renderer::UsedResource> usedResources = {mTex1};
     std::array meshDraws = {Renderer::MeshDraw{mMesh, instances, usedResources}};
 
-    std::array materialDraws = {Renderer::MaterialDraw{.material = mMaterial, .meshes = meshDraws}};
+    std::array materialDraws = {Renderer::MaterialDraw{.material = mMaterial, .meshes = meshDraws, .gpuCulling = true}};
     std::array passDraws = {Renderer::PassDraw{
-      .passName = "draw",
+      .pass = mDrawPass,
       .materialDraws = materialDraws,
     }};
 
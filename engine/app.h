@@ -30,6 +30,7 @@ class App {
   Input mInput;
   Camera mCam;
   RenderGraph::CompileResult mCompiledRenderGraph;
+  RenderGraph::PassRef mDrawPass;
 
   void Init();
 
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "log_macros.h"
+
+namespace maple {
+// Persistent slot allocator for a bindless image or sampler array binding.
+// Slots are handed out when an image (or sampler) is created and returned when it is destroyed, so shaders can index the
+// array with a stable id. Entries of image arrays leave the sampler empty, entries of sampler arrays the view.
+// Each descriptor set (one per frame in flight) only gets the slots written that changed since that set was last updated,
+// instead of rewriting the whole array every frame.
+class BindlessTable {
+ public:
+  static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+  static constexpr uint32_t MAX_SETS = 8;
+
+  BindlessTable() = default;
+  BindlessTable(uint32_t binding, uint32_t capacity, uint32_t numSets) : mBinding(binding), mCapacity(capacity), mNumSets(numSets) {
+    MAPLE_ASSERT(numSets <= MAX_SETS, "bindless table supports at most {} descriptor sets", MAX_SETS);
+    mDirtySlots.resize(numSets);
+  }
+
+  [[nodiscard]]
+  uint32_t Allocate(vk::ImageView view, vk::Sampler sampler, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal) {
+    uint32_t slot;
+    if (!mFreeSlots.empty()) {
+      slot = mFreeSlots.back();
+      mFreeSlots.pop_back();
+    } else {
+      if (mEntries.size() == mCapacity) MAPLE_FATAL("bindless table is full, capacity {}", mCapacity);
+      slot = static_cast<uint32_t>(mEntries.size());
+      mEntries.push_back({});
+    }
+
+    Update(slot, view, sampler, layout);
+    return slot;
+  }
+
+  // Point an existing slot at a new image, e.g. after a render target was recreated
+  void Update(uint32_t slot, vk::ImageView view, vk::Sampler sampler, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal) {
+    auto& entry = mEntries[slot];
+    entry.info = vk::DescriptorImageInfo{.sampler = sampler, .imageView = view, .imageLayout = layout};
+    markDirty(slot);
+  }
+
+  // For a table mirroring another table's slots, e.g. the storage views of render targets that also have a sampled slot
+  void Assign(uint32_t slot, vk::ImageView view, vk::Sampler sampler, vk::ImageLayout layout) {
+    MAPLE_ASSERT(slot < mCapacity, "bindless slot {} out of range, capacity {}", slot, mCapacity);
+    if (mEntries.size() <= slot) mEntries.resize(slot + 1);
+    std::erase(mFreeSlots, slot);
+    Update(slot, view, sampler, layout);
+  }
+
+  // The descriptor is left as is, the binding is partially bound and nothing references a freed slot
+  void Free(uint32_t slot) {
+    MAPLE_ASSERT(slot < mEntries.size(), "freeing invalid bindless slot {}", slot);
+    mEntries[slot].info = vk::DescriptorImageInfo{};
+    mFreeSlots.push_back(slot);
+  }
+
+  // Writes every slot that changed since `set` was last written, call before the set is bound for the frame
+  void WriteDirty(const vk::raii::Device& device, vk::DescriptorSet set, uint32_t setIdx, vk::DescriptorType type) {
+    auto& dirty = mDirtySlots[setIdx];
+    if (dirty.empty()) return;
+
+    std::vector<vk::WriteDescriptorSet> writes;
+    writes.reserve(dirty.size());
+    for (auto slot : dirty) {
+      auto& entry = mEntries[slot];
+      entry.dirtySets &= ~(1u << setIdx);
+      if (!entry.info.imageView && !entry.info.sampler) continue;  // freed before it was ever written to this set
+
+      writes.push_back(vk::WriteDescriptorSet{
+        .dstSet = set,
+        .dstBinding = mBinding,
+        .dstArrayElement = slot,
+        .descriptorCount = 1,
+        .descriptorType = type,
+        .pImageInfo = &entry.info,
+      });
+    }
+    dirty.clear();
+
+    if (!writes.empty()) device.updateDescriptorSets(writes, {});
+  }
+
+  uint32_t Capacity() const { return mCapacity; }
+  uint32_t ActiveCount() const { return static_cast<uint32_t>(mEntries.size() - mFreeSlots.size()); }
+
+ private:
+  struct Entry {
+    vk::DescriptorImageInfo info{};
+    uint8_t dirtySets = 0;  // bit per descriptor set still missing the current info
+  };
+
+  uint32_t mBinding = 0;
+  uint32_t mCapacity = 0;
+  uint32_t mNumSets = 0;
+
+  std::vector<Entry> mEntries;
+  std::vector<uint32_t> mFreeSlots;
+  std::vector<std::vector<uint32_t>> mDirtySlots;  // per set, slots waiting to be written
+
+  void markDirty(uint32_t slot) {
+    auto& entry = mEntries[slot];
+    for (uint32_t set = 0; set < mNumSets; set++) {
+      if (entry.dirtySets & (1u << set)) continue;
+      entry.dirtySets |= 1u << set;
+      mDirtySlots[set].push_back(slot);
+    }
+  }
+};
+}  // namespace maple
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <string_view>
+
+namespace maple::builtin_shaders {
+// Shared module loaded into every shader compilation session, user shaders pull it in with `import maple;`.
+// The structs mirror the C++ layouts in maple_renderer.cpp and must be kept in sync with them.
+inline constexpr std::string_view MAPLE_MODULE_NAME = "maple";
+inline constexpr std::string_view MAPLE_MODULE = R"slang(
+module maple;
+
+public static const uint MAPLE_CULL_DISABLED = 0xFFFFFFFF;
+public static const uint MAPLE_MAX_LODS = 4;
+
+// Element of the instance buffer (binding 1), the top three rows of an affine model matrix
+public struct InstanceTransform {
+  public float4 rows[3];
+};
+
+public float4x4 mapleInstanceMatrix(InstanceTransform instance) {
+  return float4x4(instance.rows[0], instance.rows[1], instance.rows[2], float4(0.0, 0.0, 0.0, 1.0));
+}
+
+// Push constants of every draw
+public struct DrawPush {
+  public uint64_t vertexBufferAddress;
+  public uint indexBufferOffset;     // byte offset of the index data from the vertex buffer address
+  public uint materialBufferOffset;  // element offset into the material buffer
+  public uint instanceBufferIndex;   // element offset into the instance buffer
+  public uint cullDrawOffset;        // element offset of the draw's batch in the cull draw buffer, MAPLE_CULL_DISABLED for direct draws
+  public uint cullDrawIdsOffset;     // element offset of the batch's compacted draw ids in the cull output buffer
+  public uint cullClusters;          // 1 for cluster batches, whose commands each draw one meshlet of one instance
+  public float positionOffset[3];    // vertex quantization of the mesh
+  public float positionScale[3];
+};
+
+// One mesh draw of a GPU culled material draw (binding 4)
+public struct CullDraw {
+  public float4 boundingSphere;  // object space center & radius
+  public uint64_t vertexBufferAddress;
+  public uint indexBufferOffset;
+  public uint materialBufferOffset;
+  public uint instanceBufferIndex;
+  public uint instanceCount;
+  public uint visibleOffset;  // element offset of the draw's visible instance list in the cull output buffer
+  public uint indexSize;      // bytes per index
+  public uint numLods;
+  public float lodErrors[MAPLE_MAX_LODS];  // object space
+  public uint lodFirstIndices[MAPLE_MAX_LODS];
+  public uint lodIndexCounts[MAPLE_MAX_LODS];
+  public uint firstClusterTask;  // cluster batches: index of the draw's first (instance, meshlet) cull task
+  public uint meshletOffset;     // byte offset of the meshlets from the vertex buffer address
+  public uint numMeshlets;
+  public float positionOffset[3];  // vertex quantization of the mesh
+  public float positionScale[3];
+};
+
+public struct MapleDraw {
+  public uint64_t vertexBufferAddress;
+  public uint indexBufferOffset;
+  public uint materialBufferOffset;
+  public uint instanceIndex;  // absolute index into the instance buffer
+  public uint indexSize;      // bytes per index, 0 when the draw is indexed and SV_VertexID already is the vertex index
+  public uint firstIndex;     // of the LOD or meshlet drawn, added to SV_VertexID which excludes the command's firstVertex
+  public float3 positionOffset;
+  public float3 positionScale;
+};
+
+// Resolves the mesh, material and instance the current vertex belongs to, for both direct and GPU culled draws.
+// cullDraws and cullOutput are bindings 4 and 5, drawIndex is SV_DrawIndex
+public MapleDraw mapleGetDraw(DrawPush push, StructuredBuffer<CullDraw> cullDraws, StructuredBuffer<uint> cullOutput, uint drawIndex, uint instanceID) {
+  MapleDraw draw;
+  if (push.cullDrawOffset == MAPLE_CULL_DISABLED) {
+    draw.vertexBufferAddress = push.vertexBufferAddress;
+    draw.indexBufferOffset = push.indexBufferOffset;
+    draw.materialBufferOffset = push.materialBufferOffset;
+    draw.instanceIndex = push.instanceBufferIndex + instanceID;
+    draw.indexSize = 0;
+    draw.firstIndex = 0;
+    draw.positionOffset = float3(push.positionOffset[0], push.positionOffset[1], push.positionOffset[2]);
+    draw.positionScale = float3(push.positionScale[0], push.positionScale[1], push.positionScale[2]);
+    return draw;
+  }
+
+  // the first index of the LOD or meshlet is stored next to the draw id, cluster batch commands draw a single instance which
+  // is stored in between
+  uint ids = push.cullClusters != 0 ? push.cullDrawIdsOffset + drawIndex * 3 : push.cullDrawIdsOffset + drawIndex * 2;
+  uint drawIdx = cullOutput[ids];
+  CullDraw data = cullDraws[push.cullDrawOffset + drawIdx];
+
+  draw.vertexBufferAddress = data.vertexBufferAddress;
+  draw.indexBufferOffset = data.indexBufferOffset;
+  draw.materialBufferOffset = data.materialBufferOffset;
+  draw.instanceIndex = push.cullClusters != 0 ? cullOutput[ids + 1] : cullOutput[data.visibleOffset + instanceID];
+  draw.indexSize = data.indexSize;
+  draw.firstIndex = push.cullClusters != 0 ? cullOutput[ids + 2] : cullOutput[ids + 1];
+  draw.positionOffset = float3(data.positionOffset[0], data.positionOffset[1], data.positionOffset[2]);
+  draw.positionScale = float3(data.positionScale[0], data.positionScale[1], data.positionScale[2]);
+  return draw;
+}
+
+// The vertex to fetch for SV_VertexID. Direct draws are indexed by the hardware, GPU culled batches draw several meshes with
+// one non-indexed indirect draw and read the mesh's 16 or 32 bit indices here
+public uint mapleVertexIndex(MapleDraw draw, uint vertexID) {
+  if (draw.indexSize == 0) return vertexID;
+
+  vertexID += draw.firstIndex;
+  uint* indices = reinterpret<uint*>(draw.vertexBufferAddress + draw.indexBufferOffset);
+  if (draw.indexSize == 4) return indices[vertexID];
+  uint pair = indices[vertexID / 2];
+  return (vertexID & 1) != 0 ? pair >> 16 : pair & 0xFFFF;
+}
+
+// Decoders of the compressed vertex attributes written by maple::CompressVertices, see vertex_compression.h.
+// Compressed vertices are best declared as structs of uints, their attributes are only 4 byte aligned
+
+// Object space position of the 4 x uint16 quantized position, xy in the first uint
+public float3 mapleDecodePosition(MapleDraw draw, uint2 packed) {
+  float3 quantized = float3(packed.x & 0xFFFF, packed.x >> 16, packed.y & 0xFFFF);
+  return draw.positionOffset + quantized * draw.positionScale;
+}
+
+// Unit vector of the octahedral 2 x snorm16 encoding
+public float3 mapleDecodeOctahedral(uint packed) {
+  float2 encoded = max(float2(int2(packed << 16, packed) >> 16) / 32767.0, -1.0);
+  float3 n = float3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float fold = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -fold : fold;
+  n.y += n.y >= 0.0 ? -fold : fold;
+  return normalize(n);
+}
+
+// Tangent with the bitangent sign in w, which is stored in the unused fourth component of the position
+public float4 mapleDecodeTangent(uint packed, uint2 packedPosition) {
+  return float4(mapleDecodeOctahedral(packed), (packedPosition.y >> 16) != 0 ? -1.0 : 1.0);
+}
+
+public float2 mapleDecodeHalf2(uint packed) {
+  return float2(f16tof32(packed & 0xFFFF), f16tof32(packed >> 16));
+}
+)slang";
+
+// Frustum culls the instances of a GPU culled material draw and compacts the surviving mesh draws into indirect commands.
+// Every draw is drawn with the finest LOD any of its visible instances selected.
+// Cull output layout of a batch, in uints from outputOffset:
+//   [draw count] [visible count per draw] [MAPLE_MAX_LODS - finest LOD per draw] [VkDrawIndirectCommand per draw]
+//   [draw id, first index of the LOD per command] ... visible instance lists
+// Cluster batches hold meshes with meshlets, every meshlet of every instance is frustum and normal cone culled on its own
+// and each visible one becomes a command drawing its index range, always of the full detail LOD:
+//   [command count] [VkDrawIndirectCommand per cull task] [draw id, instance index, meshlet first index per cull task]
+inline constexpr std::string_view CULL_SHADER_NAME = "maple_cull";
+inline constexpr std::string_view CULL_INSTANCES_ENTRY = "cullInstances";
+inline constexpr std::string_view COMPACT_DRAWS_ENTRY = "compactDraws";
+inline constexpr std::string_view CULL_CLUSTERS_ENTRY = "cullClusters";
+inline constexpr std::string_view CULL_SHADER = R"slang(
+import maple;
+
+struct UniformBuffer {
+  float4x4 view;
+  float4x4 proj;
+  float time;
+};
+
+struct CullPush {
+  uint drawOffset;     // element offset of the batch in the cull draw buffer
+  uint numDraws;
+  uint firstInstance;  // instance buffer index of the batch's first instance
+  uint numInstances;
+  uint outputOffset;   // element offset of the batch in the cull output buffer
+  float lodScale;      // half the viewport height over the acceptable LOD error, both in pixels
+  uint coneCulling;    // cluster batches: 1 to skip meshlets whose triangles all face away from the camera
+};
+
+// Mirrors maple::Meshlet
+struct Meshlet {
+  float4 boundingSphere;  // object space center & radius
+  float3 coneApex;
+  float coneCutoff;
+  float3 coneAxis;
+  uint firstIndex;
+  uint numTriangles;
+  uint padding[3];
+};
+
+[[vk::push_constant]] CullPush push;
+
+[[vk::binding(0, 0)]]
+ConstantBuffer<UniformBuffer> ubo;
+
+[[vk::binding(1, 0)]]
+StructuredBuffer<InstanceTransform> instanceModels;
+
+[[vk::binding(4, 0)]]
+StructuredBuffer<CullDraw> cullDraws;
+
+[[vk::binding(5, 0)]]
+RWStructuredBuffer<uint> cullOutput;
+
+// squared lengths of the model matrix' axes, the scale of the instance along them
+float3 axisScalesSq(float4x4 model) {
+  float3 axisX = float3(model[0][0], model[1][0], model[2][0]);
+  float3 axisY = float3(model[0][1], model[1][1], model[2][1]);
+  float3 axisZ = float3(model[0][2], model[1][2], model[2][2]);
+  return float3(dot(axisX, axisX), dot(axisY, axisY), dot(axisZ, axisZ));
+}
+
+// Gribb-Hartmann planes, the near plane assumes a -1..1 depth range which is conservative for 0..1 projections
+bool sphereInFrustum(float3 center, float radius) {
+  float4x4 viewProj = mul(ubo.proj, ubo.view);
+  float4 planes[6] = {
+    viewProj[3] + viewProj[0],
+    viewProj[3] - viewProj[0],
+    viewProj[3] + viewProj[1],
+    viewProj[3] - viewProj[1],
+    viewProj[3] + viewProj[2],
+    viewProj[3] - viewProj[2],
+  };
+  for (uint i = 0; i < 6; i++) {
+    float4 plane = planes[i] / length(planes[i].xyz);
+    if (dot(plane.xyz, center) + plane.w < -radius) return false;
+  }
+  return true;
+}
+
+[shader("compute")]
+[numthreads(64, 1, 1)]
+void cullInstances(uint3 threadId : SV_DispatchThreadID) {
+  if (threadId.x >= push.numInstances) return;
+  uint instanceIndex = push.firstInstance + threadId.x;
+
+  // the draws of a batch own consecutive instance ranges, find the last one starting at or before this instance
+  uint lo = 0;
+  uint hi = push.numDraws - 1;
+  while (lo < hi) {
+    uint mid = (lo + hi + 1) / 2;
+    if (cullDraws[push.drawOffset + mid].instanceBufferIndex <= instanceIndex) lo = mid;
+    else hi = mid - 1;
+  }
+  CullDraw draw = cullDraws[push.drawOffset + lo];
+
+  float4x4 model = mapleInstanceMatrix(instanceModels[instanceIndex]);
+  float3 center = mul(model, float4(draw.boundingSphere.xyz, 1.0)).xyz;
+  float3 scalesSq = axisScalesSq(model);
+  float scale = sqrt(max(scalesSq.x, max(scalesSq.y, scalesSq.z)));
+  float radius = draw.boundingSphere.w * scale;
+  if (!sphereInFrustum(center, radius)) return;
+
+  uint slot;
+  InterlockedAdd(cullOutput[push.outputOffset + 1 + lo], 1, slot);
+  cullOutput[draw.visibleOffset + slot] = instanceIndex;
+
+  // same selection as the renderer's CPU side, the coarsest LOD whose error stays below the threshold on screen
+  float distance = length(mul(ubo.view, float4(center, 1.0)).xyz) - radius;
+  uint lod = 0;
+  if (distance > 0.0) {
+    float errorScale = scale * abs(ubo.proj[1][1]) * push.lodScale / distance;
+    while (lod + 1 < draw.numLods && draw.lodErrors[lod + 1] * errorScale <= 1.0) lod++;
+  }
+  InterlockedMax(cullOutput[push.outputOffset + 1 + push.numDraws + lo], MAPLE_MAX_LODS - lod);
+}
+
+[shader("compute")]
+[numthreads(64, 1, 1)]
+void compactDraws(uint3 threadId : SV_DispatchThreadID) {
+  uint drawIdx = threadId.x;
+  if (drawIdx >= push.numDraws) return;
+
+  uint visibleCount = cullOutput[push.outputOffset + 1 + drawIdx];
+  if (visibleCount == 0) return;
+
+  CullDraw draw = cullDraws[push.drawOffset + drawIdx];
+
+  uint lod = MAPLE_MAX_LODS - cullOutput[push.outputOffset + 1 + push.numDraws + drawIdx];
+
+  uint slot;
+  InterlockedAdd(cullOutput[push.outputOffset], 1, slot);
+
+  // not indexed, the shader reads the index at SV_VertexID plus the LOD's first index. SV_VertexID doesn't include the
+  // command's firstVertex, so the first index goes next to the draw id instead
+  uint commandsOffset = push.outputOffset + 1 + 2 * push.numDraws;
+  uint command = commandsOffset + slot * 4;
+  cullOutput[command + 0] = draw.lodIndexCounts[lod];
+  cullOutput[command + 1] = visibleCount;
+  cullOutput[command + 2] = 0;  // firstVertex
+  cullOutput[command + 3] = 0;  // firstInstance
+  uint ids = commandsOffset + push.numDraws * 4 + slot * 2;
+  cullOutput[ids + 0] = drawIdx;
+  cullOutput[ids + 1] = draw.lodFirstIndices[lod];
+}
+
+[shader("compute")]
+[numthreads(64, 1, 1)]
+void cullClusters(uint3 threadId : SV_DispatchThreadID) {
+  uint task = threadId.x;
+  if (task >= push.numInstances) return;
+
+  // the draws of a batch own consecutive task ranges, the meshlets of an instance are consecutive tasks
+  uint lo = 0;
+  uint hi = push.numDraws - 1;
+  while (lo < hi) {
+    uint mid = (lo + hi + 1) / 2;
+    if (cullDraws[push.drawOffset + mid].firstClusterTask <= task) lo = mid;
+    else hi = mid - 1;
+  }
+  CullDraw draw = cullDraws[push.drawOffset + lo];
+  uint drawTask = task - draw.firstClusterTask;
+  uint instanceIndex = draw.instanceBufferIndex + drawTask / draw.numMeshlets;
+  Meshlet meshlet = reinterpret<Meshlet*>(draw.vertexBufferAddress + draw.meshletOffset)[drawTask % draw.numMeshlets];
+
+  float4x4 model = mapleInstanceMatrix(instanceModels[instanceIndex]);
+  float3 center = mul(model, float4(meshlet.boundingSphere.xyz, 1.0)).xyz;
+  float3 scalesSq = axisScalesSq(model);
+  float maxScaleSq = max(scalesSq.x, max(scalesSq.y, scalesSq.z));
+  if (!sphereInFrustum(center, meshlet.boundingSphere.w * sqrt(maxScaleSq))) return;
+
+  // in view space the camera sits at the origin. Non uniform scales bend the cone and mirroring flips the winding, those
+  // instances keep every meshlet
+  float minScaleSq = min(scalesSq.x, min(scalesSq.y, scalesSq.z));
+  if (push.coneCulling != 0 && minScaleSq > maxScaleSq * 0.99 && determinant(float3x3(model)) > 0.0) {
+    float4x4 modelView = mul(ubo.view, model);
+    float3 apex = mul(modelView, float4(meshlet.coneApex, 1.0)).xyz;
+    float3 axis = normalize(mul(modelView, float4(meshlet.coneAxis, 0.0)).xyz);
+    if (dot(normalize(apex), axis) >= meshlet.coneCutoff) return;
+  }
+
+  uint slot;
+  InterlockedAdd(cullOutput[push.outputOffset], 1, slot);
+
+  // not indexed, the shader reads the index at SV_VertexID plus the meshlet's first index, like compactDraws
+  uint command = push.outputOffset + 1 + slot * 4;
+  cullOutput[command + 0] = meshlet.numTriangles * 3;
+  cullOutput[command + 1] = 1;
+  cullOutput[command + 2] = 0;  // firstVertex
+  cullOutput[command + 3] = 0;  // firstInstance
+  uint ids = push.outputOffset + 1 + push.numInstances * 4 + slot * 3;
+  cullOutput[ids + 0] = lo;
+  cullOutput[ids + 1] = instanceIndex;
+  cullOutput[ids + 2] = meshlet.firstIndex;
+}
+)slang";
+}  // namespace maple::builtin_shaders
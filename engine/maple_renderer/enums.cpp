@@ -19,4 +19,59 @@ bool FormatHasStencil(Format format) {
 }
 
 bool FormatIsColor(Format format) { return !FormatIsDepth(format); }
+
+bool FormatIsBlockCompressed(Format format) { return FormatBlockExtent(format) > 1; }
+
+uint32_t FormatBlockExtent(Format format) {
+  switch (format) {
+    case Format::BC1_RGB_UNORM:
+    case Format::BC1_RGB_SRGB:
+    case Format::BC3_UNORM:
+    case Format::BC3_SRGB:
+    case Format::BC5_UNORM:
+    case Format::BC7_UNORM:
+    case Format::BC7_SRGB:
+      return 4;
+    default:
+      return 1;
+  }
+}
+
+uint32_t FormatBlockSize(Format format) {
+  switch (format) {
+    case Format::Undefined:
+      return 0;
+    case Format::R8_UNORM:
+      return 1;
+    case Format::R16_SFLOAT:
+    case Format::D16_UNORM:
+      return 2;
+    case Format::D16_UNORM_S8:
+      return 3;
+    case Format::R8G8B8A8_UNORM:
+    case Format::B8G8R8A8_UNORM:
+    case Format::R8G8B8A8_SRGB:
+    case Format::B8G8R8A8_SRGB:
+    case Format::B10G11R11_UFLOAT:
+    case Format::R10G10B10A2_UNORM:
+    case Format::R32_SFLOAT:
+    case Format::D24_UNORM_S8:
+    case Format::D32_SFLOAT:
+      return 4;
+    case Format::D32_SFLOAT_S8:
+      return 5;
+    case Format::R16G16B16A16_SFLOAT:
+    case Format::BC1_RGB_UNORM:
+    case Format::BC1_RGB_SRGB:
+      return 8;
+    case Format::R32G32B32A32_SFLOAT:
+    case Format::BC3_UNORM:
+    case Format::BC3_SRGB:
+    case Format::BC5_UNORM:
+    case Format::BC7_UNORM:
+    case Format::BC7_SRGB:
+      return 16;
+  }
+  return 0;
+}
 }  // namespace maple
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
+
 namespace maple {
 enum class ImageLayout {
   Undefined,
+  General,  // storage images
   AttachmentOptimal,
   ShaderReadOnlyOptimal,
   PresentSrc,
@@ -12,25 +15,45 @@ enum class AccessMask {
   None,
   ColorAttachmentWrite,
   DepthStencilAttachmentWrite,
+  ColorAttachmentReadWrite,         // loads the previous contents, then writes
+  DepthStencilAttachmentReadWrite,
   ShaderRead,
+  ShaderWrite,      // storage image writes
+  ShaderReadWrite,
 };
 
+enum class QueueType { Graphics, AsyncCompute };
+
+enum class LoadOp { Auto, Clear, Load, DontCare };
+enum class StoreOp { Auto, Store, DontCare };
+
 enum ShaderStage { Vertex, Fragment, AllGraphics, Compute, AllGraphicsAndCompute };
 
-enum class PipelineStage {
-  TopOfPipe,
-  BottomOfPipe,
-  ColorAttachmentOutput,
-  EarlyFragmentTests,
-  LateFragmentTests,
-  EarlyAndLateFragmentTests,
-  VertexShader,
-  FragmentShader,
-  ComputeShader,
-  AllGraphics,
-  AllGraphicsAndCompute,
+// Bit flags, a resource read by several passes is in the union of their stages
+enum class PipelineStage : uint32_t {
+  None = 0,
+  TopOfPipe = 1 << 0,
+  BottomOfPipe = 1 << 1,
+  ColorAttachmentOutput = 1 << 2,
+  EarlyFragmentTests = 1 << 3,
+  LateFragmentTests = 1 << 4,
+  EarlyAndLateFragmentTests = EarlyFragmentTests | LateFragmentTests,
+  VertexShader = 1 << 5,
+  FragmentShader = 1 << 6,
+  ComputeShader = 1 << 7,
+  AllGraphics = 1 << 8,
+  AllGraphicsAndCompute = 1 << 9,
 };
 
+constexpr PipelineStage operator|(PipelineStage a, PipelineStage b) {
+  return static_cast<PipelineStage>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+
+// true if every stage of `required` is in `stages`
+constexpr bool HasStages(PipelineStage stages, PipelineStage required) {
+  return (static_cast<uint32_t>(stages) & static_cast<uint32_t>(required)) == static_cast<uint32_t>(required);
+}
+
 enum SizeType { Absolute, SwapChainRelative };
 enum Format {
   Undefined,
@@ -55,6 +78,15 @@ enum Format {
   R16_SFLOAT,
   R32_SFLOAT,
 
+  // Block compressed, 4x4 texel blocks (sampled textures only, see texture_compression.h for the encoders)
+  BC1_RGB_UNORM,  // 8 bytes per block, opaque color
+  BC1_RGB_SRGB,
+  BC3_UNORM,  // 16 bytes per block, color & alpha
+  BC3_SRGB,
+  BC5_UNORM,  // 16 bytes per block, two channels, e.g. tangent space normals
+  BC7_UNORM,  // 16 bytes per block, high quality color & alpha
+  BC7_SRGB,
+
   // Depth & Stencil formats
   D16_UNORM,
   D16_UNORM_S8,
@@ -68,4 +100,12 @@ bool FormatIsDepth(Format format);
 bool FormatHasStencil(Format format);
 
 bool FormatIsColor(Format format);
+
+bool FormatIsBlockCompressed(Format format);
+
+// Width and height of the texel blocks the format is stored in, 1 for uncompressed formats
+uint32_t FormatBlockExtent(Format format);
+
+// Bytes of a block, a single texel for uncompressed formats
+uint32_t FormatBlockSize(Format format);
 }  // namespace maple
\ No newline at end of file
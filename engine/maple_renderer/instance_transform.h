@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <span>
+
+#include "log_macros.h"
+
+namespace maple {
+// Affine model transform stored as the top three rows of the model matrix, 48 bytes instead of the 64 of a glm::mat4.
+// The last row is always (0, 0, 0, 1). Mirrors `InstanceTransform` of the builtin maple shader module.
+struct InstanceTransform {
+  glm::vec4 rows[3];
+
+  static InstanceTransform FromMatrix(const glm::mat4& m) {
+    return {{
+      glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]),
+      glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]),
+      glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]),
+    }};
+  }
+
+  // Same result as translate(position) * mat4_cast(rotation) * scale(scale), without the matrix multiplies
+  static InstanceTransform FromTRS(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+    float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+    float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+    return {{
+      glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy - wz) * scale.y, 2.0f * (xz + wy) * scale.z, position.x),
+      glm::vec4(2.0f * (xy + wz) * scale.x, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz - wx) * scale.z, position.y),
+      glm::vec4(2.0f * (xz - wy) * scale.x, 2.0f * (yz + wx) * scale.y, (1.0f - 2.0f * (xx + yy)) * scale.z, position.z),
+    }};
+  }
+};
+static_assert(sizeof(InstanceTransform) == 48, "InstanceTransform must match the std430 layout of the shader struct");
+
+// Batch version of InstanceTransform::FromTRS, e.g. for the body states read back from physics.
+// A branch free loop over plain arrays so the compiler can vectorize it, all spans must have the same size.
+inline void PackInstanceTransforms(std::span<const glm::vec3> positions,
+                                   std::span<const glm::quat> rotations,
+                                   std::span<const glm::vec3> scales,
+                                   std::span<InstanceTransform> out) {
+  MAPLE_ASSERT(positions.size() == out.size() && rotations.size() == out.size() && scales.size() == out.size(),
+               "mismatched instance transform batch sizes");
+  for (size_t i = 0; i < out.size(); i++) out[i] = InstanceTransform::FromTRS(positions[i], rotations[i], scales[i]);
+}
+}  // namespace maple
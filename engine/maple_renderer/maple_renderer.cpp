@@ -2,8 +2,11 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <future>
 #include <glm/common.hpp>
 #include <glm/fwd.hpp>
 #include <memory>
@@ -11,57 +14,277 @@
 #include <ranges>
 #include <span>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vulkan/vulkan_raii.hpp>
 
+#include "bindless_table.h"
+#include "builtin_shaders.h"
 #include "enums.h"
+#include "instance_transform.h"
 #include "log_macros.h"
 #include "material.h"
 #include "material_builder_data.h"
+#include "material_param_cache.h"
 #include "mesh_data.h"
 #include "pool.h"
 #include "render_graph.h"
 #include "render_target.h"
+#include "sampler_cache.h"
 #include "shader_compilation.h"
+#include "texture_compression.h"
+#include "texture_streamer.h"
+#include "upload_manager.h"
 #include "vk_enum_translation.h"
 #include "vk_renderer_ctx.h"
 #include "vkm/vkm_allocator.h"
 #include "vkm/vkm_buffer.h"
+#include "vkm/vkm_compute_pipeline.h"
 #include "vkm/vkm_descriptor_pool.h"
 #include "vkm/vkm_descriptor_sets.h"
+#include "vkm/vkm_linear_allocator.h"
 #include "vkm/vkm_mesh.h"
+#include "vkm/vkm_pipeline_cache.h"
 #include "vkm/vkm_pipeline.h"
 #include "vkm/vkm_pipeline_layout.h"
 #include "vkm/vkm_sampler.h"
+#include "worker_pool.h"
 
 namespace maple {
 
 static constexpr uint32_t NUM_INSTANCES = 1024 * 1024;
-// TODO: to save material memory introduce a "material buffer cache"
-// each pipeline that uses the exact same combination of input shaders will get the same byte offset into the material buffer
-// no more unnecessary writing to the material buffer
-static constexpr uint32_t NUM_MATERIALS = 1024 * 1024;
+static constexpr uint32_t NUM_MATERIALS = 1024 * 1024;  // bytes of the material buffer, shared by every frame in flight
 static constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
-
+static constexpr uint32_t MAX_BINDLESS_SAMPLERS = 64;
+static constexpr uint32_t MAX_CULL_DRAWS = 64 * 1024;
+// meshlets of all instances of cluster batches per frame, meshes past it are culled as a whole like those without meshlets
+static constexpr uint32_t MAX_CULL_CLUSTER_TASKS = 256 * 1024;
+// uints, see builtin_shaders::CULL_SHADER for the layout
+static constexpr uint32_t CULL_OUTPUT_SIZE = NUM_INSTANCES + 8 * MAX_CULL_DRAWS + 7 * MAX_CULL_CLUSTER_TASKS;
+static constexpr uint32_t CULL_DISABLED = UINT32_MAX;
+static constexpr uint32_t MIN_DRAWS_PER_RECORD_TASK = 256;  // smaller passes are recorded inline, a secondary isn't worth it
+
+// Layouts below mirror the structs of the builtin maple shader module
 struct DrawPush {
   uint64_t vertexBufferAddress;
   uint32_t indexBufferOffset;     // offset of start of index data from start of vertex buffer in bytes
-  uint32_t materialBufferOffset;  // byte offset into global material buffer
-  uint32_t instanceBufferIndex;   // byte offset into global instance buffer
+  uint32_t materialBufferOffset;  // uint32_t element offset into global material buffer
+  uint32_t instanceBufferIndex;   // element offset into global instance buffer
+  uint32_t cullDrawOffset;        // element offset of the draw's batch in the cull draw buffer, CULL_DISABLED for direct draws
+  uint32_t cullDrawIdsOffset;     // element offset of the batch's compacted draw ids in the cull output buffer
+  uint32_t cullClusters;          // 1 for cluster batches, whose commands each draw one meshlet of one instance
+  float positionOffset[3];        // VertexQuantization of the mesh
+  float positionScale[3];
+};
+
+struct CullDraw {
+  glm::vec4 boundingSphere;
+  uint64_t vertexBufferAddress;
+  uint32_t indexBufferOffset;
+  uint32_t materialBufferOffset;
+  uint32_t instanceBufferIndex;
+  uint32_t instanceCount;
+  uint32_t visibleOffset;  // element offset of the draw's visible instance list in the cull output buffer
+  uint32_t indexSize;      // bytes per index, the batch's indirect draws aren't indexed so the shader reads the indices itself
+  uint32_t numLods;
+  float lodErrors[MeshData::MAX_LODS];
+  uint32_t lodFirstIndices[MeshData::MAX_LODS];
+  uint32_t lodIndexCounts[MeshData::MAX_LODS];
+  uint32_t firstClusterTask;  // cluster batches: index of the draw's first (instance, meshlet) cull task
+  uint32_t meshletOffset;     // byte offset of the meshlets from the vertex buffer address
+  uint32_t numMeshlets;
+  float positionOffset[3];  // VertexQuantization of the mesh
+  float positionScale[3];
+  uint32_t padding[2];  // std430 rounds the struct up to its 16 byte alignment
+};
+static_assert(sizeof(CullDraw) == 144, "CullDraw must match the std430 layout of the shader struct");
+
+struct CullPush {
+  uint32_t drawOffset;     // element offset of the batch in the cull draw buffer
+  uint32_t numDraws;
+  uint32_t firstInstance;  // instance buffer index of the batch's first instance
+  uint32_t numInstances;   // cluster batches: cull tasks, one per meshlet of every instance
+  uint32_t outputOffset;   // element offset of the batch in the cull output buffer
+  float lodScale;          // half the viewport height over the acceptable LOD error, both in pixels
+  uint32_t coneCulling;    // cluster batches: 1 to skip meshlets whose triangles all face away from the camera
+};
+static_assert(sizeof(CullPush) <= sizeof(DrawPush), "the cull pass shares the global pipeline layout's push constant range");
+
+struct CullBatch {
+  CullPush push;
+  uint32_t maxCommands = 0;
+  bool clusters = false;
+  uint32_t commandsOffset = 0;  // element offsets into the cull output buffer
+  uint32_t drawIdsOffset = 0;
+};
+
+// The batches a GPU culled material draw's mesh draws are split into, meshes with meshlets are culled per cluster
+struct MaterialCullBatches {
+  std::optional<CullBatch> instances;
+  std::optional<CullBatch> clusters;
+};
+
+struct PreparedDraw {
+  DrawPush push;
+  vk::Buffer indexBuffer;  // direct draws are indexed, GPU culled batches mix meshes so their shaders fetch the indices
+  vk::DeviceSize indexOffset = 0;
+  vk::IndexType indexType = vk::IndexType::eUint32;
+  uint32_t firstIndex = 0;  // of the drawn LOD
+  uint32_t indexCount = 0;
+  uint32_t instanceCount = 0;
+  const CullBatch* cullBatch = nullptr;  // GPU culled material draws are an indirect draw per batch
+};
+
+struct PreparedMaterialDraw {
+  vk::Pipeline pipeline;
+  uint32_t firstDraw = 0;  // range in the pass' prepared draws
+  uint32_t numDraws = 0;
+};
+
+struct DrawRecordInfo {
+  vk::PipelineLayout layout;
+  glm::uvec2 renderingArea;
+  vk::Buffer cullOutput;
+  std::span<const PreparedMaterialDraw> materials;
+  std::span<const PreparedDraw> draws;
+};
+
+// Command buffers of one recording thread (secondaries) or one queue's submission batches (primaries) for one frame in flight,
+// reset once the frame's fence has signaled
+struct RecordContext {
+  vk::raii::CommandPool pool = nullptr;
+  vk::CommandBufferLevel level = vk::CommandBufferLevel::eSecondary;
+  std::vector<vk::raii::CommandBuffer> buffers;
+  uint32_t used = 0;
+
+  const vk::raii::CommandBuffer& Acquire(const vk::raii::Device& device) {
+    if (used == buffers.size()) {
+      vk::raii::CommandBuffers allocated(device, {.commandPool = *pool, .level = level, .commandBufferCount = 1});
+      buffers.push_back(std::move(allocated[0]));
+    }
+    return buffers[used++];
+  }
+
+  void Reset() {
+    pool.reset();
+    used = 0;
+  }
+};
+
+// Events of the split barriers of one frame in flight, reset from the host once the frame's fence has signaled
+struct EventPool {
+  std::vector<vk::raii::Event> events;
+  uint32_t used = 0;
+
+  vk::Event Acquire(const vk::raii::Device& device) {
+    if (used == events.size()) events.emplace_back(device, vk::EventCreateInfo{});
+    return *events[used++];
+  }
+
+  void Reset() {
+    for (auto& event : std::span(events).first(used)) event.reset();
+    used = 0;
+  }
 };
 
 using RenderTargetHndl = uint32_t;
 
 struct Renderer::Impl {
   VkRendererCtx mCtx;
+  vkm::PipelineCache mPipelineCache;  // every pipeline is built through it, saved next to the shader cache on destruction
+  UploadManager mUploads;
   Pool<vkm::Mesh> mMeshPool;
   Pool<Material> mMaterialPool;
+  std::unique_ptr<ShaderCompileQueue> mShaderCompiler;  // created with the first material compiled in the background
+  std::vector<MaterialHndl> mPendingMaterials;          // still compiling in the background
+  // A shader permutation compiled once for every material created from it, kept until the last of them is destroyed.
+  // The description is compared on a hash hit, so colliding permutations never share code
+  struct ShaderPermutation {
+    uint64_t hash;  // ShaderPermutationHash
+    std::string code;
+    std::string fileName;
+    std::vector<std::string> entryFuncNames;
+    std::vector<std::string> keywords;  // sorted, without duplicates
+    std::shared_future<std::vector<uint8_t>> spirv;
+    uint32_t numMaterials = 0;
+  };
+  uint64_t mNextPermutationId = 0;
+  std::unordered_map<uint64_t, ShaderPermutation> mShaderPermutations;  // by id, which materials keep
+  std::unordered_multimap<uint64_t, uint64_t> mPermutationIds;          // by hash
+
+  // Id of the permutation a material with this data uses, compiled if no other material uses it. Compiled on the calling
+  // thread, or in the background if `async` in which case its code may still be pending
+  uint64_t AcquirePermutation(const std::string& code, const std::string& fileName, const MaterialBuilderData& data, bool async) {
+    std::vector<std::string> entryFuncNames = {data.computeEntryFuncName};
+    if (!data.IsCompute()) entryFuncNames = {data.vertEntryFuncName, data.fragEntryFuncName};
+
+    auto keywords = data.keywords;
+    std::ranges::sort(keywords);
+    auto duplicates = std::ranges::unique(keywords);
+    keywords.erase(duplicates.begin(), duplicates.end());
+
+    uint64_t hash = ShaderPermutationHash(code, fileName, entryFuncNames, keywords);
+    auto [begin, end] = mPermutationIds.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+      auto& permutation = mShaderPermutations.at(it->second);
+      if (permutation.code == code && permutation.fileName == fileName && permutation.entryFuncNames == entryFuncNames &&
+          permutation.keywords == keywords) {
+        permutation.numMaterials++;
+        return it->second;
+      }
+    }
 
-  Pool<RenderTarget> mRenderTargets;  // slots directly map to texture slot
+    std::shared_future<std::vector<uint8_t>> spirv;
+    if (async) {
+      if (!mShaderCompiler) mShaderCompiler = std::make_unique<ShaderCompileQueue>(std::max(1u, std::thread::hardware_concurrency() / 2));
+      spirv = mShaderCompiler->Submit(code, fileName, entryFuncNames, keywords).share();
+    } else {
+      // a failure is kept in the future like a background one, so every material collects its code the same way
+      std::promise<std::vector<uint8_t>> compiled;
+      try {
+        compiled.set_value(compileSlangToSpirv(code, fileName, entryFuncNames, keywords));
+      } catch (const ShaderCompileError&) {
+        compiled.set_exception(std::current_exception());
+      }
+      spirv = compiled.get_future().share();
+    }
+
+    uint64_t id = mNextPermutationId++;
+    mShaderPermutations.emplace(id,
+                                ShaderPermutation{
+                                  .hash = hash,
+                                  .code = code,
+                                  .fileName = fileName,
+                                  .entryFuncNames = std::move(entryFuncNames),
+                                  .keywords = std::move(keywords),
+                                  .spirv = std::move(spirv),
+                                  .numMaterials = 1,
+                                });
+    mPermutationIds.emplace(hash, id);
+    return id;
+  }
+
+  // A compilation still running when the last material goes away finishes into a future nobody reads
+  void ReleasePermutation(uint64_t id) {
+    auto it = mShaderPermutations.find(id);
+    MAPLE_ASSERT(it != mShaderPermutations.end(), "released unknown shader permutation {}", id);
+    if (--it->second.numMaterials > 0) return;
+
+    auto [begin, end] = mPermutationIds.equal_range(it->second.hash);
+    mPermutationIds.erase(std::find_if(begin, end, [&](const auto& entry) { return entry.second == id; }));
+    mShaderPermutations.erase(it);
+  }
+
+  std::vector<vkm::Allocation> mAliasMemory;  // per alias slot of the compiled graph, shared by the render targets in it
+  Pool<RenderTarget> mRenderTargets;
   Pool<RenderTarget> mTexturePool;
-  std::unordered_map<std::string, RenderTargetHndl> mRenderTargetMap;
+  BindlessTable mBindlessTextures;       // binding 3 slots of both render targets and textures, sampled with binding 7 samplers
+  BindlessTable mBindlessStorageImages;  // binding 6, the storage views of compute pass outputs at their binding 3 slot
+  TextureStreamer mTextureStreamer;      // resident mip levels of the textures created with CreateStreamedTexture
+  std::vector<RenderTargetHndl> mAttachmentTargets;  // indexed by the compiled graph's resource ids
+  std::optional<uint64_t> mAttachmentsHash;           // of the attachments the render targets were created for
 
   vkm::PipelineLayout mGlobalPipelineLayout;
 
@@ -70,9 +293,41 @@ struct Renderer::Impl {
 
   vkm::Buffer mInstanceSSBO[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
   vkm::Buffer mGlobalsUniform[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
-  vkm::Buffer mMaterialBuffers[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
-
-  vkm::Sampler mDefaultSampler;  // TODO: replace with a map of samplers indexed by their settings
+  vkm::Buffer mMaterialBuffer;  // deduplicated parameter blocks with stable offsets, see MaterialParamCache
+
+  // per frame sub-allocators over the persistently mapped buffers above, reset after the frame's fence is waited on
+  vkm::LinearAllocator mInstanceAllocators[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
+  MaterialParamCache mMaterialParams;
+  float mLodErrorPixels = 1.0f;  // see Renderer::SetLodErrorThreshold
+
+  // GPU culling, the draw buffers are written by the CPU and the output buffers by the cull pass
+  vkm::Buffer mCullDrawBuffers[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
+  vkm::Buffer mCullOutputBuffers[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
+  vkm::LinearAllocator mCullDrawAllocators[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
+  vkm::ComputePipeline mCullInstancesPipeline;
+  vkm::ComputePipeline mCompactDrawsPipeline;
+  vkm::ComputePipeline mCullClustersPipeline;
+
+  // parallel recording, only set up when more than one recording thread was requested
+  std::unique_ptr<WorkerPool> mRecordWorkers;
+  std::vector<RecordContext> mRecordContexts[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];  // per worker
+
+  // async compute, a frame is split into submission batches whenever the queue changes. The queues wait on each other through
+  // one timeline semaphore per queue, indexed by QueueType, signaled with an increasing value by every batch
+  std::array<RecordContext, 2> mBatchContexts[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
+  std::array<vk::raii::Semaphore, 2> mQueueTimelines = {nullptr, nullptr};
+  std::array<uint64_t, 2> mQueueTimelineValues = {0, 0};
+
+  EventPool mSplitEvents[VkRendererCtx::MAX_FRAMES_IN_FLIGHT];
+
+  SamplerCache mSamplers;  // binding 7
+
+  std::vector<uint32_t> GetSamplerSlots(std::span<const SamplerInfo> samplers) {
+    std::vector<uint32_t> slots;
+    slots.reserve(samplers.size());
+    for (auto& sampler : samplers) slots.push_back(mSamplers.Get(sampler));
+    return slots;
+  }
 };
 
 std::optional<Format> FindFirstSupportedFormat(std::span<const Format> formats, const VkRendererCtx& ctx, vk::FormatFeatureFlags formatFeatures) {
@@ -96,57 +351,218 @@ std::optional<Format> Renderer::FindFirstSupportedDepthAttachmentFormat(std::spa
   return FindFirstSupportedFormat(formats, impl->mCtx, vk::FormatFeatureFlagBits::eDepthStencilAttachment);
 }
 
+std::optional<Format> Renderer::FindFirstSupportedStorageFormat(std::span<const Format> formats) const {
+  return FindFirstSupportedFormat(formats, impl->mCtx, vk::FormatFeatureFlagBits::eStorageImage);
+}
+
 Renderer::MeshHndl Renderer::CreateMesh(const MeshData& data) {
-  auto& ctx = impl->mCtx;
+  auto& uploads = impl->mUploads;
   auto mesh = vkm::Mesh(impl->mCtx.mAllocator, data);
-  auto cmd = ctx.beginSingleTimeCommands();
 
-  auto stage = ctx.mAllocator.CreateBuffer(data.GetTotalSize(), vkm::Allocator::Stage);
-  stage.Upload(data.verts.data(), data.verts.size());
-  stage.Upload(data.indices.data(), data.indices.size() * sizeof(decltype(data.indices)::value_type), data.verts.size());
-  stage.CopyToBuffer(cmd, mesh.meshBuffer.buffer, {.size = stage.size});
-  ctx.endSingleTimeCommands(cmd);
+  // the LODs follow the full detail indices, see vkm::Mesh::Lod
+  std::vector<uint32_t> lodIndices;
+  std::span<const uint32_t> indices = data.indices;
+  if (!data.lods.empty()) {
+    lodIndices.reserve(mesh.GetNumIndices());
+    lodIndices.assign(data.indices.begin(), data.indices.end());
+    for (auto& lod : data.lods) lodIndices.insert(lodIndices.end(), lod.indices.begin(), lod.indices.end());
+    indices = lodIndices;
+  }
+
+  std::vector<uint16_t> shortIndices;
+  auto indexBytes = std::as_bytes(indices);
+  if (mesh.GetVkIndexType() == vk::IndexType::eUint16) {
+    shortIndices.assign(indices.begin(), indices.end());
+    indexBytes = std::as_bytes(std::span<const uint16_t>(shortIndices));
+  }
+
+  // all parts usually land in the same batch, the last ticket covers the whole buffer either way
+  (void)uploads.UploadBuffer(mesh.meshBuffer, data.verts);
+  mesh.uploadTicket = uploads.UploadBuffer(mesh.meshBuffer, indexBytes, mesh.GetIndexBufferOffset());
+  if (!data.meshlets.empty()) {
+    MAPLE_ASSERT(data.meshlets.back().firstIndex + data.meshlets.back().numTriangles * 3 == data.indices.size(),
+                 "meshlets have to cover the full detail indices");
+    mesh.uploadTicket = uploads.UploadBuffer(mesh.meshBuffer, std::as_bytes(data.meshlets), mesh.GetMeshletOffset());
+  }
 
   auto val = impl->mMeshPool.Add(std::move(mesh));
   return val;
 }
 
 void Renderer::DestroyMesh(MeshHndl hndl) {
+  impl->mUploads.WaitIdle();
   impl->mCtx.mDevice.device.waitIdle();
+  impl->mUploads.Discard(*impl->mMeshPool.Get(hndl).meshBuffer.buffer);
   impl->mMeshPool.Remove(hndl);
 }
 
+bool Renderer::IsMeshReady(MeshHndl hndl) const { return impl->mUploads.IsComplete(impl->mMeshPool.Get(hndl).uploadTicket); }
+
+// Color formats in output order and the depth format of a graphics pass, which its pipelines are built for
+struct PassFormats {
+  std::vector<vk::Format> colorFormats;
+  std::optional<vk::Format> depthFormat;
+};
+
+static PassFormats GetPassFormats(const RenderGraph::ExecutablePass& pass, vk::Format swapChainFormat) {
+  PassFormats formats;
+  formats.colorFormats.reserve(pass.outputs.size());
+  for (auto& output : pass.outputs) {
+    if (FormatIsDepth(output.info.format)) {
+      formats.depthFormat = ToVulkan(output.info.format);  // DrawFrame makes sure the pass only contains 1 depth attachment
+    } else {
+      // TODO: later add string output names to material info, to make sure we define the attachments in the right order
+      // index 0 in the array will be location 0 of the output attachment
+
+      // if the target is the swapchain, dynamically fetch the actual format
+      formats.colorFormats.push_back(output.resource == RenderGraph::SWAPCHAIN_RESOURCE ? swapChainFormat : ToVulkan(output.info.format));
+    }
+  }
+  return formats;
+}
+
+// Waits for a compilation, a shader that failed to compile is reported here rather than on the thread compiling it
+static std::vector<uint8_t> CollectCompiledCode(const std::shared_future<std::vector<uint8_t>>& spirv) {
+  try {
+    return spirv.get();
+  } catch (const ShaderCompileError& error) {
+    MAPLE_FATAL("{}", error.what());
+  }
+}
+
+// Hands a material whose background compilation finished its code, it's drawn with itself from now on
+static void TakeCompiledCode(Material& mat) {
+  mat.Data().shaderCode = CollectCompiledCode(mat.PendingCode());
+  mat.PendingCode() = {};
+  mat.Fallback().reset();
+}
+
 Renderer::MaterialHndl Renderer::CreateMaterial(const std::string& shaderCode, const std::string& shaderFileName, const MaterialBuilderData& data) {
+  uint64_t permutation = impl->AcquirePermutation(shaderCode, shaderFileName, data, false);
   MaterialBuilderData compiledData = data;
-  compiledData.shaderCode = compileSlangToSpirv(shaderCode, shaderFileName, data.vertEntryFuncName, data.fragEntryFuncName);
-  return impl->mMaterialPool.Add(Material(compiledData));
+  compiledData.shaderCode = CollectCompiledCode(impl->mShaderPermutations.at(permutation).spirv);
+  Material material(compiledData);
+  material.Permutation() = permutation;
+  material.SamplerSlots() = impl->GetSamplerSlots(data.samplers);
+  return impl->mMaterialPool.Add(std::move(material));
 }
 
-void Renderer::DestroyMaterial(MaterialHndl hndl) {
-  impl->mCtx.mDevice.device.waitIdle();
-  impl->mMaterialPool.Remove(hndl);
+Renderer::MaterialHndl Renderer::CreateMaterialAsync(const std::string& shaderCode,
+                                                     const std::string& shaderFileName,
+                                                     const MaterialBuilderData& data,
+                                                     std::optional<MaterialHndl> fallback) {
+  if (fallback.has_value()) {
+    MAPLE_ASSERT(impl->mMaterialPool.IsValid(*fallback), "invalid fallback material handle");
+    MAPLE_ASSERT(impl->mMaterialPool.Get(*fallback).Data().IsCompute() == data.IsCompute(),
+                 "fallback of a {} material has to be one as well",
+                 data.IsCompute() ? "compute" : "graphics");
+  }
+
+  uint64_t permutation = impl->AcquirePermutation(shaderCode, shaderFileName, data, true);
+  Material material(data);
+  material.PendingCode() = impl->mShaderPermutations.at(permutation).spirv;
+  material.Permutation() = permutation;
+  material.Fallback() = fallback;
+  material.SamplerSlots() = impl->GetSamplerSlots(data.samplers);
+
+  // the permutation may have been compiled already, for another material
+  bool compiled = material.IsCodeReady();
+  if (compiled) TakeCompiledCode(material);
+
+  auto hndl = impl->mMaterialPool.Add(std::move(material));
+  if (!compiled) impl->mPendingMaterials.push_back(hndl);
+  return hndl;
 }
 
-Renderer::TextureHndl Renderer::CreateTexture(glm::uvec2 dimensions, std::span<const uint8_t> bytes, Format format) {
+bool Renderer::IsMaterialReady(MaterialHndl hndl) const {
+  auto& mat = impl->mMaterialPool.Get(hndl);
+  return mat.IsCompiled() || mat.IsCodeReady();
+}
+
+void Renderer::PrewarmPipelines(const RenderGraph::CompileResult& compiledRenderGraph, std::span<const PipelinePrewarm> pipelines) {
   auto& ctx = impl->mCtx;
 
-  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
-  auto initialLayout = vk::ImageLayout::eUndefined;
+  struct Job {
+    Material* material;
+    PassFormats formats;
+    const MaterialBuilderData::RasterizerState* rasterizerOverride;
+    std::span<const MaterialBuilderData::SpecializationConstant> specializationConstants;
+    uint64_t variantHash;
+    std::optional<vkm::Pipeline> pipeline;
+
+    vkm::Pipeline::Variant Variant() const {
+      return {
+        .formats = {.colorFormats = formats.colorFormats, .depthFormat = formats.depthFormat},
+        .rasterizerOverride = rasterizerOverride,
+        .specializationConstants = specializationConstants,
+      };
+    }
+  };
+  std::vector<Job> jobs;
+  for (auto& prewarm : pipelines) {
+    MAPLE_ASSERT(impl->mMaterialPool.IsValid(prewarm.material), "used invalid material handle in renderer");
+    auto& mat = impl->mMaterialPool.Get(prewarm.material);
+
+    MAPLE_ASSERT(prewarm.pass.index < compiledRenderGraph.passes.size(), "no pass {} to prewarm a pipeline for", prewarm.pass.index);
+    auto& pass = compiledRenderGraph.passes[prewarm.pass.index];
+
+    // compute pipelines don't depend on the pass, their dispatches only pick specialization constants
+    PassFormats formats;
+    auto* rasterizerOverride = prewarm.rasterizerOverride ? &*prewarm.rasterizerOverride : nullptr;
+    if (mat.Data().IsCompute()) {
+      rasterizerOverride = nullptr;
+    } else {
+      formats = GetPassFormats(pass, ctx.mSwapChain.format.format);
+    }
+    vkm::Pipeline::Variant variant{
+      .formats = {.colorFormats = formats.colorFormats, .depthFormat = formats.depthFormat},
+      .rasterizerOverride = rasterizerOverride,
+      .specializationConstants = prewarm.specializationConstants,
+    };
+    uint64_t variantHash = variant.Hash();
 
-  auto img = ctx.mAllocator.CreateImage({
-    .extent = {dimensions.x, dimensions.y, 1},
-    .usage = usage,
-    .initialLayout = initialLayout,
-  });
+    auto sameVariant = [&](const Job& job) { return job.material == &mat && job.variantHash == variantHash && job.Variant() == variant; };
+    if (mat.FindPipeline(variant, variantHash) || std::ranges::any_of(jobs, sameVariant)) continue;
+
+    if (!mat.IsCompiled()) {
+      TakeCompiledCode(mat);  // waits for the background compilation
+      std::erase(impl->mPendingMaterials, prewarm.material);
+    }
+    jobs.push_back({&mat, std::move(formats), rasterizerOverride, prewarm.specializationConstants, variantHash, std::nullopt});
+  }
+
+  // jobs only build into themselves, the pipeline cache is internally synchronized
+  auto build = [&](uint32_t jobIdx, uint32_t) {
+    auto& job = jobs[jobIdx];
+    job.pipeline = vkm::Pipeline(vkm::Pipeline::CreateInfo{
+      .device = ctx.mDevice.device,
+      .layout = impl->mGlobalPipelineLayout,
+      .variant = job.Variant(),
+      .materialData = job.material->Data(),
+      .cache = impl->mPipelineCache.Get(),
+    });
+  };
+
+  auto numJobs = static_cast<uint32_t>(jobs.size());
+  if (impl->mRecordWorkers) {
+    impl->mRecordWorkers->ParallelFor(numJobs, build);
+  } else {
+    WorkerPool(std::max(1u, std::thread::hardware_concurrency())).ParallelFor(numJobs, build);
+  }
+
+  for (auto& job : jobs) job.material->AddPipeline(job.Variant(), job.variantHash, std::move(*job.pipeline));
+}
 
-  auto stageBuf = ctx.mAllocator.CreateBuffer(bytes.size(), vkm::Allocator::Stage);
-  stageBuf.Upload(bytes.data(), bytes.size());
+void Renderer::DestroyMaterial(MaterialHndl hndl) {
+  impl->mCtx.mDevice.device.waitIdle();
+  std::erase(impl->mPendingMaterials, hndl);  // a compilation still running finishes into a future nobody reads
+  if (auto permutation = impl->mMaterialPool.Get(hndl).Permutation()) impl->ReleasePermutation(*permutation);
+  impl->mMaterialPool.Remove(hndl);
+}
 
-  auto cmd = ctx.beginSingleTimeCommands();
-  img.TransitionLayout(cmd, initialLayout, vk::ImageLayout::eTransferDstOptimal);
-  img.UploadBuffer(cmd, stageBuf.buffer, dimensions.x, dimensions.y);
-  img.TransitionLayout(cmd, vk::ImageLayout::eTransferDstOptimal, ToVulkan(ImageLayout::ShaderReadOnlyOptimal));
-  ctx.endSingleTimeCommands(cmd);
+Renderer::TextureHndl Renderer::CreateTexture(glm::uvec2 dimensions, std::span<const uint8_t> bytes, Format format, uint32_t mipLevels) {
+  auto [img, ticket] = CreateTextureImage(impl->mCtx.mAllocator, impl->mUploads, dimensions, bytes, format, mipLevels);
+  auto slot = impl->mBindlessTextures.Allocate(*img.view, {});
 
   auto hndl = impl->mTexturePool.Add(RenderTarget{
     .info =
@@ -156,16 +572,29 @@ Renderer::TextureHndl Renderer::CreateTexture(glm::uvec2 dimensions, std::span<c
         .format = format,
       },
     .target = std::move(img),
+    .uploadTicket = ticket,
+    .bindlessSlot = slot,
   });
 
   return hndl;
 }
 
+Renderer::TextureHndl Renderer::CreateStreamedTexture(TextureData data) { return impl->mTextureStreamer.Add(std::move(data)); }
+
+void Renderer::SetTextureStreamingBudget(uint64_t bytes) { impl->mTextureStreamer.SetBudget(bytes); }
+
 void Renderer::DestroyTexture(TextureHndl hndl) {
+  impl->mUploads.WaitIdle();
   impl->mCtx.mDevice.device.waitIdle();
+  impl->mTextureStreamer.Remove(hndl);
+  auto& texture = impl->mTexturePool.Get(hndl);
+  impl->mUploads.Discard(*texture.target.img);
+  impl->mBindlessTextures.Free(texture.bindlessSlot);
   impl->mTexturePool.Remove(hndl);
 }
 
+bool Renderer::IsTextureReady(TextureHndl hndl) const { return impl->mUploads.IsComplete(impl->mTexturePool.Get(hndl).uploadTicket); }
+
 // FrameIdx, SwapChainIdx
 std::optional<std::pair<uint8_t, uint32_t>> acquireFrameIdxAndSwapChainIdx(const VkRendererCtx& ctx) {
   static uint8_t frameNumber = 0;
@@ -186,34 +615,164 @@ std::optional<std::pair<uint8_t, uint32_t>> acquireFrameIdxAndSwapChainIdx(const
   return std::make_pair(frameIdx, swapChainImageIdx);
 };
 
-void CreateMissingAttachments(const std::vector<RenderGraph::NameAndAttachment>& requiredAttachments,
-                              Pool<RenderTarget>& renderTargets,
-                              std::unordered_map<std::string, RenderTargetHndl>& map,
-                              VkRendererCtx& ctx) {
+// Recreates the render targets for a compiled graph's attachments, freeing those of attachments that left the graph.
+// Attachments sharing an alias slot are bound to one memory range sized for the largest of them. Transient attachments
+// drop the sampled usage and live in lazily allocated memory where the device has it, otherwise they alias like the rest.
+// Outputs of compute passes are storage images, which are never transient since the pass addresses them through bindless.
+void RecreateAttachments(const RenderGraph::CompileResult& graph,
+                         Pool<RenderTarget>& renderTargets,
+                         std::vector<RenderTargetHndl>& targets,
+                         std::vector<vkm::Allocation>& aliasMemory,
+                         BindlessTable& bindless,
+                         BindlessTable& bindlessStorage,
+                         VkRendererCtx& ctx) {
+  for (auto hndl : targets) {
+    auto& rt = renderTargets.Get(hndl);
+    if (rt.bindlessSlot != BindlessTable::INVALID_SLOT) bindless.Free(rt.bindlessSlot);
+    if (rt.storage) bindlessStorage.Free(rt.bindlessSlot);
+    renderTargets.Remove(hndl);
+  }
+  targets.clear();
+  aliasMemory.clear();
+
   glm::uvec2 swapChainSize(ctx.mSwapChain.extent.width, ctx.mSwapChain.extent.height);
+  auto& allocator = ctx.mAllocator;
+
+  std::vector<vkm::Allocator::ImageCreateInfo> infos;
+  std::vector<vk::raii::Image> images;
+  std::vector<vkm::Allocation> ownMemory(graph.attachments.size());  // attachments not placed in their alias slot
+  std::vector<vk::MemoryRequirements> slotRequirements(graph.numAliasSlots, {.size = 0, .alignment = 1, .memoryTypeBits = ~0u});
+  infos.reserve(graph.attachments.size());
+  images.reserve(graph.attachments.size());
 
-  for (auto& v : requiredAttachments) {
-    // if (!attachmentExists(v)) continue;
-    if (v.name == RenderGraph::SWAPCHAIN_TARGET_NAME) continue;  // Exclude attachment creation for the swapchain
-    auto it = map.find(v.name);
-    if (it != map.end()) continue;
+  auto isTransient = [](const RenderGraph::CompiledAttachment& v) { return v.transient && !v.storage; };
 
+  for (auto [i, v] : std::views::enumerate(graph.attachments)) {
     vk::ImageUsageFlags usage =
       FormatIsColor(v.info.format) ? vk::ImageUsageFlagBits::eColorAttachment : vk::ImageUsageFlagBits::eDepthStencilAttachment;
-    usage |= vk::ImageUsageFlagBits::eSampled;  // all render targets assumed to be sampleable cus of bindless
+    // all other render targets assumed to be sampleable cus of bindless
+    usage |= isTransient(v) ? vk::ImageUsageFlagBits::eTransientAttachment : vk::ImageUsageFlagBits::eSampled;
+    if (v.storage) {
+      // sRGB and depth formats usually can't be storage images, an image with the usage anyway would be invalid
+      if (!FindFirstSupportedFormat(std::span(&v.info.format, 1), ctx, vk::FormatFeatureFlagBits::eStorageImage).has_value())
+        MAPLE_FATAL("attachment '{}' is written by a compute pass but its format doesn't support storage images", v.name);
+      usage |= vk::ImageUsageFlagBits::eStorage;
+    }
 
     auto size = v.info.GetAbsoluteSize(swapChainSize);
+    auto& info = infos.emplace_back(vkm::Allocator::ImageCreateInfo{
+      .format = ToVulkan(v.info.format),
+      .extent = {size.x, size.y, 1},
+      .usage = usage,
+      .aspectMask = GetImageAspectFlags(v.info.format),
+    });
+    auto& img = images.emplace_back(allocator.CreateUnboundImage(info));
+    auto requirements = img.getMemoryRequirements();
+
+    if (isTransient(v)) ownMemory[i] = allocator.AllocateImageMemory(requirements, vk::MemoryPropertyFlagBits::eLazilyAllocated);
+    if (ownMemory[i]) continue;
+
+    auto& slot = slotRequirements[v.aliasSlot];
+    if (!(slot.memoryTypeBits & requirements.memoryTypeBits)) {
+      // no memory type works for everything in the slot, rare enough to just give this one its own memory
+      ownMemory[i] = allocator.AllocateImageMemory(requirements, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      if (!ownMemory[i]) MAPLE_FATAL("failed to find required memory type idx");
+      continue;
+    }
+    slot.size = std::max(slot.size, requirements.size);
+    slot.alignment = std::max(slot.alignment, requirements.alignment);
+    slot.memoryTypeBits &= requirements.memoryTypeBits;
+  }
+
+  aliasMemory.resize(graph.numAliasSlots);
+  for (auto [slotIdx, requirements] : std::views::enumerate(slotRequirements)) {
+    if (requirements.size == 0) continue;
+    aliasMemory[slotIdx] = allocator.AllocateImageMemory(requirements, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    if (!aliasMemory[slotIdx]) MAPLE_FATAL("failed to find required memory type idx");
+  }
+
+  for (auto [i, v] : std::views::enumerate(graph.attachments)) {
+    auto& memory = ownMemory[i] ? ownMemory[i] : aliasMemory[v.aliasSlot];
+    images[i].bindMemory(memory.Memory(), memory.Offset());
+
+    auto view = allocator.CreateImageView(images[i], infos[i]);
+    auto slot = isTransient(v) ? BindlessTable::INVALID_SLOT : bindless.Allocate(*view, {});
+    if (v.storage) bindlessStorage.Assign(slot, *view, {}, vk::ImageLayout::eGeneral);
     auto hndl = renderTargets.Add(RenderTarget{
       .info = v.info,
-      .target = ctx.mAllocator.CreateImage({
-        .format = ToVulkan(v.info.format),
-        .extent = {size.x, size.y, 1},
-        .usage = usage,
-        .aspectMask = GetImageAspectFlags(v.info.format),
-      }),
+      .target = {.img = std::move(images[i]), .memory = std::move(ownMemory[i]), .view = std::move(view), .extent = infos[i].extent},
+      .bindlessSlot = slot,
+      .storage = v.storage,
     });
 
-    map[v.name] = hndl;
+    targets.push_back(hndl);
+  }
+}
+
+// Records draws [drawBegin, drawEnd) of a pass, binding the pipeline of every material draw overlapping the range
+static void RecordDraws(const vk::raii::CommandBuffer& cmd, const DrawRecordInfo& info, uint32_t drawBegin, uint32_t drawEnd) {
+  cmd.setViewport(0, vk::Viewport{0.0f, 0.0f, static_cast<float>(info.renderingArea.x), static_cast<float>(info.renderingArea.y), 0.0f, 1.0f});
+  vk::Rect2D scissor{vk::Offset2D{0, 0}, vk::Extent2D{.width = info.renderingArea.x, .height = info.renderingArea.y}};
+  cmd.setScissor(0, {scissor});
+
+  // TODO: optimize this depending on if its a graphics pipeline or a compute pipeline
+  auto stageFlags = ToVulkan(ShaderStage::AllGraphicsAndCompute);
+
+  for (auto& material : info.materials) {
+    uint32_t begin = std::max(drawBegin, material.firstDraw);
+    uint32_t end = std::min(drawEnd, material.firstDraw + material.numDraws);
+    if (begin >= end) continue;
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, material.pipeline);
+    vk::Buffer boundIndexBuffer = nullptr;
+    for (auto& draw : info.draws.subspan(begin, end - begin)) {
+      cmd.pushConstants<DrawPush>(info.layout, stageFlags, 0, draw.push);
+
+      if (draw.cullBatch) {
+        auto& batch = *draw.cullBatch;
+        cmd.drawIndirectCount(info.cullOutput,
+                              batch.commandsOffset * sizeof(uint32_t),
+                              info.cullOutput,
+                              batch.push.outputOffset * sizeof(uint32_t),
+                              batch.maxCommands,
+                              sizeof(vk::DrawIndirectCommand));
+      } else {
+        // consecutive draws of the same mesh keep its index buffer bound
+        if (draw.indexBuffer != boundIndexBuffer) {
+          cmd.bindIndexBuffer(draw.indexBuffer, draw.indexOffset, draw.indexType);
+          boundIndexBuffer = draw.indexBuffer;
+        }
+        cmd.drawIndexed(draw.indexCount, draw.instanceCount, draw.firstIndex, 0, 0);
+      }
+    }
+  }
+}
+
+void Renderer::SetLodErrorThreshold(float pixels) {
+  MAPLE_ASSERT(pixels > 0.0f, "LOD error threshold has to be positive, got {}", pixels);
+  impl->mLodErrorPixels = pixels;
+}
+
+void Renderer::SetRecordingThreads(uint32_t numThreads) {
+  auto& ctx = impl->mCtx;
+  ctx.mDevice.device.waitIdle();
+
+  bool parallel = numThreads > 1;
+  impl->mRecordWorkers = parallel ? std::make_unique<WorkerPool>(numThreads) : nullptr;
+
+  for (auto& contexts : impl->mRecordContexts) {
+    contexts.clear();
+    if (!parallel) continue;
+
+    for (uint32_t i = 0; i < numThreads; i++) {
+      contexts.push_back(RecordContext{
+        .pool = vk::raii::CommandPool(ctx.mDevice.device,
+                                      {
+                                        .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                                        .queueFamilyIndex = ctx.mPhysicalDevice.queueFamilyIndices.graphics,
+                                      }),
+      });
+    }
   }
 }
 
@@ -222,8 +781,31 @@ void Renderer::DrawFrame(const UBO& frameUBO, const RenderGraph::CompileResult&
   auto& renderTargets = impl->mRenderTargets;
   auto& texturePool = impl->mTexturePool;
 
-  // TODO: manage and remove unused attachments
-  CreateMissingAttachments(compiledRenderGraph.attachments, renderTargets, impl->mRenderTargetMap, ctx);
+  // attachments are only rebuilt when the graph's change, or after a resize cleared the hash they were built for
+  if (compiledRenderGraph.attachmentsHash != impl->mAttachmentsHash) {
+    ctx.mDevice.device.waitIdle();
+    RecreateAttachments(compiledRenderGraph,
+                        renderTargets,
+                        impl->mAttachmentTargets,
+                        impl->mAliasMemory,
+                        impl->mBindlessTextures,
+                        impl->mBindlessStorageImages,
+                        ctx);
+    impl->mAttachmentsHash = compiledRenderGraph.attachmentsHash;
+  }
+
+  // materials whose background compilation finished replace their fallback from this frame on
+  std::erase_if(impl->mPendingMaterials, [&](MaterialHndl hndl) {
+    auto& mat = impl->mMaterialPool.Get(hndl);
+    if (!mat.IsCodeReady()) return false;
+    TakeCompiledCode(mat);
+    return true;
+  });
+
+  // submit everything created since last frame and find out which earlier uploads have landed
+  auto& uploads = impl->mUploads;
+  uploads.Flush();
+  uploads.Update();
 
   auto result = acquireFrameIdxAndSwapChainIdx(ctx);
   if (!result.has_value()) return;  // timeout
@@ -233,107 +815,601 @@ void Renderer::DrawFrame(const UBO& frameUBO, const RenderGraph::CompileResult&
 
   impl->mGlobalsUniform[frameIdx].Upload(&frameUBO, sizeof(frameUBO));
 
-  // TODO: optimize
-  uint32_t textureArrayOffset = 0;
-  {
-    uint32_t activeCount = renderTargets.ActiveCount();
-    while (textureArrayOffset != activeCount) {
-      if (!renderTargets.IsValid(textureArrayOffset)) {
-        textureArrayOffset++;
-        continue;
+  // streamed textures whose new levels landed are swapped into their slots, before the slots are written below
+  impl->mTextureStreamer.Update();
+
+  // only slots created, destroyed or recreated since this frame's set was last used get written
+  impl->mBindlessTextures.WriteDirty(
+    ctx.mDevice.device, *impl->mGlobalDescriptorSets.sets[frameIdx], frameIdx, vk::DescriptorType::eSampledImage);
+  impl->mSamplers.Table().WriteDirty(ctx.mDevice.device, *impl->mGlobalDescriptorSets.sets[frameIdx], frameIdx, vk::DescriptorType::eSampler);
+  impl->mBindlessStorageImages.WriteDirty(
+    ctx.mDevice.device, *impl->mGlobalDescriptorSets.sets[frameIdx], frameIdx, vk::DescriptorType::eStorageImage);
+
+  cmd.reset();
+  cmd.begin({});
+  uploads.RecordAcquireBarriers(cmd);
+  // command buffers of a compute-only queue family may only name the compute stage
+  auto bindGlobalDescriptorSet = [&](const vk::raii::CommandBuffer& target, vk::ShaderStageFlags stages = ToVulkan(ShaderStage::AllGraphicsAndCompute)) {
+    target.bindDescriptorSets2({
+      .sType = vk::StructureType::eBindDescriptorSetsInfo,
+      .pNext = nullptr,
+      .stageFlags = stages,
+      .layout = impl->mGlobalPipelineLayout.GetLayout(),
+      .firstSet = 0,
+      .descriptorSetCount = 1,
+      .pDescriptorSets = &(*impl->mGlobalDescriptorSets.sets[frameIdx]),
+      .dynamicOffsetCount = 0,
+      .pDynamicOffsets = nullptr,
+    });
+  };
+  bindGlobalDescriptorSet(cmd);
+
+  // the frame's fence has been waited on, so its slice of the instance buffer is free to overwrite and material blocks
+  // unused since then can be freed
+  auto& instanceAllocator = impl->mInstanceAllocators[frameIdx];
+  auto& cullDrawAllocator = impl->mCullDrawAllocators[frameIdx];
+  instanceAllocator.Reset();
+  impl->mMaterialParams.NextFrame();
+  cullDrawAllocator.Reset();
+  for (auto& recordContext : impl->mRecordContexts[frameIdx]) recordContext.Reset();
+  for (auto& batchContext : impl->mBatchContexts[frameIdx]) batchContext.Reset();
+  impl->mSplitEvents[frameIdx].Reset();
+
+  using UsedResources = std::span<const UsedResource>;
+
+  auto resourcesReady = [&](UsedResources usedResources) {
+    return std::ranges::all_of(usedResources, [&](const auto& usedResource) {
+      auto* res = std::get_if<TextureHndl>(&usedResource);
+      return !res || !texturePool.IsValid(*res) || uploads.IsComplete(texturePool.Get(*res).uploadTicket);
+    });
+  };
+
+  // the material to draw with, its fallback while it still compiles, or nullptr to skip the draw
+  auto resolveMaterial = [&](MaterialHndl hndl) -> Material* {
+    MAPLE_ASSERT(impl->mMaterialPool.IsValid(hndl), "used invalid material handle in renderer");
+    auto* mat = &impl->mMaterialPool.Get(hndl);
+    if (mat->IsCompiled()) return mat;
+
+    auto fallback = mat->Fallback();
+    if (!fallback.has_value() || !impl->mMaterialPool.IsValid(*fallback)) return nullptr;
+    mat = &impl->mMaterialPool.Get(*fallback);
+    return mat->IsCompiled() ? mat : nullptr;
+  };
+
+  // the material's pipeline for a variant, built the first time the material is used with it
+  auto getPipeline = [&](Material& mat, const vkm::Pipeline::Variant& variant, uint64_t variantHash) -> vk::Pipeline {
+    auto* pipeline = mat.FindPipeline(variant, variantHash);
+    if (!pipeline) {
+      pipeline = &mat.AddPipeline(variant,
+                                  variantHash,
+                                  vkm::Pipeline(vkm::Pipeline::CreateInfo{
+                                    .device = ctx.mDevice.device,
+                                    .layout = impl->mGlobalPipelineLayout,
+                                    .variant = variant,
+                                    .materialData = mat.Data(),
+                                    .cache = impl->mPipelineCache.Get(),
+                                  }));
+    }
+    return *pipeline->GetPipeline();
+  };
+
+  // scale of the instance's largest axis and view space distance to the closest point of its bounding sphere, which is 0 or
+  // less once the camera is inside it
+  auto instanceDistance = [&](const vkm::Mesh& mesh, const InstanceTransform& instance) -> std::pair<float, float> {
+    auto center = glm::vec4(glm::vec3(mesh.boundingSphere), 1.0f);
+    auto worldCenter = glm::vec4(glm::dot(instance.rows[0], center), glm::dot(instance.rows[1], center), glm::dot(instance.rows[2], center), 1.0f);
+    glm::vec3 axisX(instance.rows[0].x, instance.rows[1].x, instance.rows[2].x);
+    glm::vec3 axisY(instance.rows[0].y, instance.rows[1].y, instance.rows[2].y);
+    glm::vec3 axisZ(instance.rows[0].z, instance.rows[1].z, instance.rows[2].z);
+    float scale = std::sqrt(std::max({glm::dot(axisX, axisX), glm::dot(axisY, axisY), glm::dot(axisZ, axisZ)}));
+    return {scale, glm::length(glm::vec3(frameUBO.view * worldCenter)) - mesh.boundingSphere.w * scale};
+  };
+
+  // LOD selection by projected size, see vkm::Mesh::SelectLod. cullInstances of the cull shader does the same on the GPU
+  float lodScale = 0.5f * static_cast<float>(ctx.mSwapChain.extent.height) / impl->mLodErrorPixels;
+  std::vector<uint32_t> instanceLods;
+  auto selectLod = [&](const vkm::Mesh& mesh, const InstanceTransform& instance) -> uint32_t {
+    if (mesh.GetNumLods() == 1) return 0;
+
+    // the full detail mesh once the camera is inside the bounding sphere
+    auto [scale, distance] = instanceDistance(mesh, instance);
+    if (distance <= 0.0f) return 0;
+    return mesh.SelectLod(scale * std::abs(frameUBO.proj[1][1]) * lodScale / distance);
+  };
+
+  auto meshDrawReady = [&](const MeshDraw& meshDraw) {
+    return uploads.IsComplete(impl->mMeshPool.Get(meshDraw.mesh).uploadTicket) && resourcesReady(meshDraw.usedResources);
+  };
+
+  // streamed textures ask for the level their largest instance on screen needs, estimated as if the texture was mapped once
+  // over the mesh's bounding sphere. Compute passes don't know, they get every level
+  auto& streamer = impl->mTextureStreamer;
+  float pixelsPerUnit = 0.5f * static_cast<float>(ctx.mSwapChain.extent.height) * std::abs(frameUBO.proj[1][1]);
+  for (auto& passDraw : passDraws) {
+    for (auto& materialDraw : passDraw.materialDraws) {
+      for (auto& meshDraw : materialDraw.meshes) {
+        std::optional<float> pixels;
+        for (auto& usedResource : meshDraw.usedResources) {
+          auto* res = std::get_if<TextureHndl>(&usedResource);
+          if (!res || !streamer.IsStreamed(*res)) continue;
+
+          if (!pixels.has_value()) {
+            auto& mesh = impl->mMeshPool.Get(meshDraw.mesh);
+            pixels = 0.0f;
+            for (auto& instance : meshDraw.instanceData) {
+              auto [scale, distance] = instanceDistance(mesh, instance);
+              float diameter = distance <= 0.0f ? INFINITY : 2.0f * mesh.boundingSphere.w * scale * pixelsPerUnit / distance;
+              pixels = std::max(*pixels, diameter);
+            }
+          }
+          streamer.Request(*res, streamer.MipForScreenSize(*res, *pixels));
+        }
+      }
+    }
+    for (auto& dispatch : passDraw.dispatches) {
+      for (auto& usedResource : dispatch.usedResources) {
+        auto* res = std::get_if<TextureHndl>(&usedResource);
+        if (res && streamer.IsStreamed(*res)) streamer.Request(*res, 0);
+      }
+    }
+  }
+
+  // returns the element offset of the draw's texture slots, followed by the material's sampler slots, in the material buffer.
+  // The same for every draw and frame using the same slots
+  std::vector<uint32_t> materialSlots;
+  auto writeMaterialSlots = [&](UsedResources usedResources, const Material& mat) -> uint32_t {
+    materialSlots.resize(usedResources.size());
+    for (auto [resourceIdx, usedResource] : std::views::enumerate(usedResources)) {
+      uint32_t slot = 0;
+
+      if (auto* attachment = std::get_if<RenderGraph::AttachmentRef>(&usedResource)) {
+        MAPLE_ASSERT(attachment->id < impl->mAttachmentTargets.size(), "meshDraw resource attachment {} is out of range", attachment->id);
+        auto& name = compiledRenderGraph.ResourceName(attachment->id);
+        slot = renderTargets.Get(impl->mAttachmentTargets[attachment->id]).bindlessSlot;
+        MAPLE_ASSERT(slot != BindlessTable::INVALID_SLOT, "attachment '{}' is not an input of any pass, so it isn't sampleable", name);
+      } else if (auto* res = std::get_if<TextureHndl>(&usedResource)) {
+        MAPLE_ASSERT(texturePool.IsValid(*res), "invalid meshDraw resource texture '{}'", *res);
+        slot = texturePool.Get(*res).bindlessSlot;
+      } else {
+        MAPLE_FATAL("unknown mesh draw resource");
+      }
+
+      materialSlots[resourceIdx] = slot;
+    }
+    materialSlots.insert(materialSlots.end(), mat.SamplerSlots().begin(), mat.SamplerSlots().end());
+    return impl->mMaterialParams.Get(materialSlots);
+  };
+
+  auto bufferAddress = [&](const vkm::Buffer& buffer) {
+    VkBufferDeviceAddressInfo info{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR};
+    info.buffer = *buffer.buffer;
+    return vkGetBufferDeviceAddress(*ctx.mDevice.device, &info);
+  };
+
+  auto memoryBarrier = [&](vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess, vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess) {
+    vk::MemoryBarrier2 barrier{.srcStageMask = srcStage, .srcAccessMask = srcAccess, .dstStageMask = dstStage, .dstAccessMask = dstAccess};
+    cmd.pipelineBarrier2(vk::DependencyInfo{.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+  };
+
+  // GPU culled material draws are culled and compacted into indirect draws before any pass starts rendering. Meshes with
+  // meshlets go into a separate cluster batch of the material draw, culled meshlet by meshlet instead of as a whole
+  std::unordered_map<const MaterialDraw*, MaterialCullBatches> cullBatches;
+  uint32_t cullOutputHead = 0;
+  uint32_t clusterTasks = 0;
+
+  auto reserveCullOutput = [&](uint32_t size) {
+    uint32_t offset = cullOutputHead;
+    cullOutputHead += size;
+    if (cullOutputHead > CULL_OUTPUT_SIZE) MAPLE_FATAL("cull output buffer out of memory, {} of {} elements required", cullOutputHead, CULL_OUTPUT_SIZE);
+    return offset;
+  };
+
+  for (auto& passDraw : passDraws) {
+    for (auto& materialDraw : passDraw.materialDraws) {
+      if (!materialDraw.gpuCulling) continue;
+      auto* mat = resolveMaterial(materialDraw.material);
+      if (!mat) continue;
+
+      // meshlet normal cones are built from counter clockwise front faces, other states keep every cluster
+      auto& rasterizer = materialDraw.rasterizerOverride ? *materialDraw.rasterizerOverride : mat->Data().rasterizer;
+      bool coneCulling = rasterizer.cullMode == MaterialBuilderData::CullModeFlagBits::Back &&
+                         rasterizer.frontFace == MaterialBuilderData::FrontFace::CounterClockwise;
+
+      // the batch of every ready mesh draw. Meshes with meshlets past the frame's cluster task budget are culled as a whole
+      enum class CullKind : uint8_t { Skipped, Instances, Clusters };
+      std::vector<CullKind> kinds(materialDraw.meshes.size(), CullKind::Skipped);
+      uint32_t numInstanceDraws = 0;
+      uint32_t numClusterDraws = 0;
+      for (auto [meshIdx, meshDraw] : std::views::enumerate(materialDraw.meshes)) {
+        if (meshDraw.instanceData.empty() || !meshDrawReady(meshDraw)) continue;
+        size_t tasks = meshDraw.instanceData.size() * impl->mMeshPool.Get(meshDraw.mesh).GetNumMeshlets();
+        if (tasks > 0 && clusterTasks + tasks <= MAX_CULL_CLUSTER_TASKS) {
+          clusterTasks += static_cast<uint32_t>(tasks);
+          numClusterDraws++;
+          kinds[meshIdx] = CullKind::Clusters;
+        } else {
+          numInstanceDraws++;
+          kinds[meshIdx] = CullKind::Instances;
+        }
       }
 
-      vk::DescriptorImageInfo imgInfo{};
-      imgInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-      imgInfo.imageView = renderTargets.Get(textureArrayOffset).target.view;
-      imgInfo.sampler = impl->mDefaultSampler.sampler;
+      auto draws = cullDrawAllocator.Allocate<CullDraw>(numInstanceDraws + numClusterDraws);
+      CullPush push{
+        .drawOffset = draws.Index(),
+        .numDraws = 0,
+        .firstInstance = 0,
+        .numInstances = 0,
+        .outputOffset = 0,
+        .lodScale = lodScale,
+        .coneCulling = 0,
+      };
+      CullPush clusterPush{
+        .drawOffset = draws.Index() + numInstanceDraws,
+        .numDraws = 0,
+        .firstInstance = 0,
+        .numInstances = 0,
+        .outputOffset = 0,
+        .lodScale = lodScale,
+        .coneCulling = coneCulling ? 1u : 0u,
+      };
+
+      // instances of a batch are allocated back to back, so the cull shader can find a draw from an instance index
+      for (auto kind : {CullKind::Instances, CullKind::Clusters}) {
+        for (auto [meshIdx, meshDraw] : std::views::enumerate(materialDraw.meshes)) {
+          if (kinds[meshIdx] != kind) continue;
+          auto& mesh = impl->mMeshPool.Get(meshDraw.mesh);
 
-      vk::WriteDescriptorSet write{};
-      write.dstSet = *impl->mGlobalDescriptorSets.sets[frameIdx], write.dstBinding = 3, write.dstArrayElement = textureArrayOffset,
-      write.descriptorCount = 1, write.descriptorType = vk::DescriptorType::eCombinedImageSampler, write.pImageInfo = &imgInfo,
+          auto instances = instanceAllocator.Allocate<InstanceTransform>(meshDraw.instanceData.size());
+          std::ranges::copy(meshDraw.instanceData, instances.data.begin());
+          auto instanceCount = static_cast<uint32_t>(meshDraw.instanceData.size());
 
-      ctx.mDevice.device.updateDescriptorSets(write, {});
-      textureArrayOffset++;
+          bool clusters = kind == CullKind::Clusters;
+          auto& batchPush = clusters ? clusterPush : push;
+          if (batchPush.numDraws == 0) batchPush.firstInstance = instances.Index();
+
+          // the cluster batch's draws follow the instance batch's
+          batchPush.numDraws++;
+          auto& draw = draws.data[push.numDraws + clusterPush.numDraws - 1];
+          draw = CullDraw{
+            .boundingSphere = mesh.boundingSphere,
+            .vertexBufferAddress = bufferAddress(mesh.meshBuffer),
+            .indexBufferOffset = mesh.GetIndexBufferOffset(),
+            .materialBufferOffset = writeMaterialSlots(meshDraw.usedResources, *mat),
+            .instanceBufferIndex = instances.Index(),
+            .instanceCount = instanceCount,
+            .visibleOffset = 0,
+            .indexSize = mesh.GetIndexSize(),
+            .numLods = mesh.GetNumLods(),
+            .firstClusterTask = 0,
+            .meshletOffset = mesh.GetMeshletOffset(),
+            .numMeshlets = mesh.GetNumMeshlets(),
+            .positionOffset = {mesh.quantization.positionOffset.x, mesh.quantization.positionOffset.y, mesh.quantization.positionOffset.z},
+            .positionScale = {mesh.quantization.positionScale.x, mesh.quantization.positionScale.y, mesh.quantization.positionScale.z},
+          };
+          for (uint32_t lod = 0; lod < mesh.GetNumLods(); lod++) {
+            draw.lodErrors[lod] = mesh.GetLod(lod).error;
+            draw.lodFirstIndices[lod] = mesh.GetLod(lod).firstIndex;
+            draw.lodIndexCounts[lod] = mesh.GetLod(lod).numIndices;
+          }
+
+          // a cluster batch runs a cull task per meshlet of every instance
+          if (clusters) {
+            draw.firstClusterTask = clusterPush.numInstances;
+            clusterPush.numInstances += instanceCount * mesh.GetNumMeshlets();
+          } else {
+            push.numInstances += instanceCount;
+          }
+        }
+      }
+
+      auto& batches = cullBatches[&materialDraw];
+      if (push.numDraws > 0) {
+        CullBatch batch{.push = push, .maxCommands = push.numDraws};
+        batch.push.outputOffset = reserveCullOutput(1 + 2 * push.numDraws + 6 * push.numDraws + push.numInstances);
+        batch.commandsOffset = batch.push.outputOffset + 1 + 2 * push.numDraws;
+        batch.drawIdsOffset = batch.commandsOffset + push.numDraws * 4;
+        uint32_t visibleBase = batch.drawIdsOffset + 2 * push.numDraws;
+        for (auto& draw : draws.data.first(push.numDraws)) draw.visibleOffset = visibleBase + draw.instanceBufferIndex - push.firstInstance;
+        batches.instances = batch;
+      }
+      if (clusterPush.numDraws > 0) {
+        // every task may emit a command, a single instance meshlet draw
+        CullBatch batch{.push = clusterPush, .maxCommands = clusterPush.numInstances, .clusters = true};
+        batch.push.outputOffset = reserveCullOutput(1 + 7 * clusterPush.numInstances);
+        batch.commandsOffset = batch.push.outputOffset + 1;
+        batch.drawIdsOffset = batch.commandsOffset + clusterPush.numInstances * 4;
+        batches.clusters = batch;
+      }
+      if (!batches.instances && !batches.clusters) cullBatches.erase(&materialDraw);
     }
   }
 
-  std::unordered_map<TextureHndl, uint32_t> textureSlotMap;
+  if (!cullBatches.empty()) {
+    auto& cullOutput = impl->mCullOutputBuffers[frameIdx];
+    auto stageFlags = ToVulkan(ShaderStage::AllGraphicsAndCompute);
 
-  {
-    uint32_t updated = 0;
-    uint32_t activeCount = texturePool.ActiveCount();
-    while (updated != activeCount) {
-      if (!texturePool.IsValid(updated)) {
-        updated++;
-        continue;
+    // only the draw count and the per draw visible counts & LODs need to start at zero, cluster batches only have a count
+    for (auto& [_, batches] : cullBatches) {
+      if (batches.instances) {
+        auto& batch = *batches.instances;
+        cmd.fillBuffer(*cullOutput.buffer, batch.push.outputOffset * sizeof(uint32_t), (1 + 2 * batch.push.numDraws) * sizeof(uint32_t), 0);
       }
+      if (batches.clusters) cmd.fillBuffer(*cullOutput.buffer, batches.clusters->push.outputOffset * sizeof(uint32_t), sizeof(uint32_t), 0);
+    }
+    memoryBarrier(vk::PipelineStageFlagBits2::eTransfer,
+                  vk::AccessFlagBits2::eTransferWrite,
+                  vk::PipelineStageFlagBits2::eComputeShader,
+                  vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+    // cluster batches are done after this pass already, they emit their commands directly
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, impl->mCullInstancesPipeline.GetPipeline());
+    for (auto& [_, batches] : cullBatches) {
+      if (!batches.instances) continue;
+      cmd.pushConstants<CullPush>(impl->mGlobalPipelineLayout.GetLayout(), stageFlags, 0, batches.instances->push);
+      cmd.dispatch((batches.instances->push.numInstances + 63) / 64, 1, 1);
+    }
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, impl->mCullClustersPipeline.GetPipeline());
+    for (auto& [_, batches] : cullBatches) {
+      if (!batches.clusters) continue;
+      cmd.pushConstants<CullPush>(impl->mGlobalPipelineLayout.GetLayout(), stageFlags, 0, batches.clusters->push);
+      cmd.dispatch((batches.clusters->push.numInstances + 63) / 64, 1, 1);
+    }
+    memoryBarrier(vk::PipelineStageFlagBits2::eComputeShader,
+                  vk::AccessFlagBits2::eShaderStorageWrite,
+                  vk::PipelineStageFlagBits2::eComputeShader,
+                  vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, impl->mCompactDrawsPipeline.GetPipeline());
+    for (auto& [_, batches] : cullBatches) {
+      if (!batches.instances) continue;
+      cmd.pushConstants<CullPush>(impl->mGlobalPipelineLayout.GetLayout(), stageFlags, 0, batches.instances->push);
+      cmd.dispatch((batches.instances->push.numDraws + 63) / 64, 1, 1);
+    }
+    memoryBarrier(vk::PipelineStageFlagBits2::eComputeShader,
+                  vk::AccessFlagBits2::eShaderStorageWrite,
+                  vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+                  vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead);
+  }
 
-      uint32_t arrayIdx = textureArrayOffset + updated;
-      textureSlotMap[updated] = arrayIdx;
+  // The frame is submitted in batches, a new one starts whenever the next pass runs on the other queue or has to wait for
+  // work submitted there since the open batch started. Batches signal their queue's timeline and wait on the other one's.
+  // Without async compute passes everything stays in the frame's command buffer, a single batch
+  auto& families = ctx.mPhysicalDevice.queueFamilyIndices;
+  auto& timelines = impl->mQueueTimelines;
+  auto& timelineValues = impl->mQueueTimelineValues;
+  auto queueIdx = [](QueueType queue) { return static_cast<size_t>(queue); };
+  auto otherQueueIdx = [](QueueType queue) { return queue == QueueType::Graphics ? size_t{1} : size_t{0}; };
+  bool asyncCompute = std::ranges::any_of(compiledRenderGraph.passes, [](auto& pass) { return pass.queue == QueueType::AsyncCompute; });
+
+  const vk::raii::CommandBuffer* batchCmd = &cmd;
+  QueueType batchQueue = QueueType::Graphics;
+  uint64_t batchWaitValue = 0;  // value of the other queue's timeline the open batch waits on, 0 for none
+  bool batchUsesSwapChain = false;
+  bool firstBatch = true;
+  bool waitedPresent = false;
+
+  // barriers are collected until the next pass records work, so a pass' releases, the present transition and the next pass'
+  // transitions go out in as few calls as possible
+  std::vector<vk::ImageMemoryBarrier2> pendingBarriers;
+  auto flushBarriers = [&](const vk::raii::CommandBuffer& target) {
+    if (pendingBarriers.empty()) return;
+    target.pipelineBarrier2(
+      vk::DependencyInfo{.imageMemoryBarrierCount = static_cast<uint32_t>(pendingBarriers.size()), .pImageMemoryBarriers = pendingBarriers.data()});
+    pendingBarriers.clear();
+  };
 
-      vk::DescriptorImageInfo imgInfo{};
-      imgInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-      imgInfo.imageView = texturePool.Get(updated).target.view;
-      imgInfo.sampler = impl->mDefaultSampler.sampler;
+  auto submitBatch = [&](bool lastBatch) {
+    flushBarriers(*batchCmd);
+    batchCmd->end();
 
-      vk::WriteDescriptorSet write{};
-      write.dstSet = *impl->mGlobalDescriptorSets.sets[frameIdx], write.dstBinding = 3, write.dstArrayElement = arrayIdx, write.descriptorCount = 1,
-      write.descriptorType = vk::DescriptorType::eCombinedImageSampler, write.pImageInfo = &imgInfo,
+    std::vector<vk::SemaphoreSubmitInfo> waits;
+    if (firstBatch) waits.push_back(uploads.GraphicsWaitInfo());
+    if (batchUsesSwapChain && !waitedPresent) {
+      waits.push_back({.semaphore = *frameData.presentCompleteSem, .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput});
+      waitedPresent = true;
+    }
+    if (batchWaitValue > 0) {
+      waits.push_back(
+        {.semaphore = *timelines[otherQueueIdx(batchQueue)], .value = batchWaitValue, .stageMask = vk::PipelineStageFlagBits2::eAllCommands});
+    }
 
-      ctx.mDevice.device.updateDescriptorSets(write, {});
-      updated++;
+    auto& timelineValue = timelineValues[queueIdx(batchQueue)];
+    std::vector<vk::SemaphoreSubmitInfo> signals = {
+      {.semaphore = *timelines[queueIdx(batchQueue)], .value = ++timelineValue, .stageMask = vk::PipelineStageFlagBits2::eAllCommands},
+    };
+    if (lastBatch) {
+      signals.push_back({.semaphore = *ctx.mRenderCompleteSems[swapChainImageIdx], .stageMask = vk::PipelineStageFlagBits2::eAllCommands});
     }
+
+    vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = **batchCmd};
+    auto& queue = batchQueue == QueueType::Graphics ? ctx.mDevice.queues.graphics : ctx.mDevice.queues.compute;
+    queue.submit2(
+      vk::SubmitInfo2{
+        .waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size()),
+        .pWaitSemaphoreInfos = waits.data(),
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &cmdInfo,
+        .signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size()),
+        .pSignalSemaphoreInfos = signals.data(),
+      },
+      lastBatch ? *frameData.drawFence : vk::Fence{});
+
+    firstBatch = false;
+    batchCmd = nullptr;
+  };
+
+  auto openBatch = [&](QueueType queue, uint64_t waitValue) {
+    batchCmd = &impl->mBatchContexts[frameIdx][queueIdx(queue)].Acquire(ctx.mDevice.device);
+    batchCmd->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    batchQueue = queue;
+    batchWaitValue = waitValue;
+    batchUsesSwapChain = false;
+    bindGlobalDescriptorSet(*batchCmd,
+                            queue == QueueType::Graphics ? ToVulkan(ShaderStage::AllGraphicsAndCompute) : vk::ShaderStageFlags(vk::ShaderStageFlagBits::eCompute));
+  };
+
+  // compute batches start after the uploads were acquired and the cull pass ran, so the prelude goes out on its own
+  uint64_t preludeValue = 0;
+  if (asyncCompute) {
+    submitBatch(false);
+    preludeValue = timelineValues[queueIdx(QueueType::Graphics)];
   }
 
-  cmd.reset();
-  cmd.begin({});
-  cmd.bindDescriptorSets2({
-    .sType = vk::StructureType::eBindDescriptorSetsInfo,
-    .pNext = nullptr,
-    .stageFlags = ToVulkan(ShaderStage::AllGraphics),
-    .layout = impl->mGlobalPipelineLayout.GetLayout(),
-    .firstSet = 0,
-    .descriptorSetCount = 1,
-    .pDescriptorSets = &(*impl->mGlobalDescriptorSets.sets[frameIdx]),
-    .dynamicOffsetCount = 0,
-    .pDynamicOffsets = nullptr,
-  });
+  auto queueFamily = [&](QueueType queue) { return queue == QueueType::Graphics ? families.graphics : families.compute; };
 
-  std::vector<glm::mat4> instanceData;
-  instanceData.reserve(NUM_INSTANCES);
+  auto getImgAndAspect = [&](RenderGraph::ResourceId resource) -> std::pair<vk::Image, vk::ImageAspectFlags> {
+    if (resource == RenderGraph::SWAPCHAIN_RESOURCE) return std::make_pair(ctx.mSwapChain.images[swapChainImageIdx].img, vk::ImageAspectFlagBits::eColor);
+    auto& v = renderTargets.Get(impl->mAttachmentTargets[resource]);
+    return std::make_pair(*v.target.img, GetImageAspectFlags(v.info.format));
+  };
 
-  std::vector<uint32_t> materialBuffer;
-  materialBuffer.reserve(NUM_MATERIALS);
+  // A transition to another queue is recorded twice: as the release after the resource's last use on the old queue and as the
+  // acquire before the pass on the new one, the semaphore wait between their batches orders the two. The release is only
+  // needed when the queue families differ, otherwise the ownership doesn't change and the acquire does the layout transition
+  auto makeBarrier = [&](const RenderGraph::Transition& transition, bool release) -> std::optional<vk::ImageMemoryBarrier2> {
+    bool crossQueue = transition.oldState.queue != transition.newState.queue;
+    uint32_t srcFamily = queueFamily(transition.oldState.queue);
+    uint32_t dstFamily = queueFamily(transition.newState.queue);
+    bool ownershipTransfer = crossQueue && srcFamily != dstFamily;
+    if (release && !ownershipTransfer) return std::nullopt;
+
+    auto imgAndAspectFlags = getImgAndAspect(transition.resource);
+    vk::ImageMemoryBarrier2 barrier{
+      .srcStageMask = ToVulkan(transition.oldState.stage),
+      .srcAccessMask = ToVulkan(transition.oldState.access),
+      .dstStageMask = ToVulkan(transition.newState.stage),
+      .dstAccessMask = ToVulkan(transition.newState.access),
+      .oldLayout = ToVulkan(transition.oldState.layout),
+      .newLayout = ToVulkan(transition.newState.layout),
+      .srcQueueFamilyIndex = ownershipTransfer ? srcFamily : VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = ownershipTransfer ? dstFamily : VK_QUEUE_FAMILY_IGNORED,
+      .image = imgAndAspectFlags.first,
+      .subresourceRange = {.aspectMask = imgAndAspectFlags.second, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1},
+    };
 
-  for (auto& pass : compiledRenderGraph.passes) {
-    std::vector<vk::ImageMemoryBarrier2> barriers(pass.preTransitions.size());
-    for (auto [i, transition] : std::views::enumerate(pass.preTransitions)) {
-      auto getImgAndAspect = [&](const std::string& name) -> std::pair<vk::Image, vk::ImageAspectFlags> {
-        if (name == RenderGraph::SWAPCHAIN_TARGET_NAME)
-          return std::make_pair(ctx.mSwapChain.images[swapChainImageIdx].img, vk::ImageAspectFlagBits::eColor);
-        auto& v = renderTargets.Get(impl->mRenderTargetMap.at(transition.resource));
-        return std::make_pair(*v.target.img, GetImageAspectFlags(v.info.format));
-      };
-      auto imgAndAspectFlags = getImgAndAspect(transition.resource);
-
-      barriers[i] = vk::ImageMemoryBarrier2{
-        .srcStageMask = ToVulkan(transition.oldState.stage),
-        .srcAccessMask = ToVulkan(transition.oldState.access),
-        .dstStageMask = ToVulkan(transition.newState.stage),
-        .dstAccessMask = ToVulkan(transition.newState.access),
-        .oldLayout = ToVulkan(transition.oldState.layout),
-        .newLayout = ToVulkan(transition.newState.layout),
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = imgAndAspectFlags.first,
-        .subresourceRange = {.aspectMask = imgAndAspectFlags.second, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1},
-      };
+    // each half only names the stages of its own queue, the semaphore covers the rest
+    if (release) {
+      barrier.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+      barrier.dstAccessMask = vk::AccessFlagBits2::eNone;
+    } else if (crossQueue) {
+      barrier.srcStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+      barrier.srcAccessMask = vk::AccessFlagBits2::eNone;
+    }
+    return barrier;
+  };
+
+  auto recordTransitions = [&](std::span<const RenderGraph::Transition> transitions, bool release) {
+    for (auto& transition : transitions) {
+      if (transition.signalPass != RenderGraph::NO_SPLIT) continue;  // recorded through its event
+      if (auto barrier = makeBarrier(transition, release)) pendingBarriers.push_back(*barrier);
+    }
+  };
+
+  // Split transitions grouped by the pass signaling them and the pass waiting on them, one event per group. The event is set
+  // after the signaling pass and waited on right before the waiting pass, with the same dependency info
+  struct SplitBarrier {
+    uint32_t signalPass;
+    uint32_t waitPass;
+    vk::Event event;
+    std::vector<vk::ImageMemoryBarrier2> barriers;
+
+    vk::DependencyInfo Dependency() const {
+      return {.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()), .pImageMemoryBarriers = barriers.data()};
+    }
+  };
+  std::vector<SplitBarrier> splitBarriers;
+
+  for (auto [i, pass] : std::views::enumerate(compiledRenderGraph.passes)) {
+    auto passIdx = static_cast<uint32_t>(i);
+    for (auto& transition : pass.preTransitions) {
+      if (transition.signalPass == RenderGraph::NO_SPLIT) continue;
+
+      auto split = std::ranges::find_if(splitBarriers, [&](auto& s) { return s.signalPass == transition.signalPass && s.waitPass == passIdx; });
+      if (split == splitBarriers.end()) {
+        split = splitBarriers.insert(splitBarriers.end(),
+                                     {.signalPass = transition.signalPass,
+                                      .waitPass = passIdx,
+                                      .event = impl->mSplitEvents[frameIdx].Acquire(ctx.mDevice.device),
+                                      .barriers = {}});
+      }
+      split->barriers.push_back(*makeBarrier(transition, false));
+    }
+  }
+
+  // after a pass: queue releases join the next barrier call, split barriers are signaled
+  auto finishPass = [&](const vk::raii::CommandBuffer& target, const RenderGraph::ExecutablePass& pass, uint32_t passIdx) {
+    recordTransitions(pass.postTransitions, true);
+
+    bool signals = std::ranges::any_of(splitBarriers, [&](auto& split) { return split.signalPass == passIdx; });
+    if (!signals) return;
+
+    flushBarriers(target);  // the event only covers what was recorded before it
+    for (auto& split : splitBarriers) {
+      if (split.signalPass == passIdx) target.setEvent2(split.event, split.Dependency());
+    }
+  };
+
+  std::vector<const PassDraw*> passDrawsByIndex(compiledRenderGraph.passes.size(), nullptr);
+  for (auto& passDraw : passDraws) {
+    MAPLE_ASSERT(passDraw.pass.index < passDrawsByIndex.size(), "pass draw for pass {}, which is out of range", passDraw.pass.index);
+    MAPLE_ASSERT(passDrawsByIndex[passDraw.pass.index] == nullptr,
+                 "duplicate material draw for pass '{}'",
+                 compiledRenderGraph.passes[passDraw.pass.index].name);
+    passDrawsByIndex[passDraw.pass.index] = &passDraw;
+  }
+
+  for (auto [i, pass] : std::views::enumerate(compiledRenderGraph.passes)) {
+    auto passIdx = static_cast<uint32_t>(i);
+    // the other queue's batch goes out first, its signal value is what this pass has to wait for
+    if (batchCmd && batchQueue != pass.queue) submitBatch(false);
+    uint64_t requiredWait = pass.waitsForOtherQueue ? timelineValues[otherQueueIdx(pass.queue)] : 0;
+    if (pass.queue == QueueType::AsyncCompute) requiredWait = std::max(requiredWait, preludeValue);
+    if (batchCmd && batchWaitValue < requiredWait) submitBatch(false);
+    if (!batchCmd) openBatch(pass.queue, requiredWait);
+
+    auto& passCmd = *batchCmd;
+    if (std::ranges::any_of(pass.preTransitions, [](auto& t) { return t.resource == RenderGraph::SWAPCHAIN_RESOURCE; }))
+      batchUsesSwapChain = true;
+
+    for (auto& split : splitBarriers) {
+      if (split.waitPass == passIdx) passCmd.waitEvents2(split.event, split.Dependency());
+    }
+    recordTransitions(pass.preTransitions, false);
+    auto* passDraw = passDrawsByIndex[passIdx];
+
+    if (pass.pipelineType == RenderGraph::Compute) {
+      auto stageFlags = ToVulkan(ShaderStage::AllGraphicsAndCompute);  // has to match the push constant range
+      flushBarriers(passCmd);
+
+      for (auto& dispatch : passDraw ? passDraw->dispatches : std::span<const Dispatch>{}) {
+        auto* resolved = resolveMaterial(dispatch.material);
+        if (!resolved || !resourcesReady(dispatch.usedResources)) continue;
+        auto& mat = *resolved;
+        MAPLE_ASSERT(mat.Data().IsCompute(), "compute pass '{}' dispatched a graphics material", pass.name);
+
+        DrawPush push{
+          .vertexBufferAddress = 0,
+          .indexBufferOffset = 0,
+          .materialBufferOffset = writeMaterialSlots(dispatch.usedResources, mat),
+          .instanceBufferIndex = 0,
+          .cullDrawOffset = CULL_DISABLED,
+          .cullDrawIdsOffset = 0,
+          .cullClusters = 0,
+          .positionOffset = {0.0f, 0.0f, 0.0f},
+          .positionScale = {1.0f, 1.0f, 1.0f},
+        };
+        vkm::Pipeline::Variant variant{.specializationConstants = dispatch.specializationConstants};
+        passCmd.bindPipeline(vk::PipelineBindPoint::eCompute, getPipeline(mat, variant, variant.Hash()));
+        passCmd.pushConstants<DrawPush>(impl->mGlobalPipelineLayout.GetLayout(), stageFlags, 0, push);
+        passCmd.dispatch(dispatch.groupCount.x, dispatch.groupCount.y, dispatch.groupCount.z);
+      }
+
+      finishPass(passCmd, pass, passIdx);
+      continue;
     }
-    vk::DependencyInfo dependencyInfo{
-      .dependencyFlags = {}, .imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()), .pImageMemoryBarriers = barriers.data()};
-    cmd.pipelineBarrier2(dependencyInfo);
 
     if (pass.outputs.empty()) {
+      finishPass(passCmd, pass, passIdx);
       continue;  // it's a barrier-only pass (e.g present transition of swapchain), continue
     }
 
@@ -341,9 +1417,9 @@ void Renderer::DrawFrame(const UBO& frameUBO, const RenderGraph::CompileResult&
     colorAttachments.reserve(pass.outputs.size());
     std::optional<vk::RenderingAttachmentInfo> depthAttachment = std::nullopt;
 
-    auto getImageView = [&](const std::string& name) -> vk::ImageView {
-      if (name == RenderGraph::SWAPCHAIN_TARGET_NAME) return ctx.mSwapChain.images[swapChainImageIdx].view;
-      return renderTargets.Get(impl->mRenderTargetMap.at(name)).target.view;
+    auto getImageView = [&](RenderGraph::ResourceId resource) -> vk::ImageView {
+      if (resource == RenderGraph::SWAPCHAIN_RESOURCE) return ctx.mSwapChain.images[swapChainImageIdx].view;
+      return renderTargets.Get(impl->mAttachmentTargets[resource]).target.view;
     };
 
     std::optional<glm::uvec2> renderingArea = std::nullopt;
@@ -352,153 +1428,197 @@ void Renderer::DrawFrame(const UBO& frameUBO, const RenderGraph::CompileResult&
       auto attachmentSize = out.info.GetAbsoluteSize(glm::uvec2(ctx.mSwapChain.extent.width, ctx.mSwapChain.extent.height));
 
       if (!renderingArea.has_value()) renderingArea = attachmentSize;
-      MAPLE_ASSERT(renderingArea.value() == attachmentSize, "attachments in pass with unequal sizes, attachment '{}'", out.name);
+      MAPLE_ASSERT(renderingArea.value() == attachmentSize, "attachments in pass with unequal sizes, attachment '{}'",
+                   compiledRenderGraph.ResourceName(out.resource));
 
       if (FormatIsDepth(out.info.format)) {
-        MAPLE_ASSERT(!depthAttachment.has_value(), "attempted to use multiple depth outputs in a single pass, attachment '{}'", out.name);
+        MAPLE_ASSERT(!depthAttachment.has_value(), "attempted to use multiple depth outputs in a single pass, attachment '{}'",
+                     compiledRenderGraph.ResourceName(out.resource));
 
+        // load & store ops were resolved by the render graph
         depthAttachment = vk::RenderingAttachmentInfo{
-          .imageView = getImageView(out.name),
+          .imageView = getImageView(out.resource),
           .imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
-          .loadOp = vk::AttachmentLoadOp::eClear,            // TODO: make this configurable
-          .storeOp = vk::AttachmentStoreOp::eStore,          // TODO: make this configurable
-          .clearValue = vk::ClearDepthStencilValue{1.0f, 0}  // TODO: make this configurable
+          .loadOp = ToVulkan(out.info.loadOp),
+          .storeOp = ToVulkan(out.info.storeOp),
+          .clearValue = vk::ClearDepthStencilValue{out.info.clearDepth, out.info.clearStencil},
         };
       } else {
+        auto& clear = out.info.clearColor;
         colorAttachments.push_back({
-          .imageView = getImageView(out.name),
+          .imageView = getImageView(out.resource),
           .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
-          .loadOp = vk::AttachmentLoadOp::eClear,                    // TODO: make this configurable
-          .storeOp = vk::AttachmentStoreOp::eStore,                  // TODO: make this configurable
-          .clearValue = vk::ClearColorValue{0.0f, 0.0f, 0.0f, 1.0f}  // TODO: make this configurable
+          .loadOp = ToVulkan(out.info.loadOp),
+          .storeOp = ToVulkan(out.info.storeOp),
+          .clearValue = vk::ClearColorValue{clear.r, clear.g, clear.b, clear.a},
         });
       }
     }
 
-    cmd.beginRendering({
-      .renderArea = {.offset = {0, 0}, .extent = {renderingArea->x, renderingArea->y}},
-      .layerCount = 1,
-      .colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size()),
-      .pColorAttachments = colorAttachments.data(),
-      .pDepthAttachment = depthAttachment.has_value() ? &depthAttachment.value() : nullptr,
-    });
+    const std::span<const MaterialDraw>* materialDraws = passDraw ? &passDraw->materialDraws : nullptr;
 
-    auto& passName = pass.name;
-    const std::span<const MaterialDraw>* materialDraws = nullptr;
-    for (auto& passDraw : passDraws) {
-      if (passDraw.passName == passName) {
-        MAPLE_ASSERT(materialDraws == nullptr, "duplicate material draw for pass '{}'", passName);
-        materialDraws = &passDraw.materialDraws;
-      }
-    }
+    // everything that touches shared state (allocators, lazily built pipelines) happens here on the calling thread,
+    // recording afterwards only reads the prepared draws so it can be split across threads
+    std::vector<PreparedMaterialDraw> preparedMaterials;
+    std::vector<PreparedDraw> preparedDraws;
+    auto passFormats = GetPassFormats(pass, ctx.mSwapChain.format.format);
+    auto& outputColorFormats = passFormats.colorFormats;
+    auto& outputDepthFormat = passFormats.depthFormat;
+    vkm::Pipeline::Variant passVariant{.formats = {.colorFormats = outputColorFormats, .depthFormat = outputDepthFormat}};
+    uint64_t passVariantHash = passVariant.Hash();
 
     if (materialDraws) {
-      std::vector<vk::Format> outputColorFormats;
-      std::optional<vk::Format> outputDepthFormat;
-      outputColorFormats.reserve(pass.outputs.size());
-      for (auto& output : pass.outputs) {
-        if (FormatIsDepth(output.info.format)) {
-          outputDepthFormat = ToVulkan(output.info.format);  // above we already make sure the pass only contains 1 depth attachment
-        } else {
-          // TODO: later add string output names to material info, to make sure we define the attachments in the right order
-          // index 0 in the array will be location 0 of the output attachment
-
-          // if the target is the swapchain, dynamically fetch the actual format
-          auto format = output.name == RenderGraph::SWAPCHAIN_TARGET_NAME ? ctx.mSwapChain.format.format : ToVulkan(output.info.format);
-          outputColorFormats.push_back(format);
-        }
-      }
-
       for (auto& materialDraw : *materialDraws) {
-        MAPLE_ASSERT(impl->mMaterialPool.IsValid(materialDraw.material), "used invalid material handle in renderer");
-        auto& mat = impl->mMaterialPool.Get(materialDraw.material);
-        // TODO: assert pass.pipelineType == materialDraw.material's pipeline type
-
-        if (!mat.Pipeline().has_value()) {
-          mat.Pipeline() = vkm::Pipeline(vkm::Pipeline::CreateInfo{
-            .device = ctx.mDevice.device,
-            .layout = impl->mGlobalPipelineLayout,
-            .formats =
-              vkm::Pipeline::AttachmentFormats{
-                .colorFormats = outputColorFormats,
-                .depthFormat = outputDepthFormat,
-              },
-            .materialData = mat.Data(),
-          });
+        auto* resolved = resolveMaterial(materialDraw.material);
+        if (!resolved) continue;
+        auto& mat = *resolved;
+        MAPLE_ASSERT(!mat.Data().IsCompute(), "graphics pass '{}' drew a compute material", pass.name);
+
+        auto variant = passVariant;
+        uint64_t variantHash = passVariantHash;
+        if (materialDraw.rasterizerOverride.has_value() || !materialDraw.specializationConstants.empty()) {
+          variant.rasterizerOverride = materialDraw.rasterizerOverride ? &*materialDraw.rasterizerOverride : nullptr;
+          variant.specializationConstants = materialDraw.specializationConstants;
+          variantHash = variant.Hash();
         }
 
-        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mat.Pipeline().value().GetPipeline());
-        cmd.setViewport(0, vk::Viewport{0.0f, 0.0f, static_cast<float>(renderingArea->x), static_cast<float>(renderingArea->y), 0.0f, 1.0f});
-        vk::Rect2D scissor{vk::Offset2D{0, 0}, vk::Extent2D{.width = renderingArea->x, .height = renderingArea->y}};
-        cmd.setScissor(0, {scissor});
-
-        for (auto& meshDraw : materialDraw.meshes) {
-          auto& mesh = impl->mMeshPool.Get(meshDraw.mesh);
+        PreparedMaterialDraw prepared{
+          .pipeline = getPipeline(mat, variant, variantHash),
+          .firstDraw = static_cast<uint32_t>(preparedDraws.size()),
+        };
 
-          uint32_t materialBufferOffset = materialBuffer.size();
-          for (auto& usedResource : meshDraw.usedResources) {
-            uint32_t slot = 0;
-            uint32_t slotTypeSize = sizeof(slot);
-
-            if (auto* res = std::get_if<const std::string>(&usedResource)) {
-              MAPLE_ASSERT(*res != RenderGraph::SWAPCHAIN_TARGET_NAME, "cannot use swapchain as sampled attachment");
-              auto it = impl->mRenderTargetMap.find(*res);
-              MAPLE_ASSERT(it != impl->mRenderTargetMap.end(), "failed to find meshDraw resource attachment '{}'", *res);
-              slot = it->second;
-              MAPLE_ASSERT(renderTargets.IsValid(slot), "invalid meshDraw resource attachment '{}'", *res);
-            } else if (auto* res = std::get_if<TextureHndl>(&usedResource)) {
-              // TODO
-              auto it = textureSlotMap.find(*res);
-              MAPLE_ASSERT(it != textureSlotMap.end(), "failed to find meshDraw resource texture '{}'", *res);
-              slot = it->second;
-            } else {
-              MAPLE_FATAL("unknown mesh draw resource");
+        if (materialDraw.gpuCulling) {
+          auto it = cullBatches.find(&materialDraw);
+          if (it == cullBatches.end()) continue;  // none of the mesh draws were ready
+
+          for (auto* batch : {&it->second.instances, &it->second.clusters}) {
+            if (!batch->has_value()) continue;
+            preparedDraws.push_back(PreparedDraw{
+              .push =
+                {
+                  .vertexBufferAddress = 0,
+                  .indexBufferOffset = 0,
+                  .materialBufferOffset = 0,
+                  .instanceBufferIndex = 0,
+                  .cullDrawOffset = (*batch)->push.drawOffset,
+                  .cullDrawIdsOffset = (*batch)->drawIdsOffset,
+                  .cullClusters = (*batch)->clusters ? 1u : 0u,
+                },
+              .cullBatch = &**batch,
+            });
+          }
+        } else {
+          for (auto& meshDraw : materialDraw.meshes) {
+            if (!meshDrawReady(meshDraw)) continue;
+            auto& mesh = impl->mMeshPool.Get(meshDraw.mesh);
+
+            auto instances = instanceAllocator.Allocate<InstanceTransform>(meshDraw.instanceData.size());
+
+            // instances are packed grouped by their LOD, with a draw per LOD in use
+            std::array<uint32_t, MeshData::MAX_LODS> lodCounts{};
+            instanceLods.resize(meshDraw.instanceData.size());
+            for (auto [i, instance] : std::views::enumerate(meshDraw.instanceData)) lodCounts[instanceLods[i] = selectLod(mesh, instance)]++;
+
+            std::array<uint32_t, MeshData::MAX_LODS> lodOffsets{};
+            for (uint32_t lod = 1; lod < mesh.GetNumLods(); lod++) lodOffsets[lod] = lodOffsets[lod - 1] + lodCounts[lod - 1];
+            auto writeOffsets = lodOffsets;
+            for (auto [i, instance] : std::views::enumerate(meshDraw.instanceData)) instances.data[writeOffsets[instanceLods[i]]++] = instance;
+
+            uint32_t materialBufferOffset = writeMaterialSlots(meshDraw.usedResources, mat);
+            for (uint32_t lod = 0; lod < mesh.GetNumLods(); lod++) {
+              if (lodCounts[lod] == 0) continue;
+              preparedDraws.push_back(PreparedDraw{
+                .push =
+                  {
+                    .vertexBufferAddress = bufferAddress(mesh.meshBuffer),
+                    .indexBufferOffset = mesh.GetIndexBufferOffset(),
+                    .materialBufferOffset = materialBufferOffset,
+                    .instanceBufferIndex = instances.Index() + lodOffsets[lod],
+                    .cullDrawOffset = CULL_DISABLED,
+                    .cullDrawIdsOffset = 0,
+                    .cullClusters = 0,
+                    .positionOffset = {mesh.quantization.positionOffset.x, mesh.quantization.positionOffset.y, mesh.quantization.positionOffset.z},
+                    .positionScale = {mesh.quantization.positionScale.x, mesh.quantization.positionScale.y, mesh.quantization.positionScale.z},
+                  },
+                .indexBuffer = *mesh.meshBuffer.buffer,
+                .indexOffset = mesh.GetIndexBufferOffset(),
+                .indexType = mesh.GetVkIndexType(),
+                .firstIndex = mesh.GetLod(lod).firstIndex,
+                .indexCount = mesh.GetLod(lod).numIndices,
+                .instanceCount = lodCounts[lod],
+              });
             }
-
-            size_t offset = materialBuffer.size() * sizeof(decltype(materialBuffer)::value_type);
-            materialBuffer.resize(offset + slotTypeSize);
-            std::memcpy(materialBuffer.data() + offset, &slot, slotTypeSize);
           }
+        }
 
-          VkBufferDeviceAddressInfo info{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR};
-          info.buffer = *mesh.meshBuffer.buffer;
+        prepared.numDraws = static_cast<uint32_t>(preparedDraws.size()) - prepared.firstDraw;
+        if (prepared.numDraws > 0) preparedMaterials.push_back(prepared);
+      }
+    }
 
-          DrawPush push{
-            .vertexBufferAddress = vkGetBufferDeviceAddress(*ctx.mDevice.device, &info),
-            .indexBufferOffset = mesh.GetIndexBufferOffset(),
-            .materialBufferOffset = materialBufferOffset,
-            .instanceBufferIndex = static_cast<uint32_t>(instanceData.size()),
-          };
+    DrawRecordInfo recordInfo{
+      .layout = *impl->mGlobalPipelineLayout.GetLayout(),
+      .renderingArea = *renderingArea,
+      .cullOutput = *impl->mCullOutputBuffers[frameIdx].buffer,
+      .materials = preparedMaterials,
+      .draws = preparedDraws,
+    };
 
-          for (auto& instance : meshDraw.instanceData) instanceData.push_back(instance);
+    // large passes are split into contiguous draw ranges recorded into secondary command buffers, executed in order
+    auto& workers = impl->mRecordWorkers;
+    uint32_t numDraws = static_cast<uint32_t>(preparedDraws.size());
+    uint32_t numTasks = workers ? std::min(workers->NumWorkers(), numDraws / MIN_DRAWS_PER_RECORD_TASK) : 0;
+    std::vector<vk::CommandBuffer> secondaries;
+
+    if (numTasks > 1) {
+      secondaries.resize(numTasks);
+      vk::CommandBufferInheritanceRenderingInfo inheritanceRendering{
+        .colorAttachmentCount = static_cast<uint32_t>(outputColorFormats.size()),
+        .pColorAttachmentFormats = outputColorFormats.data(),
+        .depthAttachmentFormat = outputDepthFormat.value_or(vk::Format::eUndefined),
+        .rasterizationSamples = vk::SampleCountFlagBits::e1,
+      };
+      vk::CommandBufferInheritanceInfo inheritance{.pNext = &inheritanceRendering};
 
-          // TODO: optimize this depending on if its a graphics pipeline or a compute pipeline
-          auto stageFlags = ToVulkan(ShaderStage::AllGraphicsAndCompute);
-          cmd.pushConstants<DrawPush>(impl->mGlobalPipelineLayout.GetLayout(), stageFlags, 0, push);
-          cmd.draw(mesh.GetNumIndices(), meshDraw.instanceData.size(), 0, 0);  // non-indexed, emulated indexed drawing
-        }
-      }
+      workers->ParallelFor(numTasks, [&](uint32_t taskIdx, uint32_t workerIdx) {
+        auto& secondary = impl->mRecordContexts[frameIdx][workerIdx].Acquire(ctx.mDevice.device);
+        secondary.begin({
+          .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+          .pInheritanceInfo = &inheritance,
+        });
+        bindGlobalDescriptorSet(secondary);
+        uint32_t drawBegin = numDraws * taskIdx / numTasks;
+        uint32_t drawEnd = numDraws * (taskIdx + 1) / numTasks;
+        RecordDraws(secondary, recordInfo, drawBegin, drawEnd);
+        secondary.end();
+        secondaries[taskIdx] = *secondary;
+      });
     }
 
-    cmd.endRendering();
-  }
+    flushBarriers(passCmd);
+    passCmd.beginRendering({
+      .flags = secondaries.empty() ? vk::RenderingFlags{} : vk::RenderingFlagBits::eContentsSecondaryCommandBuffers,
+      .renderArea = {.offset = {0, 0}, .extent = {renderingArea->x, renderingArea->y}},
+      .layerCount = 1,
+      .colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size()),
+      .pColorAttachments = colorAttachments.data(),
+      .pDepthAttachment = depthAttachment.has_value() ? &depthAttachment.value() : nullptr,
+    });
 
-  cmd.end();
+    if (secondaries.empty()) {
+      RecordDraws(passCmd, recordInfo, 0, numDraws);
+    } else {
+      passCmd.executeCommands(secondaries);
+    }
 
-  impl->mInstanceSSBO[frameIdx].Upload(instanceData.data(), instanceData.size() * sizeof(decltype(instanceData)::value_type));
-  impl->mMaterialBuffers[frameIdx].Upload(materialBuffer.data(), materialBuffer.size());
+    passCmd.endRendering();
+    finishPass(passCmd, pass, passIdx);
+  }
 
-  vk::PipelineStageFlags waitDestinationStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-  vk::SubmitInfo submitInfo{
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &*frameData.presentCompleteSem,
-    .pWaitDstStageMask = &waitDestinationStageMask,
-    .commandBufferCount = 1,
-    .pCommandBuffers = &*frameData.cmd,
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = &*ctx.mRenderCompleteSems[swapChainImageIdx],
-  };
-  ctx.mDevice.queues.graphics.submit(submitInfo, frameData.drawFence);
+  // the fence has to cover the frame's compute batches as well, they use its allocator slices and command buffers
+  MAPLE_ASSERT(batchCmd && batchQueue == QueueType::Graphics, "the swapchain transition ends the frame on the graphics queue");
+  if (asyncCompute) batchWaitValue = std::max(batchWaitValue, timelineValues[queueIdx(QueueType::AsyncCompute)]);
+  submitBatch(true);
 
   vk::PresentInfoKHR presentInfo{
     .waitSemaphoreCount = 1,
@@ -519,29 +1639,8 @@ void Renderer::DrawFrame(const UBO& frameUBO, const RenderGraph::CompileResult&
       .framebufferSizeCb = ctx.mFrameBufferSizeCallback,
     });
 
-    // swapchain recreation above already calls device.waitIdle() so these attachments won't be use-after-freed
-    glm::uvec2 swapChainSize(ctx.mSwapChain.extent.width, ctx.mSwapChain.extent.height);
-    auto multiplySwapChain = [&](glm::vec2 v) { return glm::uvec2(v.x * swapChainSize.x, v.y * swapChainSize.y); };
-
-    // TODO: optimize
-    for (uint32_t i = 0; i < renderTargets.Capacity(); i++) {
-      if (!renderTargets.IsValid(i)) continue;
-      auto& rt = renderTargets.Get(i);
-      if (rt.info.sizeType != SwapChainRelative) continue;
-
-      glm::uvec2 size = multiplySwapChain(rt.info.size);
-      vk::ImageUsageFlags usage =
-        FormatIsColor(rt.info.format) ? vk::ImageUsageFlagBits::eColorAttachment : vk::ImageUsageFlagBits::eDepthStencilAttachment;
-      usage |= vk::ImageUsageFlagBits::eSampled;  // all render targets assumed to be sampleable cus of bindless
-
-      rt.target = ctx.mAllocator.CreateImage({
-        .format = ToVulkan(rt.info.format),
-        .extent = {size.x, size.y, 1},
-        .usage = usage,
-        .aspectMask = GetImageAspectFlags(rt.info.format),
-      });
-    }
-
+    // the render targets are recreated at the new size at the start of the next frame
+    impl->mAttachmentsHash.reset();
   } else if (presentResult != vk::Result::eSuccess) {
     MAPLE_FATAL("Failed to present swap chain image");
   }
@@ -553,15 +1652,32 @@ Renderer::Renderer(const std::vector<const char*>& glfwExtensions, SurfaceCreate
   auto& ctx = impl->mCtx;
   ctx.Init(glfwExtensions, surfaceCb, frameBufferSizeCb);
 
+  auto shaderCacheDirectory = ShaderCacheDirectory();
+  impl->mPipelineCache = vkm::PipelineCache({
+    .device = ctx.mDevice.device,
+    .properties = ctx.mPhysicalDevice.GetProperties(),
+    .path = shaderCacheDirectory.empty() ? std::filesystem::path() : shaderCacheDirectory / "pipeline_cache.bin",
+  });
+
+  impl->mUploads = UploadManager(UploadManager::CreateInfo{
+    .device = ctx.mDevice,
+    .queueFamilies = ctx.mPhysicalDevice.queueFamilyIndices,
+    .allocator = ctx.mAllocator,
+    .commandPool = ctx.mTransferCommandPool,
+  });
+
   impl->mGlobalDescriptorPool = vkm::DescriptorPool(vkm::DescriptorPool::CreateInfo{
     .device = ctx.mDevice.device,
     .maxSets = ctx.MAX_FRAMES_IN_FLIGHT,
     .resourceSizes =
       {
         std::make_pair(vk::DescriptorType::eUniformBuffer, ctx.MAX_FRAMES_IN_FLIGHT),
-        std::make_pair(vk::DescriptorType::eStorageBuffer, ctx.MAX_FRAMES_IN_FLIGHT * 2),
-        std::make_pair(vk::DescriptorType::eCombinedImageSampler, ctx.MAX_FRAMES_IN_FLIGHT * MAX_BINDLESS_TEXTURES),
+        std::make_pair(vk::DescriptorType::eStorageBuffer, ctx.MAX_FRAMES_IN_FLIGHT * 4),
+        std::make_pair(vk::DescriptorType::eSampledImage, ctx.MAX_FRAMES_IN_FLIGHT * MAX_BINDLESS_TEXTURES),
+        std::make_pair(vk::DescriptorType::eSampler, ctx.MAX_FRAMES_IN_FLIGHT * MAX_BINDLESS_SAMPLERS),
+        std::make_pair(vk::DescriptorType::eStorageImage, ctx.MAX_FRAMES_IN_FLIGHT * MAX_BINDLESS_TEXTURES),
       },
+    .updateAfterBind = true,
   });
 
   std::array description = {
@@ -571,12 +1687,33 @@ Renderer::Renderer(const std::vector<const char*>& glfwExtensions, SurfaceCreate
       .bindingSlot = 1, .type = vkm::DescriptorSets::Type::SSBO, .usedStages = ShaderStage::AllGraphicsAndCompute},  // Instance buffer
     vkm::DescriptorSets::Layout{
       .bindingSlot = 2, .type = vkm::DescriptorSets::Type::SSBO, .usedStages = ShaderStage::AllGraphicsAndCompute},  // Material buffer
-    // Texture array
+    // Texture array, sampled with any sampler of the binding 7 array
     vkm::DescriptorSets::Layout{
       .bindingSlot = 3,
-      .type = vkm::DescriptorSets::Type::CombinedImageSampler,
+      .type = vkm::DescriptorSets::Type::SampledImage,
       .usedStages = ShaderStage::AllGraphicsAndCompute,
       .arrayCount = MAX_BINDLESS_TEXTURES,
+      .bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
+    },
+    vkm::DescriptorSets::Layout{
+      .bindingSlot = 4, .type = vkm::DescriptorSets::Type::SSBO, .usedStages = ShaderStage::AllGraphicsAndCompute},  // Cull draw buffer
+    vkm::DescriptorSets::Layout{
+      .bindingSlot = 5, .type = vkm::DescriptorSets::Type::SSBO, .usedStages = ShaderStage::AllGraphicsAndCompute},  // Cull output buffer
+    // Storage image array, compute pass outputs at the index of their binding 3 slot
+    vkm::DescriptorSets::Layout{
+      .bindingSlot = 6,
+      .type = vkm::DescriptorSets::Type::StorageImage,
+      .usedStages = ShaderStage::AllGraphicsAndCompute,
+      .arrayCount = MAX_BINDLESS_TEXTURES,
+      .bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
+    },
+    // Sampler array, deduplicated by their settings, see SamplerCache
+    vkm::DescriptorSets::Layout{
+      .bindingSlot = 7,
+      .type = vkm::DescriptorSets::Type::Sampler,
+      .usedStages = ShaderStage::AllGraphicsAndCompute,
+      .arrayCount = MAX_BINDLESS_SAMPLERS,
+      .bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
     },
   };
   impl->mGlobalDescriptorSets = vkm::DescriptorSets(vkm::DescriptorSets::CreateInfo{
@@ -586,10 +1723,18 @@ Renderer::Renderer(const std::vector<const char*>& glfwExtensions, SurfaceCreate
     .description = description,
   });
 
+  impl->mMaterialBuffer = ctx.mAllocator.CreateBuffer(NUM_MATERIALS, vkm::Allocator::SSBO);
+  impl->mMaterialParams = MaterialParamCache(impl->mMaterialBuffer, ctx.MAX_FRAMES_IN_FLIGHT);
+
   for (size_t i = 0; i < ctx.MAX_FRAMES_IN_FLIGHT; i++) {
-    impl->mInstanceSSBO[i] = ctx.mAllocator.CreateBuffer(sizeof(glm::mat4) * NUM_INSTANCES, vkm::Allocator::SSBO);
+    impl->mInstanceSSBO[i] = ctx.mAllocator.CreateBuffer(sizeof(InstanceTransform) * NUM_INSTANCES, vkm::Allocator::SSBO);
     impl->mGlobalsUniform[i] = ctx.mAllocator.CreateBuffer(sizeof(UBO), vkm::Allocator::UBO);
-    impl->mMaterialBuffers[i] = ctx.mAllocator.CreateBuffer(NUM_MATERIALS, vkm::Allocator::SSBO);
+
+    impl->mInstanceAllocators[i] = vkm::LinearAllocator(impl->mInstanceSSBO[i]);
+
+    impl->mCullDrawBuffers[i] = ctx.mAllocator.CreateBuffer(sizeof(CullDraw) * MAX_CULL_DRAWS, vkm::Allocator::SSBO);
+    impl->mCullOutputBuffers[i] = ctx.mAllocator.CreateBuffer(sizeof(uint32_t) * CULL_OUTPUT_SIZE, vkm::Allocator::Indirect);
+    impl->mCullDrawAllocators[i] = vkm::LinearAllocator(impl->mCullDrawBuffers[i]);
   }
 
   impl->mGlobalPipelineLayout = vkm::PipelineLayout(vkm::PipelineLayout::Info{
@@ -602,7 +1747,65 @@ Renderer::Renderer(const std::vector<const char*>& glfwExtensions, SurfaceCreate
     .descriptorSetLayout = impl->mGlobalDescriptorSets.layout,
   });
 
-  impl->mDefaultSampler = vkm::Sampler(ctx.mDevice.device, {.maxAnisotropy = ctx.mPhysicalDevice.GetProperties().limits.maxSamplerAnisotropy});
+  {
+    std::array entryFuncNames = {std::string(builtin_shaders::CULL_INSTANCES_ENTRY),
+                                 std::string(builtin_shaders::COMPACT_DRAWS_ENTRY),
+                                 std::string(builtin_shaders::CULL_CLUSTERS_ENTRY)};
+    std::vector<uint8_t> cullCode;
+    try {
+      cullCode = compileSlangToSpirv(std::string(builtin_shaders::CULL_SHADER), std::string(builtin_shaders::CULL_SHADER_NAME), entryFuncNames);
+    } catch (const ShaderCompileError& error) {
+      MAPLE_FATAL("{}", error.what());
+    }
+    impl->mCullInstancesPipeline = vkm::ComputePipeline({
+      .device = ctx.mDevice.device,
+      .layout = impl->mGlobalPipelineLayout,
+      .shaderCode = cullCode,
+      .entryFuncName = entryFuncNames[0],
+      .cache = impl->mPipelineCache.Get(),
+    });
+    impl->mCompactDrawsPipeline = vkm::ComputePipeline({
+      .device = ctx.mDevice.device,
+      .layout = impl->mGlobalPipelineLayout,
+      .shaderCode = cullCode,
+      .entryFuncName = entryFuncNames[1],
+      .cache = impl->mPipelineCache.Get(),
+    });
+    impl->mCullClustersPipeline = vkm::ComputePipeline({
+      .device = ctx.mDevice.device,
+      .layout = impl->mGlobalPipelineLayout,
+      .shaderCode = cullCode,
+      .entryFuncName = entryFuncNames[2],
+      .cache = impl->mPipelineCache.Get(),
+    });
+  }
+
+  impl->mSamplers = SamplerCache(
+    ctx.mDevice.device, ctx.mPhysicalDevice.GetProperties().limits.maxSamplerAnisotropy, 7, MAX_BINDLESS_SAMPLERS, ctx.MAX_FRAMES_IN_FLIGHT);
+  impl->mSamplers.Get({});  // slot 0, the default every shader can use without a material declaring it
+  impl->mBindlessTextures = BindlessTable(3, MAX_BINDLESS_TEXTURES, ctx.MAX_FRAMES_IN_FLIGHT);
+  impl->mBindlessStorageImages = BindlessTable(6, MAX_BINDLESS_TEXTURES, ctx.MAX_FRAMES_IN_FLIGHT);
+  impl->mTextureStreamer = TextureStreamer({
+    .allocator = ctx.mAllocator,
+    .uploads = impl->mUploads,
+    .bindless = impl->mBindlessTextures,
+    .textures = impl->mTexturePool,
+    .framesInFlight = ctx.MAX_FRAMES_IN_FLIGHT,
+  });
+
+  vk::SemaphoreTypeCreateInfo timelineInfo{.semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = 0};
+  for (auto& timeline : impl->mQueueTimelines) timeline = vk::raii::Semaphore(ctx.mDevice.device, vk::SemaphoreCreateInfo{.pNext = &timelineInfo});
+
+  auto& families = ctx.mPhysicalDevice.queueFamilyIndices;
+  for (auto& contexts : impl->mBatchContexts) {
+    for (auto [queueIdx, batchContext] : std::views::enumerate(contexts)) {
+      auto family = static_cast<QueueType>(queueIdx) == QueueType::Graphics ? families.graphics : families.compute;
+      batchContext = RecordContext{
+        .pool = vk::raii::CommandPool(ctx.mDevice.device, {.flags = vk::CommandPoolCreateFlagBits::eTransient, .queueFamilyIndex = family}),
+        .level = vk::CommandBufferLevel::ePrimary,
+      };
+    }
+  }
 
   // Writing descriptor sets
   for (size_t i = 0; i < ctx.MAX_FRAMES_IN_FLIGHT; i++) {
@@ -629,7 +1832,7 @@ Renderer::Renderer(const std::vector<const char*>& glfwExtensions, SurfaceCreate
                                          .pBufferInfo = &instanceInfo};
 
     // Material SSBO (binding 2)
-    vk::DescriptorBufferInfo materialInfo{.buffer = *impl->mMaterialBuffers[i].buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+    vk::DescriptorBufferInfo materialInfo{.buffer = *impl->mMaterialBuffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE};
     vk::WriteDescriptorSet writeMaterial{.dstSet = *impl->mGlobalDescriptorSets.sets[i],
                                          .dstBinding = 2,
                                          .dstArrayElement = 0,
@@ -637,13 +1840,32 @@ Renderer::Renderer(const std::vector<const char*>& glfwExtensions, SurfaceCreate
                                          .descriptorType = vk::DescriptorType::eStorageBuffer,
                                          .pBufferInfo = &materialInfo};
 
-    std::array writes = {writeUbo, writeInstance, writeMaterial};
+    // Cull draw SSBO (binding 4)
+    vk::DescriptorBufferInfo cullDrawInfo{.buffer = *impl->mCullDrawBuffers[i].buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+    vk::WriteDescriptorSet writeCullDraw{.dstSet = *impl->mGlobalDescriptorSets.sets[i],
+                                         .dstBinding = 4,
+                                         .dstArrayElement = 0,
+                                         .descriptorCount = 1,
+                                         .descriptorType = vk::DescriptorType::eStorageBuffer,
+                                         .pBufferInfo = &cullDrawInfo};
+
+    // Cull output SSBO (binding 5)
+    vk::DescriptorBufferInfo cullOutputInfo{.buffer = *impl->mCullOutputBuffers[i].buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+    vk::WriteDescriptorSet writeCullOutput{.dstSet = *impl->mGlobalDescriptorSets.sets[i],
+                                           .dstBinding = 5,
+                                           .dstArrayElement = 0,
+                                           .descriptorCount = 1,
+                                           .descriptorType = vk::DescriptorType::eStorageBuffer,
+                                           .pBufferInfo = &cullOutputInfo};
+
+    std::array writes = {writeUbo, writeInstance, writeMaterial, writeCullDraw, writeCullOutput};
     ctx.mDevice.device.updateDescriptorSets(writes, {});
   }
 }
 Renderer::~Renderer() {
   if (impl) {
     impl->mCtx.Destroy();
+    impl->mPipelineCache.Save();
   }
 };
 
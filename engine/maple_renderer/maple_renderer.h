@@ -8,10 +8,12 @@
 #include <vector>
 
 #include "enums.h"
+#include "instance_transform.h"
 #include "material_builder_data.h"
 #include "mesh_data.h"
 #include "render_graph.h"
 #include "renderer_callbacks.h"
+#include "texture_compression.h"
 
 namespace maple {
 
@@ -35,14 +37,48 @@ class Renderer {
 
   [[nodiscard]]
   MaterialHndl CreateMaterial(const std::string& shaderCode, const std::string& shaderFileName, const MaterialBuilderData& data);
+  // Compiles the shader on a background thread and returns right away. Until it is compiled, draws and dispatches of the
+  // material use `fallback`, a compiled material of the same kind, or are skipped without one
+  [[nodiscard]]
+  MaterialHndl CreateMaterialAsync(const std::string& shaderCode,
+                                   const std::string& shaderFileName,
+                                   const MaterialBuilderData& data,
+                                   std::optional<MaterialHndl> fallback = std::nullopt);
+  // Whether the material is drawn with its own shader from the next frame on
+  bool IsMaterialReady(MaterialHndl hndl) const;
+
+  // A material and the render graph pass it will be drawn or dispatched in
+  struct PipelinePrewarm {
+    MaterialHndl material;
+    RenderGraph::PassRef pass;
+    std::optional<MaterialBuilderData::RasterizerState> rasterizerOverride = std::nullopt;  // see MaterialDraw
+    std::span<const MaterialBuilderData::SpecializationConstant> specializationConstants;
+  };
+  // Builds the pipelines of the given materials in parallel, instead of on the first frame drawing them. Waits for materials
+  // still compiling in the background
+  void PrewarmPipelines(const RenderGraph::CompileResult& compiledRenderGraph, std::span<const PipelinePrewarm> pipelines);
   void DestroyMaterial(MaterialHndl);
 
+  // `bytes` holds `mipLevels` levels, largest first and tightly packed like TextureData
+  [[nodiscard]]
+  TextureHndl CreateTexture(glm::uvec2 dimensions, std::span<const uint8_t> bytes, Format format, uint32_t mipLevels = 1);
+  // Only the mip tail of `data` is uploaded right away, finer levels follow once draws show them large enough on screen and
+  // are dropped again, least recently used first, when the streamed textures exceed the budget. `data` stays in system
+  // memory as the source of those uploads
   [[nodiscard]]
-  TextureHndl CreateTexture(glm::uvec2 dimensions, std::span<const uint8_t> bytes, Format format);
+  TextureHndl CreateStreamedTexture(TextureData data);
+  // GPU memory the mip levels of all streamed textures may take together, 256 MiB by default. Mip tails always stay
+  void SetTextureStreamingBudget(uint64_t bytes);
   void DestroyTexture(TextureHndl hndl);
 
+  // Meshes and textures are uploaded asynchronously, draws referencing them are skipped until they are ready
+  bool IsMeshReady(MeshHndl hndl) const;
+  bool IsTextureReady(TextureHndl hndl) const;
+
   std::optional<Format> FindFirstSupportedTextureFormat(std::span<const Format> formats) const;
   std::optional<Format> FindFirstSupportedDepthAttachmentFormat(std::span<const Format> formats) const;
+  // for outputs of compute passes, which are written as storage images
+  std::optional<Format> FindFirstSupportedStorageFormat(std::span<const Format> formats) const;
 
   struct UBO {
     glm::mat4 view;
@@ -50,22 +86,52 @@ class Renderer {
     float time;
   };
 
+  // A regular texture or a render graph attachment, resolved once from the compiled graph with FindAttachment
+  using UsedResource = std::variant<TextureHndl, RenderGraph::AttachmentRef>;
+
   struct MeshDraw {
     MeshHndl mesh;
-    std::span<const glm::mat4> instanceData;
-    std::span<std::variant<const std::string, TextureHndl>> usedResources;  // string means sampling a render target, otherwise a regular texture
+    std::span<const InstanceTransform> instanceData;
+    std::span<UsedResource> usedResources;
   };
 
   struct MaterialDraw {
     MaterialHndl material;
     std::span<const MeshDraw> meshes;
+    // Frustum cull the instances on the GPU and draw the survivors with a single indirect draw,
+    // the material's vertex shader must resolve its draw through `mapleGetDraw`
+    bool gpuCulling = false;
+    // replaces the material's rasterizer state in this draw, e.g. depth bias in a shadow pass, built as a separate pipeline
+    std::optional<MaterialBuilderData::RasterizerState> rasterizerOverride = std::nullopt;
+    // override the material's specialization constants with the same id, a pipeline per distinct set is built and cached
+    std::span<const MaterialBuilderData::SpecializationConstant> specializationConstants;
+  };
+
+  // A compute material dispatched by a compute pass. Its usedResources land in the material buffer like a mesh draw's, the
+  // pass' outputs are written through the storage image array (binding 6), which shares its indices with the sampled array.
+  // Regular textures are owned by the graphics queue, on devices with a separate compute family only sample them in passes
+  // compiled without async compute
+  struct Dispatch {
+    MaterialHndl material;
+    glm::uvec3 groupCount;
+    std::span<UsedResource> usedResources;
+    std::span<const MaterialBuilderData::SpecializationConstant> specializationConstants;  // see MaterialDraw
   };
 
   struct PassDraw {
-    std::string passName;
-    std::span<const MaterialDraw> materialDraws;
+    RenderGraph::PassRef pass;  // resolved once from the compiled graph with FindPass
+    std::span<const MaterialDraw> materialDraws;  // graphics passes
+    std::span<const Dispatch> dispatches;         // compute passes
   };
 
+  // Meshes with LODs are drawn with the coarsest one whose simplification error covers at most `pixels` on screen, picked per
+  // instance. Defaults to 1 pixel
+  void SetLodErrorThreshold(float pixels);
+
+  // Passes with enough draws are recorded into secondary command buffers on `numThreads` threads (the caller included),
+  // 0 or 1 records everything on the calling thread. Waits for the device to go idle.
+  void SetRecordingThreads(uint32_t numThreads);
+
   void DrawFrame(const UBO& frameUBO, const RenderGraph::CompileResult& compiledRenderGraph, std::span<const PassDraw> passDraws);
 
  private:
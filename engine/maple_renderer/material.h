@@ -1,7 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <future>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
 #include "material_builder_data.h"
 #include "vkm/vkm_pipeline.h"
@@ -12,18 +17,47 @@ struct Material {
   Material() {};
   Material(const MaterialBuilderData& data) : data(data) {}
 
-  std::optional<vkm::Pipeline>& Pipeline() { return pipeline; }
+  // The pipeline built for `variant`, whose vkm::Pipeline::Variant::Hash is `variantHash`, if there is one
+  vkm::Pipeline* FindPipeline(const vkm::Pipeline::Variant& variant, uint64_t variantHash) {
+    auto [begin, end] = pipelines.equal_range(variantHash);
+    auto it = std::find_if(begin, end, [&](const auto& entry) { return entry.second.variant.View() == variant; });
+    return it != end ? &it->second.pipeline : nullptr;
+  }
+  vkm::Pipeline& AddPipeline(const vkm::Pipeline::Variant& variant, uint64_t variantHash, vkm::Pipeline&& pipeline) {
+    return pipelines.emplace(variantHash, VariantPipeline{vkm::Pipeline::StoredVariant(variant), std::move(pipeline)})->second.pipeline;
+  }
   MaterialBuilderData& Data() { return data; }
 
+  // Set while the shader compiles in the background, draws use the fallback material until then or are skipped without one
+  std::shared_future<std::vector<uint8_t>>& PendingCode() { return pendingCode; }
+  std::optional<uint32_t>& Fallback() { return fallback; }
+  // id of the renderer's shader permutation the material was created from
+  std::optional<uint64_t>& Permutation() { return permutation; }
+  // bindless slots of data.samplers
+  std::vector<uint32_t>& SamplerSlots() { return samplerSlots; }
+  const std::vector<uint32_t>& SamplerSlots() const { return samplerSlots; }
+  bool IsCompiled() const { return !pendingCode.valid(); }
+  bool IsCodeReady() const { return pendingCode.valid() && pendingCode.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
   uint32_t AddRef() { return ++numRefs; }
   uint32_t RemoveRef() { return --numRefs; }
   uint32_t GetRefs() const { return numRefs; }
 
  private:
+  struct VariantPipeline {
+    vkm::Pipeline::StoredVariant variant;
+    vkm::Pipeline pipeline;
+  };
+
   // since we don't know the output attachment formats of the pipeline
-  // we only store the build data and compile lazily when needed
-  std::optional<vkm::Pipeline> pipeline = std::nullopt;
+  // we only store the build data and compile lazily for every variant the material gets used with.
+  // By variant hash, the stored variant tells colliding ones apart
+  std::unordered_multimap<uint64_t, VariantPipeline> pipelines;
   MaterialBuilderData data;
+  std::shared_future<std::vector<uint8_t>> pendingCode;
+  std::optional<uint32_t> fallback = std::nullopt;
+  std::optional<uint64_t> permutation = std::nullopt;
+  std::vector<uint32_t> samplerSlots;
   uint32_t numRefs = 0;
 };
 }  // namespace maple
\ No newline at end of file
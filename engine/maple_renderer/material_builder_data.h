@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include "sampler_info.h"
+
 namespace maple {
 struct MaterialBuilderData {
  public:
@@ -43,6 +45,8 @@ struct MaterialBuilderData {
     CullModeFlagBits cullMode = CullModeFlagBits::Back;
     FrontFace frontFace = FrontFace::CounterClockwise;
     bool depthBiasEnable = false;
+
+    bool operator==(const RasterizerState&) const = default;
   };
 
   struct DepthStencilState {
@@ -64,7 +68,29 @@ struct MaterialBuilderData {
 
   std::string vertEntryFuncName = "vertMain";
   std::string fragEntryFuncName = "fragMain";
+  // Set for materials dispatched by compute passes, the graphics state and entries above are ignored then
+  std::string computeEntryFuncName;
   // Must be slang shader code, compiled internally to spirv
   std::vector<uint8_t> shaderCode;
+
+  // Feature keywords of the material's permutation, defined to 1 when compiling the shader. Materials with the same source,
+  // entry points and keywords share one compilation, the order of the keywords doesn't matter
+  std::vector<std::string> keywords;
+
+  // `[vk::constant_id(id)]` constant of the shader, 32 bit values so bools, ints or the bits of a float
+  struct SpecializationConstant {
+    uint32_t id;
+    uint32_t value;
+
+    bool operator==(const SpecializationConstant&) const = default;
+  };
+  // Applied to every pipeline of the material, draws can override them without another compilation
+  std::vector<SpecializationConstant> specializationConstants;
+
+  // Bindless sampler slots (binding 7) of these samplers follow the draw's used resources in the material buffer, in this
+  // order. Samplers with equal settings are shared between materials. Slot 0 is always the default SamplerInfo
+  std::vector<SamplerInfo> samplers;
+
+  bool IsCompute() const { return !computeEntryFuncName.empty(); }
 };
 }  // namespace maple
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "log_macros.h"
+#include "vkm/vkm_buffer.h"
+
+namespace maple {
+// Persistent store of material parameter blocks, the bindless slots a draw's shader reads from the material buffer.
+// Blocks are keyed by their content, so draws with identical parameters share one block. A block keeps its offset for as
+// long as draws use it and is written only once, when its content is first seen. Blocks that went unused for a while are
+// freed, never before every frame in flight that could still read them has finished.
+class MaterialParamCache {
+ public:
+  // frames a block has to go unused before its memory is reused, keeps blocks of draws that skip a few frames alive
+  static constexpr uint64_t UNUSED_FRAMES_BEFORE_FREE = 64;
+
+  MaterialParamCache() = default;
+  MaterialParamCache(vkm::Buffer& buffer, uint32_t framesInFlight) : mBuffer(&buffer) {
+    MAPLE_ASSERT(buffer.IsMapped(), "material param cache requires a persistently mapped buffer");
+    MAPLE_ASSERT(framesInFlight <= UNUSED_FRAMES_BEFORE_FREE, "blocks could be freed while a frame in flight reads them");
+  }
+
+  // Element offset of the block holding `params`, written to the buffer the first time they're seen
+  uint32_t Get(std::span<const uint32_t> params) {
+    if (params.empty()) return 0;  // nothing is read from the offset
+
+    mLookup.assign(params.begin(), params.end());
+    auto it = mBlocks.find(mLookup);
+    if (it == mBlocks.end()) {
+      uint32_t offset = allocate(static_cast<uint32_t>(params.size()));
+      std::memcpy(static_cast<uint32_t*>(mBuffer->mapped) + offset, params.data(), params.size_bytes());
+      it = mBlocks.emplace(mLookup, Block{.offset = offset}).first;
+    }
+    it->second.lastUsedFrame = mFrame;
+    return it->second.offset;
+  }
+
+  // Call once per frame, after the fence of the frame about to be recorded was waited on
+  void NextFrame() {
+    mFrame++;
+    if (mFrame % UNUSED_FRAMES_BEFORE_FREE != 0) return;  // no block can have expired since the last sweep
+
+    std::erase_if(mBlocks, [&](const auto& entry) {
+      auto& [params, block] = entry;
+      if (mFrame - block.lastUsedFrame < UNUSED_FRAMES_BEFORE_FREE) return false;
+      mFreeBlocks[static_cast<uint32_t>(params.size())].push_back(block.offset);
+      return true;
+    });
+  }
+
+  uint32_t NumBlocks() const { return static_cast<uint32_t>(mBlocks.size()); }
+
+ private:
+  struct Block {
+    uint32_t offset;  // in uint32_t elements
+    uint64_t lastUsedFrame = 0;
+  };
+
+  // FNV-1a over the slots
+  struct ParamsHash {
+    size_t operator()(const std::vector<uint32_t>& params) const {
+      uint64_t hash = 14695981039346656037ull;
+      for (auto param : params) {
+        hash ^= param;
+        hash *= 1099511628211ull;  // FNV-1a prime
+      }
+      return static_cast<size_t>(hash);
+    }
+  };
+
+  vkm::Buffer* mBuffer = nullptr;
+  uint64_t mFrame = 0;
+  uint32_t mHead = 0;  // elements handed out from the untouched end of the buffer
+
+  std::unordered_map<std::vector<uint32_t>, Block, ParamsHash> mBlocks;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> mFreeBlocks;  // offsets of freed blocks by their size
+  std::vector<uint32_t> mLookup;                                     // reused for lookups, avoids an allocation per draw
+
+  // blocks are only reused at their exact size, parameter blocks come in very few sizes
+  uint32_t allocate(uint32_t size) {
+    if (auto it = mFreeBlocks.find(size); it != mFreeBlocks.end() && !it->second.empty()) {
+      uint32_t offset = it->second.back();
+      it->second.pop_back();
+      return offset;
+    }
+
+    auto capacity = static_cast<uint32_t>(mBuffer->size / sizeof(uint32_t));
+    if (mHead + size > capacity) MAPLE_FATAL("material buffer out of memory, {} blocks using {} of {} elements", mBlocks.size(), mHead, capacity);
+    uint32_t offset = mHead;
+    mHead += size;
+    return offset;
+  }
+};
+}  // namespace maple
@@ -2,16 +2,83 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <optional>
 #include <span>
 
 namespace maple {
+// A coarser index list over the vertices of a mesh, see OptimizeMesh to generate them
+struct MeshLod {
+  std::span<const uint32_t> indices;
+  float error;  // object space distance the simplified surface may be off from the full detail one
+};
+
+// A cluster of up to MAX_TRIANGLES triangles over at most MAX_VERTICES vertices, a consecutive range of the full detail
+// indices. GPU culled draws test every cluster on its own so only the visible part of a large mesh is drawn, see BuildMeshlets.
+// Mirrors the std430 layout of the cull shader's Meshlet struct
+struct Meshlet {
+  static constexpr uint32_t MAX_VERTICES = 64;
+  static constexpr uint32_t MAX_TRIANGLES = 124;
+
+  glm::vec4 boundingSphere;  // object space center & radius
+  // Normal cone of the triangles, every triangle faces away from any camera position for which
+  // dot(normalize(coneApex - cameraPos), coneAxis) >= coneCutoff. A cutoff above 1 never culls
+  glm::vec3 coneApex;
+  float coneCutoff;
+  glm::vec3 coneAxis;
+  uint32_t firstIndex;
+  uint32_t numTriangles;
+  uint32_t padding[3];
+};
+static_assert(sizeof(Meshlet) == 64, "Meshlet must match the std430 layout of the shader struct");
+
+// Decodes quantized vertex positions, position = offset + quantized * scale. The identity for uncompressed meshes
+struct VertexQuantization {
+  glm::vec3 positionOffset{0.0f};
+  glm::vec3 positionScale{1.0f};
+};
+
 class MeshData {
  public:
+  static constexpr uint32_t MAX_LODS = 4;  // the full detail indices included
+
   std::span<const std::byte> verts;
   std::span<const uint32_t> indices;
   uint32_t numVerts;
+  std::optional<glm::vec4> boundingSphere = std::nullopt;  // object space center & radius, used by GPU culling
+  std::span<const MeshLod> lods = {};  // ordered from fine to coarse with increasing errors, at most MAX_LODS - 1
+  std::span<const Meshlet> meshlets = {};  // covering `indices`, empty for meshes that are always culled as a whole
+  VertexQuantization quantization = {};    // set by CompressVertices, see vertex_compression.h
 
   uint32_t GetStride() const { return verts.size() / numVerts; }
-  uint32_t GetTotalSize() const { return indices.size() * sizeof(decltype(indices)::value_type) + verts.size(); }
+  uint32_t GetTotalSize() const {
+    size_t numIndices = indices.size();
+    for (auto& lod : lods) numIndices += lod.indices.size();
+    return numIndices * sizeof(uint32_t) + verts.size() + meshlets.size_bytes();
+  }
+
+  // Sphere around the AABB of the positions, assumes every vertex starts with a float3 position, so uncompressed vertices
+  glm::vec4 ComputeBoundingSphere() const {
+    if (numVerts == 0) return glm::vec4(0.0f);
+
+    auto positionAt = [&](uint32_t i) {
+      glm::vec3 pos;
+      std::memcpy(&pos, verts.data() + i * GetStride(), sizeof(pos));
+      return pos;
+    };
+
+    glm::vec3 min = positionAt(0), max = min;
+    for (uint32_t i = 1; i < numVerts; i++) {
+      auto pos = positionAt(i);
+      min = glm::min(min, pos);
+      max = glm::max(max, pos);
+    }
+
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < numVerts; i++) radius = glm::max(radius, glm::distance(center, positionAt(i)));
+    return glm::vec4(center, radius);
+  }
 };
 }  // namespace maple
\ No newline at end of file
@@ -0,0 +1,626 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <utility>
+
+#include "log_macros.h"
+
+namespace maple {
+namespace {
+constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+constexpr uint32_t FORSYTH_MAX_VALENCE = 32;  // higher valences all score like this one
+
+// Vertex scores by position in the simulated LRU cache and by the number of triangles still using the vertex, so vertices
+// that are about to be evicted or have few triangles left are finished first
+struct ForsythScores {
+  std::array<float, FORSYTH_CACHE_SIZE> cache;
+  std::array<float, FORSYTH_MAX_VALENCE + 1> valence;
+
+  ForsythScores() {
+    for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+      // the last triangle's vertices score the same, whichever order they were emitted in
+      cache[i] = i < 3 ? 0.75f : std::pow(1.0f - static_cast<float>(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    valence[0] = 0.0f;
+    for (uint32_t i = 1; i <= FORSYTH_MAX_VALENCE; i++) valence[i] = 2.0f / std::sqrt(static_cast<float>(i));
+  }
+
+  float Score(int32_t cachePos, uint32_t remainingTris) const {
+    if (remainingTris == 0) return -1.0f;
+    float score = cachePos >= 0 ? cache[cachePos] : 0.0f;
+    return score + valence[std::min(remainingTris, FORSYTH_MAX_VALENCE)];
+  }
+};
+
+// FIFO cache of a fixed number of vertices, like the post transform cache of most hardware
+class FifoCacheSim {
+ public:
+  FifoCacheSim(uint32_t numVerts, uint32_t cacheSize) : mTimestamps(numVerts, 0), mCacheSize(cacheSize), mTime(cacheSize + 1) {}
+
+  // vertex shader invocations the triangle costs
+  uint32_t Triangle(const uint32_t* tri) {
+    uint32_t misses = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      if (mTime - mTimestamps[tri[k]] <= mCacheSize) continue;
+      mTimestamps[tri[k]] = mTime++;
+      misses++;
+    }
+    return misses;
+  }
+
+  // evicts every vertex
+  void Flush() { mTime += mCacheSize + 1; }
+
+ private:
+  std::vector<uint64_t> mTimestamps;  // when the vertex was last loaded into the cache
+  uint64_t mCacheSize;
+  uint64_t mTime;
+};
+
+glm::vec3 PositionAt(const MeshData& mesh, uint32_t vertex) {
+  glm::vec3 pos;
+  std::memcpy(&pos, mesh.verts.data() + static_cast<size_t>(vertex) * mesh.GetStride(), sizeof(pos));
+  return pos;
+}
+
+// Sum of squared distances to a set of planes as a symmetric 4x4 matrix, Q(p) = p^T Q p with p = (x, y, z, 1)
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+
+  static Quadric FromPlane(glm::vec3 normal, float distance) {
+    double a = normal.x, b = normal.y, c = normal.z, d = distance;
+    return {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+  }
+
+  Quadric& operator+=(const Quadric& q) {
+    a00 += q.a00, a01 += q.a01, a02 += q.a02, a03 += q.a03, a11 += q.a11;
+    a12 += q.a12, a13 += q.a13, a22 += q.a22, a23 += q.a23, a33 += q.a33;
+    return *this;
+  }
+
+  double Error(glm::vec3 p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double error = a00 * x * x + a11 * y * y + a22 * z * z + a33;
+    error += 2.0 * (a01 * x * y + a02 * x * z + a03 * x + a12 * y * z + a13 * y + a23 * z);
+    return std::max(error, 0.0);  // rounding can take it slightly below
+  }
+};
+
+// Vertices that may not move during simplification: those on a border or non-manifold edge, which would open holes, and
+// those sharing their position with another vertex, an attribute seam that would tear
+std::vector<bool> FindLockedVertices(std::span<const uint32_t> indices, const MeshData& mesh) {
+  std::vector<bool> locked(mesh.numVerts, false);
+
+  std::unordered_map<uint64_t, uint32_t> edgeUses;
+  edgeUses.reserve(indices.size());
+  for (size_t t = 0; t < indices.size(); t += 3) {
+    for (uint32_t k = 0; k < 3; k++) {
+      uint64_t a = indices[t + k], b = indices[t + (k + 1) % 3];
+      edgeUses[std::min(a, b) << 32 | std::max(a, b)]++;
+    }
+  }
+  for (auto [edge, uses] : edgeUses) {
+    if (uses == 2) continue;
+    locked[edge >> 32] = true;
+    locked[edge & UINT32_MAX] = true;
+  }
+
+  struct PositionHash {
+    size_t operator()(const glm::vec3& pos) const {
+      uint32_t bits[3];
+      std::memcpy(bits, &pos, sizeof(bits));
+      return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+  };
+  struct PositionEqual {
+    bool operator()(const glm::vec3& a, const glm::vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+  };
+  std::unordered_map<glm::vec3, uint32_t, PositionHash, PositionEqual> firstAtPosition;
+  firstAtPosition.reserve(mesh.numVerts);
+  for (uint32_t v = 0; v < mesh.numVerts; v++) {
+    auto [it, inserted] = firstAtPosition.try_emplace(PositionAt(mesh, v), v);
+    if (inserted) continue;
+    locked[v] = true;
+    locked[it->second] = true;
+  }
+  return locked;
+}
+
+}  // namespace
+
+Meshlet ComputeMeshletBounds(std::span<const uint32_t> indices, const MeshData& mesh) {
+  Meshlet meshlet{};
+
+  glm::vec3 min = PositionAt(mesh, indices[0]), max = min;
+  for (auto index : indices) {
+    min = glm::min(min, PositionAt(mesh, index));
+    max = glm::max(max, PositionAt(mesh, index));
+  }
+  glm::vec3 center = (min + max) * 0.5f;
+  float radius = 0.0f;
+  for (auto index : indices) radius = std::max(radius, glm::distance(center, PositionAt(mesh, index)));
+  meshlet.boundingSphere = glm::vec4(center, radius);
+
+  meshlet.coneApex = center;
+  meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+  meshlet.coneCutoff = 2.0f;
+
+  std::array<glm::vec3, Meshlet::MAX_TRIANGLES> normals;
+  uint32_t numNormals = 0;
+  glm::vec3 normalSum(0.0f);
+  for (size_t t = 0; t < indices.size(); t += 3) {
+    auto p0 = PositionAt(mesh, indices[t]);
+    auto normal = glm::cross(PositionAt(mesh, indices[t + 1]) - p0, PositionAt(mesh, indices[t + 2]) - p0);
+    float length = glm::length(normal);
+    if (length == 0.0f) continue;  // degenerate triangles are never visible
+    normals[numNormals++] = normal / length;
+    normalSum += normal / length;
+  }
+  float sumLength = glm::length(normalSum);
+  if (numNormals == 0 || sumLength < 1e-6f) return meshlet;
+  glm::vec3 axis = normalSum / sumLength;
+
+  float minDot = 1.0f;
+  for (uint32_t i = 0; i < numNormals; i++) minDot = std::min(minDot, glm::dot(normals[i], axis));
+  if (minDot <= 0.1f) return meshlet;
+
+  // move the apex back along the axis until it's behind every triangle's plane
+  float maxT = 0.0f;
+  uint32_t normalIdx = 0;
+  for (size_t t = 0; t < indices.size(); t += 3) {
+    auto p0 = PositionAt(mesh, indices[t]);
+    auto normal = glm::cross(PositionAt(mesh, indices[t + 1]) - p0, PositionAt(mesh, indices[t + 2]) - p0);
+    if (glm::length(normal) == 0.0f) continue;
+    auto& unitNormal = normals[normalIdx++];
+    maxT = std::max(maxT, glm::dot(center - p0, unitNormal) / glm::dot(axis, unitNormal));
+  }
+
+  meshlet.coneApex = center - axis * maxT;
+  meshlet.coneAxis = axis;
+  meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+  return meshlet;
+}
+
+std::vector<uint32_t> OptimizeVertexCache(std::span<const uint32_t> indices, uint32_t numVerts) {
+  MAPLE_ASSERT(indices.size() % 3 == 0, "mesh index count {} is not a multiple of 3", indices.size());
+  static const ForsythScores scores;
+  auto numTris = static_cast<uint32_t>(indices.size() / 3);
+
+  // the not yet emitted triangles of every vertex, vertTris[firstTri[v], firstTri[v] + remainingTris[v])
+  std::vector<uint32_t> remainingTris(numVerts, 0);
+  for (auto index : indices) {
+    MAPLE_ASSERT(index < numVerts, "mesh index {} out of range, the mesh has {} vertices", index, numVerts);
+    remainingTris[index]++;
+  }
+  std::vector<uint32_t> firstTri(numVerts + 1, 0);
+  for (uint32_t v = 0; v < numVerts; v++) firstTri[v + 1] = firstTri[v] + remainingTris[v];
+  std::vector<uint32_t> vertTris(indices.size());
+  {
+    auto fill = firstTri;
+    for (uint32_t i = 0; i < indices.size(); i++) vertTris[fill[indices[i]]++] = i / 3;
+  }
+
+  std::vector<int32_t> cachePos(numVerts, -1);
+  std::vector<float> vertScore(numVerts);
+  for (uint32_t v = 0; v < numVerts; v++) vertScore[v] = scores.Score(-1, remainingTris[v]);
+  std::vector<float> triScore(numTris);
+  for (uint32_t t = 0; t < numTris; t++) triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+  std::vector<bool> emitted(numTris, false);
+
+  std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> cache;
+  std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> newCache;
+  uint32_t cacheSize = 0;
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  uint32_t deadEndCursor = 0;
+  int64_t next = -1;
+  while (result.size() < indices.size()) {
+    // none of the cached vertices have triangles left, continue with the next unemitted one in input order
+    if (next < 0) {
+      while (emitted[deadEndCursor]) deadEndCursor++;
+      next = deadEndCursor;
+    }
+    auto tri = static_cast<uint32_t>(next);
+    const uint32_t* triVerts = &indices[tri * 3];
+
+    emitted[tri] = true;
+    for (uint32_t k = 0; k < 3; k++) {
+      uint32_t v = triVerts[k];
+      result.push_back(v);
+
+      auto begin = vertTris.begin() + firstTri[v];
+      auto end = begin + remainingTris[v];
+      auto it = std::find(begin, end, tri);
+      *it = *(end - 1);
+      remainingTris[v]--;
+    }
+
+    // the triangle's vertices move to the front of the cache, the rest shift back
+    uint32_t newCacheSize = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      auto newCacheEnd = newCache.begin() + newCacheSize;
+      if (std::find(newCache.begin(), newCacheEnd, triVerts[k]) == newCacheEnd) newCache[newCacheSize++] = triVerts[k];
+    }
+    for (uint32_t i = 0; i < cacheSize; i++) {
+      if (cache[i] != triVerts[0] && cache[i] != triVerts[1] && cache[i] != triVerts[2]) newCache[newCacheSize++] = cache[i];
+    }
+
+    // rescore the cached and just evicted vertices, and with them their remaining triangles
+    for (uint32_t i = 0; i < newCacheSize; i++) {
+      uint32_t v = newCache[i];
+      cachePos[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+      float score = scores.Score(cachePos[v], remainingTris[v]);
+      float delta = score - vertScore[v];
+      vertScore[v] = score;
+      for (uint32_t j = 0; j < remainingTris[v]; j++) triScore[vertTris[firstTri[v] + j]] += delta;
+    }
+    cacheSize = std::min(newCacheSize, FORSYTH_CACHE_SIZE);
+    std::copy_n(newCache.begin(), cacheSize, cache.begin());
+
+    next = -1;
+    float bestScore = -1.0f;
+    for (uint32_t i = 0; i < cacheSize; i++) {
+      uint32_t v = cache[i];
+      for (uint32_t j = 0; j < remainingTris[v]; j++) {
+        uint32_t t = vertTris[firstTri[v] + j];
+        if (triScore[t] > bestScore) {
+          bestScore = triScore[t];
+          next = t;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<uint32_t> OptimizeOverdraw(std::span<const uint32_t> indices, const MeshData& mesh, float threshold) {
+  MAPLE_ASSERT(indices.size() % 3 == 0, "mesh index count {} is not a multiple of 3", indices.size());
+  constexpr uint32_t CACHE_SIZE = 16;
+  auto numTris = static_cast<uint32_t>(indices.size() / 3);
+  if (numTris == 0) return {};
+
+  // Clusters start where the cache runs cold anyway, a triangle missing all of its vertices, or where the cluster so far
+  // already reached a good enough miss ratio. The cache restarts with every cluster, as it will once they're reordered
+  float maxMissRatio = AverageCacheMissRatio(indices, mesh.numVerts, CACHE_SIZE) * threshold;
+  std::vector<uint32_t> clusterStarts = {0};
+  {
+    FifoCacheSim cache(mesh.numVerts, CACHE_SIZE);
+    uint32_t clusterTris = 0;
+    uint32_t clusterMisses = 0;
+    for (uint32_t t = 0; t < numTris; t++) {
+      uint32_t misses = cache.Triangle(&indices[t * 3]);
+      if (misses == 3 && clusterTris > 0) {
+        clusterStarts.push_back(t);
+        clusterTris = 0;
+        clusterMisses = 0;
+      }
+      clusterTris++;
+      clusterMisses += misses;
+
+      if (t + 1 < numTris && static_cast<float>(clusterMisses) / clusterTris <= maxMissRatio) {
+        clusterStarts.push_back(t + 1);
+        clusterTris = 0;
+        clusterMisses = 0;
+        cache.Flush();
+      }
+    }
+  }
+  auto numClusters = static_cast<uint32_t>(clusterStarts.size());
+  clusterStarts.push_back(numTris);
+
+  // area weighted centroid & average normal of every cluster
+  struct Cluster {
+    uint32_t begin;
+    uint32_t end;
+    float sortKey = 0.0f;
+  };
+  std::vector<Cluster> clusters(numClusters);
+  std::vector<glm::vec3> centroids(numClusters, glm::vec3(0.0f));
+  std::vector<glm::vec3> normals(numClusters, glm::vec3(0.0f));
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (uint32_t c = 0; c < numClusters; c++) {
+    clusters[c] = {.begin = clusterStarts[c], .end = clusterStarts[c + 1]};
+
+    float clusterArea = 0.0f;
+    for (uint32_t t = clusters[c].begin; t < clusters[c].end; t++) {
+      auto p0 = PositionAt(mesh, indices[t * 3]);
+      auto p1 = PositionAt(mesh, indices[t * 3 + 1]);
+      auto p2 = PositionAt(mesh, indices[t * 3 + 2]);
+      auto normal = glm::cross(p1 - p0, p2 - p0);  // length is twice the area
+      float area = glm::length(normal);
+
+      centroids[c] += (p0 + p1 + p2) / 3.0f * area;
+      normals[c] += normal;
+      clusterArea += area;
+    }
+
+    meshCentroid += centroids[c];
+    meshArea += clusterArea;
+    centroids[c] = clusterArea > 0.0f ? centroids[c] / clusterArea : PositionAt(mesh, indices[clusters[c].begin * 3]);
+  }
+  if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+  // clusters facing away from the center are on the outside of the mesh, drawing them first occludes the inner ones
+  for (uint32_t c = 0; c < numClusters; c++) {
+    float normalLength = glm::length(normals[c]);
+    if (normalLength > 0.0f) clusters[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c] / normalLength);
+  }
+  std::ranges::stable_sort(clusters, std::greater{}, &Cluster::sortKey);
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (auto& cluster : clusters) result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+  return result;
+}
+
+std::vector<uint32_t> SimplifyMesh(std::span<const uint32_t> indices, const MeshData& mesh, uint32_t targetIndexCount, float* outError) {
+  MAPLE_ASSERT(indices.size() % 3 == 0, "mesh index count {} is not a multiple of 3", indices.size());
+  auto locked = FindLockedVertices(indices, mesh);
+
+  std::vector<Quadric> quadrics(mesh.numVerts);
+  for (size_t t = 0; t < indices.size(); t += 3) {
+    auto p0 = PositionAt(mesh, indices[t]);
+    auto normal = glm::cross(PositionAt(mesh, indices[t + 1]) - p0, PositionAt(mesh, indices[t + 2]) - p0);
+    float length = glm::length(normal);
+    if (length == 0.0f) continue;
+    normal = normal / length;
+
+    auto plane = Quadric::FromPlane(normal, -glm::dot(normal, p0));
+    for (uint32_t k = 0; k < 3; k++) quadrics[indices[t + k]] += plane;
+  }
+
+  struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+  };
+
+  std::vector<uint32_t> result(indices.begin(), indices.end());
+  std::vector<uint32_t> collapseTo(mesh.numVerts);
+  std::vector<bool> touched(mesh.numVerts);
+  std::vector<uint32_t> firstTri(mesh.numVerts + 1);
+  std::vector<uint32_t> vertTris;
+  std::vector<Collapse> candidates;
+  double maxCost = 0.0;
+
+  // Every pass collapses the cheapest edges that don't share triangles, so their costs and flip checks stay valid
+  while (result.size() > targetIndexCount) {
+    std::ranges::fill(firstTri, 0);
+    for (auto index : result) firstTri[index + 1]++;
+    for (uint32_t v = 0; v < mesh.numVerts; v++) firstTri[v + 1] += firstTri[v];
+    vertTris.resize(result.size());
+    {
+      auto fill = firstTri;
+      for (uint32_t i = 0; i < result.size(); i++) vertTris[fill[result[i]]++] = i / 3;
+    }
+
+    candidates.clear();
+    for (size_t t = 0; t < result.size(); t += 3) {
+      for (uint32_t k = 0; k < 3; k++) {
+        uint32_t a = result[t + k], b = result[t + (k + 1) % 3];
+        Quadric merged = quadrics[a];
+        merged += quadrics[b];
+        if (!locked[a]) candidates.push_back({a, b, merged.Error(PositionAt(mesh, b))});
+        if (!locked[b]) candidates.push_back({b, a, merged.Error(PositionAt(mesh, a))});
+      }
+    }
+    std::ranges::sort(candidates, {}, &Collapse::cost);
+
+    std::iota(collapseTo.begin(), collapseTo.end(), 0u);
+    std::fill(touched.begin(), touched.end(), false);
+    size_t trisToRemove = (result.size() - targetIndexCount + 2) / 3;
+    size_t trisRemoved = 0;
+    uint32_t numCollapses = 0;
+    for (auto& collapse : candidates) {
+      if (trisRemoved >= trisToRemove) break;
+      if (touched[collapse.from] || touched[collapse.to]) continue;
+
+      // moving `from` onto `to` must not turn any of the triangles that survive the collapse around
+      auto target = PositionAt(mesh, collapse.to);
+      bool flips = false;
+      uint32_t collapsedTris = 0;
+      for (uint32_t j = firstTri[collapse.from]; j < firstTri[collapse.from + 1] && !flips; j++) {
+        const uint32_t* tri = &result[vertTris[j] * 3];
+        if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+          collapsedTris++;
+          continue;
+        }
+
+        glm::vec3 before[3], after[3];
+        for (uint32_t k = 0; k < 3; k++) {
+          before[k] = PositionAt(mesh, tri[k]);
+          after[k] = tri[k] == collapse.from ? target : before[k];
+        }
+        auto normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        auto normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        flips = glm::dot(normalBefore, normalAfter) <= 0.0f;
+      }
+      if (flips) continue;
+
+      collapseTo[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      maxCost = std::max(maxCost, collapse.cost);
+      for (uint32_t j = firstTri[collapse.from]; j < firstTri[collapse.from + 1]; j++) {
+        for (uint32_t k = 0; k < 3; k++) touched[result[vertTris[j] * 3 + k]] = true;
+      }
+      trisRemoved += collapsedTris;
+      numCollapses++;
+    }
+    if (numCollapses == 0) break;  // everything left is locked or would flip
+
+    size_t write = 0;
+    for (size_t t = 0; t < result.size(); t += 3) {
+      uint32_t a = collapseTo[result[t]], b = collapseTo[result[t + 1]], c = collapseTo[result[t + 2]];
+      if (a == b || b == c || a == c) continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+
+  if (outError) *outError = static_cast<float>(std::sqrt(maxCost));
+  return result;
+}
+
+std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t>& indices, const MeshData& mesh) {
+  MAPLE_ASSERT(indices.size() % 3 == 0, "mesh index count {} is not a multiple of 3", indices.size());
+  auto numTris = static_cast<uint32_t>(indices.size() / 3);
+
+  // triangles using each vertex
+  std::vector<uint32_t> triOffsets(mesh.numVerts + 1, 0);
+  for (auto index : indices) triOffsets[index + 1]++;
+  std::partial_sum(triOffsets.begin(), triOffsets.end(), triOffsets.begin());
+  std::vector<uint32_t> vertexTris(indices.size());
+  std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+  for (uint32_t t = 0; t < numTris; t++) {
+    for (uint32_t k = 0; k < 3; k++) vertexTris[fill[indices[t * 3 + k]]++] = t;
+  }
+
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<bool> emitted(numTris, false);
+  std::vector<uint32_t> vertexMeshlet(mesh.numVerts, UINT32_MAX);  // last meshlet the vertex was added to
+  std::vector<uint32_t> meshletVerts;
+  meshletVerts.reserve(Meshlet::MAX_VERTICES);
+
+  auto newVertices = [&](uint32_t tri, uint32_t meshletIdx) {
+    uint32_t count = 0;
+    for (uint32_t k = 0; k < 3; k++) count += vertexMeshlet[indices[tri * 3 + k]] != meshletIdx;
+    return count;
+  };
+
+  // Meshlets grow greedily from the first triangle not yet emitted, always taking the adjacent triangle that adds the fewest
+  // new vertices. Starting in the cache optimized order keeps the meshlets themselves in a cache friendly order
+  uint32_t seed = 0;
+  while (true) {
+    while (seed < numTris && emitted[seed]) seed++;
+    if (seed == numTris) break;
+
+    auto meshletIdx = static_cast<uint32_t>(meshlets.size());
+    auto firstIndex = static_cast<uint32_t>(result.size());
+    meshletVerts.clear();
+
+    uint32_t tri = seed;
+    uint32_t numTriangles = 0;
+    while (true) {
+      emitted[tri] = true;
+      numTriangles++;
+      for (uint32_t k = 0; k < 3; k++) {
+        uint32_t index = indices[tri * 3 + k];
+        result.push_back(index);
+        if (vertexMeshlet[index] != meshletIdx) {
+          vertexMeshlet[index] = meshletIdx;
+          meshletVerts.push_back(index);
+        }
+      }
+      if (numTriangles == Meshlet::MAX_TRIANGLES) break;
+
+      // ties go to the triangle closest to the meshlet's center, which keeps meshlets round instead of growing into strips
+      glm::vec3 centroid(0.0f);
+      for (auto vertex : meshletVerts) centroid += PositionAt(mesh, vertex);
+      centroid /= static_cast<float>(meshletVerts.size());
+
+      uint32_t best = UINT32_MAX;
+      uint32_t bestNew = 4;
+      float bestDistance = 0.0f;
+      for (auto vertex : meshletVerts) {
+        for (uint32_t i = triOffsets[vertex]; i < triOffsets[vertex + 1]; i++) {
+          uint32_t candidate = vertexTris[i];
+          if (emitted[candidate] || candidate == best) continue;
+          uint32_t added = newVertices(candidate, meshletIdx);
+          if (added > bestNew) continue;
+
+          const uint32_t* tri = &indices[candidate * 3];
+          float distance = glm::distance(centroid, (PositionAt(mesh, tri[0]) + PositionAt(mesh, tri[1]) + PositionAt(mesh, tri[2])) / 3.0f);
+          if (added < bestNew || distance < bestDistance) {
+            best = candidate;
+            bestNew = added;
+            bestDistance = distance;
+          }
+        }
+      }
+      // the best candidate adds the fewest vertices, if it doesn't fit no other one does
+      if (best == UINT32_MAX || meshletVerts.size() + bestNew > Meshlet::MAX_VERTICES) break;
+      tri = best;
+    }
+
+    auto meshlet = ComputeMeshletBounds(std::span(result).subspan(firstIndex), mesh);
+    meshlet.firstIndex = firstIndex;
+    meshlet.numTriangles = numTriangles;
+    meshlets.push_back(meshlet);
+  }
+
+  indices = std::move(result);
+  return meshlets;
+}
+
+OptimizedMesh OptimizeMesh(const MeshData& mesh, uint32_t maxLods, bool buildMeshlets) {
+  MAPLE_ASSERT(maxLods >= 1 && maxLods <= MeshData::MAX_LODS, "meshes have between 1 and {} LODs", MeshData::MAX_LODS);
+  auto indices = OptimizeVertexCache(mesh.indices, mesh.numVerts);
+  indices = OptimizeOverdraw(indices, mesh);
+
+  // every LOD halves the triangles of the previous one, until simplification stops paying off
+  std::vector<std::vector<uint32_t>> lodIndices;
+  std::vector<float> lodErrors;
+  for (uint32_t lod = 1; lod < maxLods; lod++) {
+    size_t previousSize = lodIndices.empty() ? indices.size() : lodIndices.back().size();
+    auto target = static_cast<uint32_t>(previousSize / 2 / 3 * 3);
+    if (target == 0) break;
+
+    float error = 0.0f;
+    auto simplified = SimplifyMesh(indices, mesh, target, &error);
+    if (simplified.size() * 10 > previousSize * 9) break;
+
+    lodErrors.push_back(std::max(error, lodErrors.empty() ? 0.0f : lodErrors.back()));
+    lodIndices.push_back(OptimizeVertexCache(simplified, mesh.numVerts));
+  }
+
+  // clusters replace the overdraw order, their triangles stay in the same order within each one
+  std::vector<Meshlet> meshlets;
+  if (buildMeshlets) meshlets = BuildMeshlets(indices, mesh);
+
+  OptimizedMesh result;
+  uint32_t stride = mesh.numVerts > 0 ? mesh.GetStride() : 0;
+  result.verts.reserve(mesh.verts.size());
+
+  std::vector<uint32_t> remap(mesh.numVerts, UINT32_MAX);
+  for (auto& index : indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = result.numVerts++;
+      auto vertex = mesh.verts.subspan(static_cast<size_t>(index) * stride, stride);
+      result.verts.insert(result.verts.end(), vertex.begin(), vertex.end());
+    }
+    index = remap[index];
+  }
+  for (auto& lod : lodIndices) {
+    for (auto& index : lod) index = remap[index];  // the LODs only use vertices of the full detail mesh
+  }
+
+  result.indices = std::move(indices);
+  result.lodIndices = std::move(lodIndices);
+  result.lodErrors = std::move(lodErrors);
+  result.meshlets = std::move(meshlets);  // the bounds don't depend on the vertex order
+  return result;
+}
+
+float AverageCacheMissRatio(std::span<const uint32_t> indices, uint32_t numVerts, uint32_t cacheSize) {
+  auto numTris = static_cast<uint32_t>(indices.size() / 3);
+  if (numTris == 0) return 0.0f;
+
+  FifoCacheSim cache(numVerts, cacheSize);
+  uint32_t misses = 0;
+  for (uint32_t t = 0; t < numTris; t++) misses += cache.Triangle(&indices[t * 3]);
+  return static_cast<float>(misses) / numTris;
+}
+}  // namespace maple
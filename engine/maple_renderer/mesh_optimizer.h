@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "mesh_data.h"
+
+namespace maple {
+// Import time optimizations of a mesh's data, run once before it's handed to Renderer::CreateMesh.
+// Like MeshData::ComputeBoundingSphere, every vertex is expected to start with a float3 position.
+
+// Owns the data of an optimized mesh, MeshData only views it
+struct OptimizedMesh {
+  std::vector<std::byte> verts;
+  std::vector<uint32_t> indices;
+  uint32_t numVerts = 0;
+  std::vector<std::vector<uint32_t>> lodIndices;  // coarser LODs after `indices`
+  std::vector<float> lodErrors;
+  std::vector<Meshlet> meshlets;  // over `indices`
+
+  // valid until the mesh is modified or Data() is called again
+  MeshData Data() {
+    lodViews.clear();
+    for (size_t i = 0; i < lodIndices.size(); i++) lodViews.push_back({.indices = lodIndices[i], .error = lodErrors[i]});
+    return {.verts = verts, .indices = indices, .numVerts = numVerts, .lods = lodViews, .meshlets = meshlets};
+  }
+
+ private:
+  std::vector<MeshLod> lodViews;
+};
+
+// Reorders the triangles so consecutive ones share vertices, which then hit the post transform vertex cache instead of
+// running the vertex shader again (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+std::vector<uint32_t> OptimizeVertexCache(std::span<const uint32_t> indices, uint32_t numVerts);
+
+// Reorders clusters of a cache optimized index list so outward facing ones are drawn first and occlude the rest.
+// Clusters are only split where that costs the vertex cache less than `threshold` times its miss ratio on the whole mesh
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+std::vector<uint32_t> OptimizeOverdraw(std::span<const uint32_t> indices, const MeshData& mesh, float threshold = 1.05f);
+
+// Index list of the same vertices with about `targetIndexCount` indices, by collapsing the edges that move the surface the
+// least (Garland & Heckbert, "Surface Simplification Using Quadric Error Metrics"). Vertices only collapse onto other
+// vertices so every LOD shares the mesh's vertex data. Vertices on borders and attribute seams stay where they are, which
+// can keep the result above the target. `outError` receives how far the surface may have moved, in object space units
+std::vector<uint32_t> SimplifyMesh(std::span<const uint32_t> indices,
+                                   const MeshData& mesh,
+                                   uint32_t targetIndexCount,
+                                   float* outError = nullptr);
+
+// Splits the triangles into meshlets of at most Meshlet::MAX_VERTICES vertices and Meshlet::MAX_TRIANGLES triangles, grown
+// from spatially adjacent triangles so their bounds and normal cones stay tight. `indices` are reordered so every meshlet
+// is a consecutive range of them
+std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t>& indices, const MeshData& mesh);
+
+// Bounding sphere and normal cone of a meshlet's triangles, the cone apex is placed so every triangle's plane lies in front
+// of it. Cones wider than a hemisphere minus a margin can't cull anything and are left disabled. Only the bounds are set
+Meshlet ComputeMeshletBounds(std::span<const uint32_t> indices, const MeshData& mesh);
+
+// Vertex cache, overdraw and finally vertex fetch optimization: vertices are reordered by first use so the vertex shader
+// reads memory mostly in order, vertices no triangle references are dropped. Up to `maxLods` - 1 simplified LODs with half
+// the triangles of the previous one are generated, as long as simplifying still removes a meaningful part of them.
+// `buildMeshlets` splits the full detail triangles into meshlets, worth it for large meshes that are often partially visible
+OptimizedMesh OptimizeMesh(const MeshData& mesh, uint32_t maxLods = MeshData::MAX_LODS, bool buildMeshlets = false);
+
+// Average vertex shader invocations per triangle for a FIFO cache of `cacheSize` vertices, 0.5 is the best possible
+float AverageCacheMissRatio(std::span<const uint32_t> indices, uint32_t numVerts, uint32_t cacheSize = 16);
+}  // namespace maple
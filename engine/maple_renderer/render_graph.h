@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <glm/glm.hpp>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -18,11 +24,21 @@ class RenderGraph {
     glm::vec2 size = glm::vec2(1.f, 1.f);
     Format format = Undefined;
 
+    // Auto loads the previous writer's contents if the attachment has one and clears otherwise. An explicit Load without a
+    // previous writer becomes DontCare, there is nothing to load.
+    LoadOp loadOp = LoadOp::Auto;
+    // Auto stores only if a later pass reads or loads the attachment, or it's the swapchain
+    StoreOp storeOp = StoreOp::Auto;
+    glm::vec4 clearColor = glm::vec4(0.f, 0.f, 0.f, 1.f);
+    float clearDepth = 1.f;
+    uint32_t clearStencil = 0;
+
     glm::uvec2 GetAbsoluteSize(glm::uvec2 swapChainSize) const {
       if (sizeType == Absolute) return size;
       return glm::uvec2(size.x * swapChainSize.x, size.y * swapChainSize.y);
     }
 
+    // compares the image the attachment needs, not how passes load or store it
     bool operator==(const AttachmentInfo& rhs) const { return sizeType == rhs.sizeType && size == rhs.size && format == rhs.format; }
   };
 
@@ -33,16 +49,27 @@ class RenderGraph {
     AttachmentInfo info;
   };
 
+  struct Input {
+    std::string name;
+    PipelineStage stages;
+  };
+
   struct Pass {
    public:
-    Pass& AddInput(const std::string& inputName) {
-      inputs.push_back(inputName);
+    // `stages` are the shader stages sampling the input, compute passes always read it in the compute shader
+    Pass& AddInput(const std::string& inputName, PipelineStage stages = PipelineStage::FragmentShader) {
+      inputs.push_back({inputName, stages});
       return *this;
     }
     Pass& AddOutput(const std::string& outputName, const AttachmentInfo& info) {
       outputs.push_back({outputName, info});
       return *this;
     }
+    // Disabled passes are left out of compilation as if they were never added, e.g. for a debug overlay
+    Pass& SetEnabled(bool isEnabled) {
+      enabled = isEnabled;
+      return *this;
+    }
 
    private:
     Pass() = default;
@@ -50,7 +77,8 @@ class RenderGraph {
 
     std::string name;
     PipelineType pipelineType;
-    std::vector<std::string> inputs;
+    bool enabled = true;
+    std::vector<Input> inputs;
     std::vector<NameAndAttachment> outputs;
 
     friend class RenderGraph;
@@ -61,104 +89,403 @@ class RenderGraph {
     return passes.back();
   }
 
+  // The reference AddPass returned is invalidated by later AddPass calls, this finds the pass again
+  Pass& GetPass(const std::string& name) {
+    auto it = std::ranges::find(passes, name, &Pass::name);
+    MAPLE_ASSERT(it != passes.end(), "Render graph has no pass '{}'", name);
+    return *it;
+  }
+
+  // Index into CompileResult::attachments, or SWAPCHAIN_RESOURCE
+  using ResourceId = uint32_t;
+  static constexpr ResourceId SWAPCHAIN_RESOURCE = UINT32_MAX;
+
+  // A compiled attachment referenced by id, resolved once through CompileResult::FindAttachment instead of by name every frame
+  struct AttachmentRef {
+    ResourceId id;
+  };
+
+  // A compiled pass referenced by its index into CompileResult::passes, resolved once through CompileResult::FindPass
+  struct PassRef {
+    uint32_t index;
+  };
+
   struct ResourceState {
     ImageLayout layout = ImageLayout::Undefined;
     AccessMask access = AccessMask::None;
     PipelineStage stage = PipelineStage::TopOfPipe;
+    QueueType queue = QueueType::Graphics;
   };
 
+  static constexpr uint32_t NO_SPLIT = UINT32_MAX;
+
+  // A transition whose old and new queue differ moves the resource between queues: it is recorded as a queue ownership release
+  // after the last pass using the resource on the old queue and as the acquire before the pass on the new one.
+  // A split transition is signaled right after `signalPass`, the last pass using the resource, and only waited on before the
+  // pass it belongs to, so the passes in between don't have to drain first
   struct Transition {
-    std::string resource;
+    ResourceId resource;
     ResourceState oldState, newState;
+    uint32_t signalPass = NO_SPLIT;
+  };
+
+  struct CompiledOutput {
+    ResourceId resource;
+    AttachmentInfo info;  // with the load & store ops resolved, never Auto
   };
 
   struct ExecutablePass {
     std::string name;
     PipelineType pipelineType;
-    std::vector<Transition> preTransitions;  // barriers to apply before the pass
-    std::vector<NameAndAttachment> outputs;
+    QueueType queue = QueueType::Graphics;
+    bool waitsForOtherQueue = false;          // touches a resource last used on the other queue, must wait for its submission
+    std::vector<Transition> preTransitions;   // barriers to apply before the pass
+    std::vector<Transition> postTransitions;  // queue ownership releases to apply after the pass
+    std::vector<CompiledOutput> outputs;
+  };
+
+  // An attachment written by one of the compiled passes and how long it lives within a frame
+  struct CompiledAttachment {
+    std::string name;
+    AttachmentInfo info;
+    uint32_t firstPass = 0;   // index into CompileResult::passes of the pass writing the attachment
+    uint32_t lastPass = 0;    // index of the last pass reading it, or firstPass if nothing does
+    bool transient = false;   // never read or loaded by a later pass, its contents don't need to outlive the pass writing it
+    bool storage = false;     // written by a compute pass, as a storage image
+    uint32_t aliasSlot = 0;   // attachments in the same slot have disjoint lifetimes and may share memory
+
+    bool operator==(const CompiledAttachment&) const = default;
   };
 
+  // Flat execution plan, everything in it refers to resources by id
   struct CompileResult {
     std::vector<ExecutablePass> passes;
-    std::vector<NameAndAttachment> attachments;
+    std::vector<CompiledAttachment> attachments;  // excluding the swapchain and outputs of passes that got culled
+    uint32_t numAliasSlots = 0;
+    uint64_t attachmentsHash = 0;  // of everything in `attachments`, equal hashes need the same render targets
+    std::unordered_map<std::string, ResourceId> attachmentIds;
+    std::unordered_map<std::string, uint32_t> passIndices;  // of the passes that weren't culled
+
+    std::optional<AttachmentRef> FindAttachment(const std::string& name) const {
+      auto it = attachmentIds.find(name);
+      if (it == attachmentIds.end()) return std::nullopt;
+      return AttachmentRef{it->second};
+    }
+
+    std::optional<PassRef> FindPass(const std::string& name) const {
+      auto it = passIndices.find(name);
+      if (it == passIndices.end()) return std::nullopt;
+      return PassRef{it->second};
+    }
+
+    const std::string& ResourceName(ResourceId id) const { return id == SWAPCHAIN_RESOURCE ? SWAPCHAIN_TARGET_NAME : attachments[id].name; }
   };
 
-  CompileResult Compile() const {
-    // 1. Build output -> pass map
-    std::unordered_map<std::string, const Pass*> outputToPass;
+  struct CompileOptions {
+    // compute passes go to the async compute queue and are scheduled as early as their dependencies allow, so graphics work
+    // that doesn't depend on them overlaps with them
+    bool asyncCompute = true;
+    // transitions with passes between the resource's last use and the pass needing it are split into a signal and a wait
+    bool splitBarriers = true;
+  };
+
+  CompileResult Compile() { return Compile(CompileOptions{}); }
+
+  // An attachment may be written by several passes: they run in the order they were added, each one after the previous
+  // writer, and passes reading the attachment see the last writer's result.
+  // The last few results are cached by the graph description, so compiling an unchanged graph or toggling a pass back and
+  // forth doesn't rebuild anything. Not const since it updates that cache, compiling the same graph from several threads
+  // needs external synchronization.
+  CompileResult Compile(const CompileOptions& options) {
+    auto description = DescribeForCompile(options);
+    auto cached = std::ranges::find_if(mCompileCache, [&](const CachedCompile& c) {
+      return c.hash == description.hash && c.description == description.bytes;
+    });
+    if (cached != mCompileCache.end()) return cached->result;
+
+    auto result = CompileUncached(options);
+    if (mCompileCache.size() == MAX_CACHED_COMPILES) mCompileCache.erase(mCompileCache.begin());
+    mCompileCache.push_back({description.hash, std::move(description.bytes), result});
+    return result;
+  }
+
+  static constexpr std::string SWAPCHAIN_TARGET_NAME = "SWAPCHAIN";
+
+ private:
+  static constexpr uint32_t NONE = UINT32_MAX;
+  static constexpr size_t MAX_CACHED_COMPILES = 8;
+
+  struct CachedCompile {
+    uint64_t hash;
+    std::vector<uint8_t> description;  // compared on a hash hit, so a collision compiles instead of returning another graph
+    CompileResult result;
+  };
+
+  std::vector<Pass> passes;
+  std::vector<CachedCompile> mCompileCache;
+
+  // FNV-1a over the fields that affect compilation, optionally keeping the bytes hashed
+  struct Hasher {
+    uint64_t value = 14695981039346656037ull;
+    std::vector<uint8_t>* bytes = nullptr;
+
+    void AddBytes(const void* data, size_t size) {
+      auto span = std::span(static_cast<const uint8_t*>(data), size);
+      if (bytes) bytes->insert(bytes->end(), span.begin(), span.end());
+      for (auto byte : span) {
+        value ^= byte;
+        value *= 1099511628211ull;  // FNV-1a prime
+      }
+    }
+    template <typename T>
+      requires std::is_trivially_copyable_v<T>
+    void Add(const T& v) {
+      AddBytes(&v, sizeof(T));
+    }
+    void Add(const std::string& s) {
+      Add(s.size());
+      AddBytes(s.data(), s.size());
+    }
+    void Add(const AttachmentInfo& info) {
+      Add(info.sizeType);
+      Add(info.size);
+      Add(info.format);
+      Add(info.loadOp);
+      Add(info.storeOp);
+      Add(info.clearColor);
+      Add(info.clearDepth);
+      Add(info.clearStencil);
+    }
+  };
+
+  struct Description {
+    std::vector<uint8_t> bytes;
+    uint64_t hash = 0;
+  };
+
+  // the fields of the graph and options that affect compilation, serialized
+  Description DescribeForCompile(const CompileOptions& options) const {
+    Description description;
+    Hasher hasher{.bytes = &description.bytes};
+    hasher.Add(options.asyncCompute);
+    hasher.Add(options.splitBarriers);
     for (const auto& pass : passes) {
+      hasher.Add(pass.enabled);
+      if (!pass.enabled) continue;
+
+      hasher.Add(pass.name);
+      hasher.Add(pass.pipelineType);
+      hasher.Add(pass.inputs.size());
+      for (const auto& input : pass.inputs) {
+        hasher.Add(input.name);
+        hasher.Add(input.stages);
+      }
+      hasher.Add(pass.outputs.size());
       for (const auto& out : pass.outputs) {
-        MAPLE_ASSERT(outputToPass.find(out.name) == outputToPass.end(), "Duplicate output name '{}' in render graph", out.name);
-        outputToPass[out.name] = &pass;
+        hasher.Add(out.name);
+        hasher.Add(out.info);
       }
     }
+    description.hash = hasher.value;
+    return description;
+  }
 
-    std::vector<ExecutablePass> execOrder;
-    std::unordered_set<const Pass*> visited;
-    std::unordered_set<const Pass*> inStack;
+  static uint64_t HashAttachments(const std::vector<CompiledAttachment>& attachments) {
+    Hasher hasher;
+    for (const auto& attachment : attachments) {
+      hasher.Add(attachment.name);
+      hasher.Add(attachment.info);
+      hasher.Add(attachment.firstPass);
+      hasher.Add(attachment.lastPass);
+      hasher.Add(attachment.aliasSlot);
+      hasher.Add(attachment.transient);
+      hasher.Add(attachment.storage);
+    }
+    return hasher.value;
+  }
 
-    // Tracked resource state: resource name -> its current layout/access/stage
-    std::unordered_map<std::string, ResourceState> resourceStates;
+  CompileResult CompileUncached(const CompileOptions& options) const {
+    // 1. Give every resource a local index and collect its writers in the order the passes were added. Per pass resource
+    // indices are kept so nothing below looks a name up again
+    std::unordered_map<std::string, uint32_t> resourceIndices;
+    std::vector<std::vector<uint32_t>> writers;
+    auto intern = [&](const std::string& name) {
+      auto [it, inserted] = resourceIndices.try_emplace(name, static_cast<uint32_t>(writers.size()));
+      if (inserted) writers.emplace_back();
+      return it->second;
+    };
 
-    std::function<void(const std::string&)> walk = [&](const std::string& resource) {
-      auto it = outputToPass.find(resource);
-      if (it == outputToPass.end()) return;  // external, skip
+    std::vector<std::vector<uint32_t>> passInputs(passes.size());
+    std::vector<std::vector<uint32_t>> passOutputs(passes.size());
+    for (auto [p, pass] : std::views::enumerate(passes)) {
+      if (!pass.enabled) continue;
+      auto passIdx = static_cast<uint32_t>(p);
 
-      const Pass* pass = it->second;
-      if (visited.count(pass)) return;
-      if (inStack.count(pass)) {
-        MAPLE_FATAL("Render graph cycle detected involving pass: {}", pass->name);
+      for (const auto& input : pass.inputs) passInputs[p].push_back(intern(input.name));
+      for (const auto& out : pass.outputs) {
+        auto resource = intern(out.name);
+        auto& resourceWriters = writers[resource];
+        MAPLE_ASSERT(resourceWriters.empty() || resourceWriters.back() != passIdx, "Duplicate output name '{}' in pass '{}'", out.name, pass.name);
+        MAPLE_ASSERT(resourceWriters.empty() || FindOutput(passes[resourceWriters.front()], out.name).info == out.info,
+                     "Passes writing '{}' disagree on its size or format",
+                     out.name);
+        MAPLE_ASSERT(pass.pipelineType == Graphics || out.name != SWAPCHAIN_TARGET_NAME, "Compute pass '{}' cannot write the swapchain", pass.name);
+        resourceWriters.push_back(passIdx);
+        passOutputs[p].push_back(resource);
       }
+    }
 
-      inStack.insert(pass);
+    auto previousWriter = [&](uint32_t resource, uint32_t pass) {
+      auto& resourceWriters = writers[resource];
+      auto it = std::ranges::find(resourceWriters, pass);
+      return it == resourceWriters.begin() ? NONE : *std::prev(it);
+    };
 
-      // Process dependencies (inputs)
-      for (const auto& inputName : pass->inputs) {
-        walk(inputName);
+    // every pass depends on the passes producing its inputs and the earlier writers of its outputs
+    std::vector<std::vector<uint32_t>> dependencies(passes.size());
+    for (uint32_t p = 0; p < passes.size(); p++) {
+      for (auto [i, resource] : std::views::enumerate(passInputs[p])) {
+        MAPLE_ASSERT(!writers[resource].empty(), "Input '{}' of pass '{}' isn't written by any enabled pass", passes[p].inputs[i].name, passes[p].name);
+        dependencies[p].push_back(writers[resource].back());
       }
+      for (auto resource : passOutputs[p]) {
+        if (auto previous = previousWriter(resource, p); previous != NONE) dependencies[p].push_back(previous);
+      }
+    }
 
-      inStack.erase(pass);
-      visited.insert(pass);
+    // 2. Order the passes the swapchain depends on, depth first from its last writer
+    std::vector<uint32_t> order;
+    enum VisitState : uint8_t { Unvisited, OnStack, Done };
+    std::vector<VisitState> visitStates(passes.size(), Unvisited);
+    std::vector<std::pair<uint32_t, uint32_t>> stack;  // pass, index of its next dependency to visit
+
+    auto swapChainIt = resourceIndices.find(SWAPCHAIN_TARGET_NAME);
+    uint32_t swapChain = swapChainIt == resourceIndices.end() ? NONE : swapChainIt->second;
+    if (swapChain != NONE) {
+      stack.push_back({writers[swapChain].back(), 0});
+      visitStates[stack.back().first] = OnStack;
+    }
+    while (!stack.empty()) {
+      auto [pass, next] = stack.back();
+      if (next == dependencies[pass].size()) {
+        visitStates[pass] = Done;
+        order.push_back(pass);
+        stack.pop_back();
+        continue;
+      }
 
-      // ---- Build the executable pass ----
-      ExecutablePass exec;
-      exec.name = pass->name;
-      exec.pipelineType = pass->pipelineType;
+      stack.back().second++;
+      uint32_t dep = dependencies[pass][next];
+      if (visitStates[dep] == OnStack) MAPLE_FATAL("Render graph cycle detected involving pass: {}", passes[dep].name);
+      if (visitStates[dep] == Unvisited) {
+        visitStates[dep] = OnStack;
+        stack.push_back({dep, 0});
+      }
+    }
 
-      // For each input, ensure it is in ShaderReadOnlyOptimal before this pass
-      for (const auto& inputName : pass->inputs) {
-        ResourceState required = GetReadState();
-        InsertTransitionIfNeeded(inputName, required, resourceStates, exec.preTransitions);
+    std::vector<QueueType> queues(passes.size(), QueueType::Graphics);
+    for (auto pass : order) {
+      if (options.asyncCompute && passes[pass].pipelineType == Compute) queues[pass] = QueueType::AsyncCompute;
+    }
+    auto schedule = ScheduleForOverlap(order, dependencies, queues);
+
+    // 3. Build the executable passes in schedule order, tracking every resource's state and queue
+    std::vector<ExecutablePass> execOrder;
+    execOrder.reserve(schedule.size() + 1);
+
+    auto numResources = writers.size();
+    std::vector<ResourceState> resourceStates(numResources);
+    std::vector<uint32_t> lastUsers(numResources, NONE);      // index of the last pass using the resource
+    std::vector<uint32_t> lastConsumers(numResources, NONE);  // index of the last pass reading or loading it
+    std::vector<ResourceId> resourceIds(numResources, NONE);  // local index -> id in the compile result
+
+    // attachments in the order their passes execute
+    std::vector<CompiledAttachment> attachments;
+    if (swapChain != NONE) resourceIds[swapChain] = SWAPCHAIN_RESOURCE;
+
+    for (auto pass : schedule) {
+      const auto& desc = passes[pass];
+      ExecutablePass exec;
+      exec.name = desc.name;
+      exec.pipelineType = desc.pipelineType;
+      exec.queue = queues[pass];
+
+      auto passIdx = static_cast<uint32_t>(execOrder.size());
+      for (auto resource : passInputs[pass]) {
+        lastConsumers[resource] = passIdx;
+
+        if (resourceIds[resource] == SWAPCHAIN_RESOURCE) continue;
+        auto& attachment = attachments[resourceIds[resource]];
+        attachment.lastPass = passIdx;
+        attachment.transient = false;
       }
 
-      // For each output, ensure it is in the appropriate attachment layout before the pass writes it
-      for (const auto& out : pass->outputs) {
-        ResourceState required = GetWriteState(out.info);
-        InsertTransitionIfNeeded(out.name, required, resourceStates, exec.preTransitions);
+      for (auto [i, out] : std::views::enumerate(desc.outputs)) {
+        auto resource = passOutputs[pass][i];
+        bool hasPreviousWriter = previousWriter(resource, pass) != NONE;
+
+        if (!hasPreviousWriter && resource != swapChain) {
+          resourceIds[resource] = static_cast<ResourceId>(attachments.size());
+          attachments.push_back({.name = out.name, .info = out.info, .firstPass = passIdx, .lastPass = passIdx, .transient = true});
+        }
+
+        CompiledOutput resolved{.resource = resourceIds[resource], .info = out.info};
+        resolved.info.loadOp = ResolveLoadOp(out.info.loadOp, hasPreviousWriter);
+        bool loads = resolved.info.loadOp == LoadOp::Load;
+        if (loads) lastConsumers[resource] = passIdx;
+        exec.outputs.push_back(resolved);
+
+        if (resource == swapChain) continue;
+        auto& attachment = attachments[resourceIds[resource]];
+        attachment.lastPass = passIdx;
+        if (loads) attachment.transient = false;
+        if (desc.pipelineType == Compute) attachment.storage = true;
       }
 
-      exec.outputs = pass->outputs;
+      // moving a resource to another queue also releases it from the last pass that used it there
+      auto transition = [&](uint32_t resource, ResourceState required) {
+        required.queue = exec.queue;
+        uint32_t lastUser = lastUsers[resource];
+        if (lastUser != NONE && execOrder[lastUser].queue != exec.queue) exec.waitsForOtherQueue = true;
+
+        auto* t = InsertTransitionIfNeeded(resourceIds[resource], required, resourceStates[resource], exec.preTransitions);
+        if (t && t->oldState.queue != t->newState.queue) {
+          execOrder[lastUser].postTransitions.push_back(*t);
+        } else if (t && options.splitBarriers && t->oldState.layout != ImageLayout::Undefined && lastUser != NONE &&
+                   lastUser + 1 < passIdx) {
+          t->signalPass = lastUser;
+        }
+        lastUsers[resource] = passIdx;
+      };
 
-      // Special handling: if a resource appears as both input and output (read‑write, e.g., depth),
-      // we use the write state (attachment state) and skip the read transition.
-      // Since we process inputs first and then outputs, the write state may override.
-      // To keep it simple, we can just process outputs after inputs, allowing outputs to override.
+      // For each input, ensure it is in ShaderReadOnlyOptimal before this pass
+      for (auto [i, resource] : std::views::enumerate(passInputs[pass])) {
+        transition(resource, GetReadState(desc.pipelineType, desc.inputs[i].stages));
+      }
 
-      // Actually, for read‑write resources (like depth with depth test), the required state
-      // should be DepthStencilAttachmentOptimal with both read and write access.
-      // Our current GetWriteState gives write access only; we may want to include read access later.
-      // But it's fine as a first pass.
+      // For each output, ensure it is in the appropriate attachment layout before the pass writes it.
+      // A resource that is both input and output gets the write state, outputs are processed last
+      for (auto [i, out] : std::views::enumerate(exec.outputs)) {
+        transition(passOutputs[pass][i], GetWriteState(out.info, desc.pipelineType));
+      }
 
       execOrder.push_back(std::move(exec));
-    };
+    }
+
+    // outputs nothing consumes afterwards don't need to be written back to memory
+    for (auto [passIdx, pass] : std::views::enumerate(schedule)) {
+      for (auto [i, out] : std::views::enumerate(execOrder[passIdx].outputs)) {
+        if (out.info.storeOp != StoreOp::Auto) continue;
 
-    // Start from the final target
-    walk(SWAPCHAIN_TARGET_NAME);
+        auto consumer = lastConsumers[passOutputs[pass][i]];
+        bool consumed = consumer != NONE && consumer > static_cast<uint32_t>(passIdx);
+        out.info.storeOp = out.resource == SWAPCHAIN_RESOURCE || consumed ? StoreOp::Store : StoreOp::DontCare;
+      }
+    }
 
     std::vector swapChainTransition = {Transition{
-      .resource = SWAPCHAIN_TARGET_NAME,
-      .oldState = resourceStates[SWAPCHAIN_TARGET_NAME],
+      .resource = SWAPCHAIN_RESOURCE,
+      .oldState = swapChain == NONE ? ResourceState{} : resourceStates[swapChain],
       .newState =
         {
           .layout = ImageLayout::PresentSrc,
@@ -173,64 +500,197 @@ class RenderGraph {
       .preTransitions = std::move(swapChainTransition),
     });
 
-    std::vector<NameAndAttachment> attachments;
-    for (const auto& pass : passes) {
-      for (const auto& v : pass.outputs) {
-        if (v.name != SWAPCHAIN_TARGET_NAME) attachments.push_back(v);
-      }
+    std::vector<ResourceState> finalStates(attachments.size());
+    std::unordered_map<std::string, ResourceId> attachmentIds;
+    for (auto [resource, id] : std::views::enumerate(resourceIds)) {
+      if (id == NONE || id == SWAPCHAIN_RESOURCE) continue;
+      finalStates[id] = resourceStates[resource];
+      attachmentIds[attachments[id].name] = id;
     }
 
-    return {std::move(execOrder), std::move(attachments)};
-  }
+    uint32_t numAliasSlots = AssignAliasSlots(attachments, finalStates, execOrder);
+    uint64_t attachmentsHash = HashAttachments(attachments);
 
-  static constexpr std::string SWAPCHAIN_TARGET_NAME = "SWAPCHAIN";
+    std::unordered_map<std::string, uint32_t> passIndices;
+    for (auto [i, pass] : std::views::enumerate(execOrder)) passIndices[pass.name] = static_cast<uint32_t>(i);
 
- private:
-  std::vector<Pass> passes;
+    return {std::move(execOrder), std::move(attachments), numAliasSlots, attachmentsHash, std::move(attachmentIds), std::move(passIndices)};
+  }
 
-  // Get the state required for reading a resource at a given shader stage
-  static ResourceState GetReadState() {
+  // Get the state required for reading a resource at the given shader stages
+  static ResourceState GetReadState(PipelineType pipelineType, PipelineStage stages) {
     ResourceState s;
     s.layout = ImageLayout::ShaderReadOnlyOptimal;
     s.access = AccessMask::ShaderRead;
-    s.stage = PipelineStage::AllGraphicsAndCompute;
+    // a compute-only queue doesn't support the graphics stages
+    s.stage = pipelineType == Compute ? PipelineStage::ComputeShader : stages;
     return s;
   }
 
-  // Get the state required for writing to an attachment
-  static ResourceState GetWriteState(const AttachmentInfo& info) {
+  // Get the state required for writing to an attachment, loading the previous contents is an attachment read as well.
+  // Compute passes write their outputs as storage images, load & store ops don't apply to those beyond the read access
+  static ResourceState GetWriteState(const AttachmentInfo& info, PipelineType pipelineType) {
+    bool loads = info.loadOp == LoadOp::Load;
+    if (pipelineType == Compute) {
+      return {
+        .layout = ImageLayout::General,
+        .access = loads ? AccessMask::ShaderReadWrite : AccessMask::ShaderWrite,
+        .stage = PipelineStage::ComputeShader,
+      };
+    }
+
     ResourceState s{.layout = ImageLayout::AttachmentOptimal};
     if (FormatIsDepth(info.format)) {
-      s.access = AccessMask::DepthStencilAttachmentWrite;
+      s.access = loads ? AccessMask::DepthStencilAttachmentReadWrite : AccessMask::DepthStencilAttachmentWrite;
       s.stage = PipelineStage::EarlyAndLateFragmentTests;  // safe conservative
     } else {
       // Color or ColorHDR
-      s.access = AccessMask::ColorAttachmentWrite;
+      s.access = loads ? AccessMask::ColorAttachmentReadWrite : AccessMask::ColorAttachmentWrite;
       s.stage = PipelineStage::ColorAttachmentOutput;
     }
     return s;
   }
 
-  // If the current state of 'resource' differs from 'required', add a transition and update the tracked state
-  static void InsertTransitionIfNeeded(const std::string& resource,
-                                       const ResourceState& required,
-                                       std::unordered_map<std::string, ResourceState>& states,
-                                       std::vector<Transition>& transitions) {
-    auto& current = states[resource];
-    if (current.layout != required.layout || current.access != required.access || current.stage != required.stage) {
+  static LoadOp ResolveLoadOp(LoadOp op, bool hasPreviousWriter) {
+    if (op == LoadOp::Auto) return hasPreviousWriter ? LoadOp::Load : LoadOp::Clear;
+    if (op == LoadOp::Load && !hasPreviousWriter) return LoadOp::DontCare;
+    return op;
+  }
+
+  static bool IsWriteAccess(AccessMask access) { return access != AccessMask::None && access != AccessMask::ShaderRead; }
+
+  // List scheduling over a dependency respecting order: ready async compute passes are issued first, then graphics passes an
+  // async compute pass depends on, leaving the graphics work independent of the compute passes to overlap with them
+  static std::vector<uint32_t> ScheduleForOverlap(const std::vector<uint32_t>& order,
+                                                  const std::vector<std::vector<uint32_t>>& dependencies,
+                                                  const std::vector<QueueType>& queues) {
+    auto isAsync = [&](uint32_t pass) { return queues[pass] == QueueType::AsyncCompute; };
+    if (std::ranges::none_of(order, isAsync)) return order;
+
+    // `order` is topologically sorted, walking it backwards reaches every pass before its dependencies
+    std::vector<bool> feedsAsync(queues.size(), false);
+    for (auto pass : order | std::views::reverse) {
+      if (!isAsync(pass) && !feedsAsync[pass]) continue;
+      for (auto dep : dependencies[pass]) feedsAsync[dep] = true;
+    }
+
+    std::vector<uint32_t> scheduled;
+    std::vector<uint32_t> remaining = order;
+    std::vector<bool> done(queues.size(), false);
+    auto ready = [&](uint32_t pass) { return std::ranges::all_of(dependencies[pass], [&](uint32_t dep) { return done[dep]; }); };
+
+    while (!remaining.empty()) {
+      // the first remaining pass is always ready
+      auto pick = std::ranges::find_if(remaining, [&](uint32_t pass) { return isAsync(pass) && ready(pass); });
+      if (pick == remaining.end()) pick = std::ranges::find_if(remaining, [&](uint32_t pass) { return feedsAsync[pass] && ready(pass); });
+      if (pick == remaining.end()) pick = remaining.begin();
+
+      done[*pick] = true;
+      scheduled.push_back(*pick);
+      remaining.erase(pick);
+    }
+    return scheduled;
+  }
+
+  static const NameAndAttachment& FindOutput(const Pass& pass, const std::string& name) {
+    return *std::find_if(pass.outputs.begin(), pass.outputs.end(), [&](const auto& out) { return out.name == name; });
+  }
+
+  // Greedily packs attachments with disjoint lifetimes into shared slots, preferring a slot last used by an attachment with
+  // the same info so its memory fits exactly. Attachments are expected in the order of their first pass.
+  // An attachment taking over a slot starts with an undefined layout, but its first transition now has to wait for the
+  // previous occupant's last use, so that transition's source stage and access are widened to the previous occupant's
+  static uint32_t AssignAliasSlots(std::vector<CompiledAttachment>& attachments,
+                                   const std::vector<ResourceState>& finalStates,
+                                   std::vector<ExecutablePass>& execOrder) {
+    struct Slot {
+      uint32_t lastPass;
+      ResourceId occupant;
+    };
+    std::vector<Slot> slots;
+
+    for (auto [id, attachment] : std::views::enumerate(attachments)) {
+      std::optional<uint32_t> chosen;
+      for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].lastPass >= attachment.firstPass) continue;
+        if (!chosen.has_value()) chosen = i;
+        if (attachments[slots[i].occupant].info == attachment.info) {
+          chosen = i;
+          break;
+        }
+      }
+
+      if (!chosen.has_value()) {
+        attachment.aliasSlot = static_cast<uint32_t>(slots.size());
+        slots.push_back({attachment.lastPass, static_cast<ResourceId>(id)});
+        continue;
+      }
+
+      auto& slot = slots[*chosen];
+      auto& previousState = finalStates[slot.occupant];
+      auto& firstPass = execOrder[attachment.firstPass];
+      if (previousState.queue != firstPass.queue) {
+        // a barrier can't reach across queues, the semaphore wait orders the two instead
+        firstPass.waitsForOtherQueue = true;
+      } else {
+        for (auto& transition : firstPass.preTransitions) {
+          if (transition.resource != id) continue;
+          transition.oldState.stage = previousState.stage;
+          transition.oldState.access = previousState.access;
+        }
+      }
+
+      attachment.aliasSlot = *chosen;
+      slot = {attachment.lastPass, static_cast<ResourceId>(id)};
+    }
+
+    return static_cast<uint32_t>(slots.size());
+  }
+
+  // If the current state of 'resource' differs from 'required', or both write it, add a transition and update the tracked state.
+  // Consecutive reads share one state with the union of their stages, later readers only need a transition when they read at
+  // a stage the last write wasn't made visible to yet. Returns the added transition, if any
+  static Transition* InsertTransitionIfNeeded(ResourceId resource,
+                                              const ResourceState& required,
+                                              ResourceState& current,
+                                              std::vector<Transition>& transitions) {
+    // undefined contents don't need their ownership transferred, whichever queue touched the memory before
+    if (current.layout == ImageLayout::Undefined) current.queue = required.queue;
+
+    bool readAfterRead = current.access == AccessMask::ShaderRead && required.access == AccessMask::ShaderRead &&
+                         current.layout == required.layout && current.queue == required.queue;
+    if (readAfterRead) {
+      if (HasStages(current.stage, required.stage)) return nullptr;
+
+      // chains onto the barrier in front of the earlier reads, which already made the write available
+      transitions.push_back({
+        .resource = resource,
+        .oldState = {.layout = current.layout, .access = AccessMask::None, .stage = current.stage, .queue = current.queue},
+        .newState = required,
+      });
+      current.stage = current.stage | required.stage;
+      return &transitions.back();
+    }
+
+    bool writeAfterWrite = IsWriteAccess(current.access) && IsWriteAccess(required.access);
+    if (writeAfterWrite || current.layout != required.layout || current.access != required.access || current.stage != required.stage ||
+        current.queue != required.queue) {
       Transition t;
       t.resource = resource;
 
       t.newState.layout = required.layout;
       t.newState.access = required.access;
       t.newState.stage = required.stage;
+      t.newState.queue = required.queue;
 
       t.oldState = current;
 
       transitions.push_back(t);
 
       current = required;
+      return &transitions.back();
     }
+    return nullptr;
   }
 };
 }  // namespace maple
\ No newline at end of file
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <cstdint>
+
 #include "render_graph.h"
 #include "vkm/vkm_image.h"
 
 namespace maple {
 
-struct RenderTarget {  
+struct RenderTarget {
   RenderGraph::AttachmentInfo info;
   vkm::Image target;
+  uint64_t uploadTicket = 0;          // UploadManager ticket the image contents are valid at, 0 for attachments
+  uint32_t bindlessSlot = UINT32_MAX;  // index into the bindless texture array
+  bool storage = false;                // also in the bindless storage image array, at the same index
 };
 }  // namespace maple
\ No newline at end of file
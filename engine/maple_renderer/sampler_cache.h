@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "bindless_table.h"
+#include "sampler_info.h"
+#include "vk_enum_translation.h"
+#include "vkm/vkm_sampler.h"
+
+namespace maple {
+// Samplers deduplicated by their settings, each in a slot of the bindless sampler array. Images and samplers live in
+// separate arrays, so a shader combines any texture with any sampler without a descriptor per pair.
+// Samplers are never destroyed, a renderer only ever uses a handful of distinct settings
+class SamplerCache {
+ public:
+  SamplerCache() = default;
+  SamplerCache(const vk::raii::Device& device, float maxDeviceAnisotropy, uint32_t binding, uint32_t capacity, uint32_t numSets)
+      : mDevice(&device), mMaxDeviceAnisotropy(maxDeviceAnisotropy), mTable(binding, capacity, numSets) {}
+
+  // Bindless slot of the sampler with these settings, created the first time they are asked for
+  uint32_t Get(const SamplerInfo& info) {
+    auto vkInfo = toVulkan(info);
+
+    auto it = mSamplers.find(vkInfo);
+    if (it == mSamplers.end()) {
+      Entry entry{.sampler = vkm::Sampler(*mDevice, vkInfo)};
+      entry.slot = mTable.Allocate({}, *entry.sampler.sampler);
+      it = mSamplers.emplace(vkInfo, std::move(entry)).first;
+    }
+    return it->second.slot;
+  }
+
+  BindlessTable& Table() { return mTable; }
+  uint32_t Size() const { return static_cast<uint32_t>(mSamplers.size()); }
+
+ private:
+  struct Entry {
+    vkm::Sampler sampler;
+    uint32_t slot = BindlessTable::INVALID_SLOT;
+  };
+
+  const vk::raii::Device* mDevice = nullptr;
+  float mMaxDeviceAnisotropy = 1.0f;
+  BindlessTable mTable;
+  std::unordered_map<vkm::Sampler::Info, Entry, vkm::Sampler::InfoHash> mSamplers;
+
+  // anisotropy is clamped here, so settings that only differ beyond the device limit share a sampler
+  vkm::Sampler::Info toVulkan(const SamplerInfo& info) const {
+    float maxAnisotropy = std::clamp(info.maxAnisotropy, 1.0f, mMaxDeviceAnisotropy);
+    bool anisotropy = info.anisotropyEnable && maxAnisotropy > 1.0f;
+    return {
+      .magFilter = ToVulkan(info.magFilter),
+      .minFilter = ToVulkan(info.minFilter),
+      .mipmapMode = ToVulkan(info.mipmapMode),
+      .addressModeU = ToVulkan(info.addressModeU),
+      .addressModeV = ToVulkan(info.addressModeV),
+      .addressModeW = ToVulkan(info.addressModeW),
+      .mipLodBias = info.mipLodBias,
+      .anisotropyEnable = anisotropy ? vk::True : vk::False,
+      .maxAnisotropy = anisotropy ? maxAnisotropy : 1.0f,
+      .compareEnable = info.compareEnable ? vk::True : vk::False,
+      .compareOp = ToVulkan(info.compareOp),
+      .minLod = info.minLod,
+      .maxLod = info.maxLod,
+      .borderColor = ToVulkan(info.borderColor),
+      .unnormalizedCoordinates = info.unnormalizedCoordinates ? vk::True : vk::False,
+    };
+  }
+};
+}  // namespace maple
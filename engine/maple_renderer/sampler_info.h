@@ -1,6 +1,6 @@
 #pragma once
 
-#include "engine/renderer/sampler_enums.h"
+#include "sampler_enums.h"
 namespace maple {
 struct SamplerInfo {
   SamplerFilter magFilter = SamplerFilter::Linear;
@@ -11,12 +11,12 @@ struct SamplerInfo {
   SamplerAddressMode addressModeW = SamplerAddressMode::Repeat;
   float mipLodBias = 0.0f;
   bool anisotropyEnable = true;
-  float maxAnisotropy = 1.0f;  // filled from device limits
+  float maxAnisotropy = 16.0f;  // clamped to the device limit
   bool compareEnable = false;
   CompareOp compareOp = CompareOp::Always;
   float minLod = 0.0f;
-  float maxLod = 1.0f;
+  float maxLod = 1000.0f;  // VK_LOD_CLAMP_NONE, every mip level of the image
   SamplerBorderColor borderColor = SamplerBorderColor::IntOpaqueBlack;
   bool unnormalizedCoordinates = false;
 };
-}  // namespace maple
\ No newline at end of file
+}  // namespace maple
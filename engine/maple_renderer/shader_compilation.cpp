@@ -1,8 +1,18 @@
 #include "shader_compilation.h"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
 
+#include "builtin_shaders.h"
 #include "log_macros.h"
 #include "slang-com-ptr.h"
 #include "slang.h"
@@ -12,97 +22,364 @@ std::vector<uint8_t> compileSlangToSpirv(const std::string& code,
                                          const std::string& fileName,
                                          const std::string& vertEntryFuncName,
                                          const std::string& fragEntryFuncName) {
-  Slang::ComPtr<slang::IGlobalSession> globalSession = nullptr;
+  std::array entryFuncNames = {vertEntryFuncName, fragEntryFuncName};
+  return compileSlangToSpirv(code, fileName, entryFuncNames);
+}
+
+namespace {
+// bump when the cache file contents or the key layout change
+constexpr uint64_t SHADER_CACHE_VERSION = 2;
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+std::mutex gCacheDirectoryMutex;
+std::filesystem::path gCacheDirectory = "shader_cache";
+
+// Creating a global session loads the core module and takes far longer than compiling most shaders, so it is created once.
+// Global sessions can't be shared between threads, every thread compiling shaders gets its own
+slang::IGlobalSession* GlobalSession() {
+  thread_local Slang::ComPtr<slang::IGlobalSession> globalSession = [] {
+    Slang::ComPtr<slang::IGlobalSession> session;
+    if (SLANG_FAILED(slang::createGlobalSession(session.writeRef()))) MAPLE_FATAL("failed to create slang global session");
+    return session;
+  }();
+  return globalSession;
+}
+
+// FNV-1a, every field is length prefixed so adjacent strings can't shift into each other
+struct CacheKey {
+  uint64_t hash = 14695981039346656037ull;
 
-  if (!globalSession) {
-    if (SLANG_FAILED(slang::createGlobalSession(globalSession.writeRef()))) MAPLE_FATAL("failed to create slang global session");
+  void Add(const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;  // FNV-1a prime
+    }
   }
+  void Add(std::string_view str) {
+    uint64_t size = str.size();
+    Add(&size, sizeof(size));
+    Add(str.data(), str.size());
+  }
+};
 
-  // TODO: on release enable shader optimizations
+std::optional<uint64_t> HashFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) return std::nullopt;
+  std::string contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+  if (file.bad()) return std::nullopt;
 
-  slang::TargetDesc targetDesc = {};
-  targetDesc.format = SLANG_SPIRV;
-  targetDesc.profile = globalSession->findProfile("spirv_1_4");
-  targetDesc.flags = 0;
+  CacheKey key;
+  key.Add(contents);
+  return key.hash;
+}
 
-  std::array<slang::CompilerOptionEntry, 3> options = {
-    slang::CompilerOptionEntry{slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
-    slang::CompilerOptionEntry{slang::CompilerOptionName::VulkanUseEntryPointName, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
-    slang::CompilerOptionEntry{slang::CompilerOptionName::MatrixLayoutColumn, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
+struct CompiledShader {
+  std::vector<uint8_t> spirv;
+  std::vector<std::string> dependencies;  // files pulled in through imports and includes, only known after compiling
+};
+
+// An entry starts with the dependencies of the shader, each with the hash of its contents at compile time, followed by the
+// SPIR-V. An entry whose dependencies changed since is stale
+std::optional<std::vector<uint8_t>> ReadCachedSpirv(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) return std::nullopt;
+
+  size_t fileSize = file.tellg();
+  std::vector<uint8_t> entry(fileSize);
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(entry.data()), fileSize);
+  if (!file) return std::nullopt;
+
+  // a truncated or otherwise broken entry is treated as a miss and overwritten
+  size_t offset = 0;
+  auto read = [&](void* dst, size_t size) {
+    if (entry.size() - offset < size) return false;
+    std::memcpy(dst, entry.data() + offset, size);
+    offset += size;
+    return true;
+  };
+
+  uint64_t numDependencies = 0;
+  if (!read(&numDependencies, sizeof(numDependencies))) return std::nullopt;
+  for (uint64_t i = 0; i < numDependencies; i++) {
+    uint64_t pathSize = 0;
+    if (!read(&pathSize, sizeof(pathSize)) || entry.size() - offset < pathSize) return std::nullopt;
+    std::string dependency(reinterpret_cast<const char*>(entry.data() + offset), pathSize);
+    offset += pathSize;
+
+    uint64_t contentHash = 0;
+    if (!read(&contentHash, sizeof(contentHash)) || HashFile(dependency) != contentHash) return std::nullopt;
+  }
+
+  std::vector<uint8_t> spirv(entry.begin() + offset, entry.end());
+  uint32_t magic = 0;
+  if (spirv.size() >= sizeof(magic)) std::memcpy(&magic, spirv.data(), sizeof(magic));
+  if (spirv.size() % sizeof(uint32_t) != 0 || magic != SPIRV_MAGIC) return std::nullopt;
+  return spirv;
+}
+
+// written to a temporary file first, so a concurrent reader or a crash never leaves a partial entry behind
+void WriteCachedSpirv(const std::filesystem::path& path, const CompiledShader& shader) {
+  std::vector<uint8_t> entry;
+  auto write = [&](const void* src, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(src);
+    entry.insert(entry.end(), bytes, bytes + size);
   };
+
+  uint64_t numDependencies = shader.dependencies.size();
+  write(&numDependencies, sizeof(numDependencies));
+  for (auto& dependency : shader.dependencies) {
+    // a dependency that can't be read anymore couldn't have been compiled against, don't cache what can't be validated
+    auto contentHash = HashFile(dependency);
+    if (!contentHash) return;
+
+    uint64_t pathSize = dependency.size();
+    write(&pathSize, sizeof(pathSize));
+    write(dependency.data(), dependency.size());
+    write(&*contentHash, sizeof(*contentHash));
+  }
+  write(shader.spirv.data(), shader.spirv.size());
+
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  if (ec) {
+    MAPLE_WARN("failed to create shader cache directory {}: {}", path.parent_path().string(), ec.message());
+    return;
+  }
+
+  auto tmpPath = path;
+  tmpPath += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(entry.data()), entry.size());
+    if (!file) {
+      MAPLE_WARN("failed to write shader cache entry {}", tmpPath.string());
+      return;
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    MAPLE_WARN("failed to write shader cache entry {}: {}", path.string(), ec.message());
+    std::filesystem::remove(tmpPath, ec);
+  }
+}
+
+CompiledShader CompileUncached(slang::IGlobalSession* globalSession,
+                               const std::string& code,
+                               const std::string& fileName,
+                               std::span<const std::string> entryFuncNames,
+                               std::span<const std::string> keywords,
+                               const slang::TargetDesc& targetDesc,
+                               std::span<slang::CompilerOptionEntry> options) {
+  // keywords are macros rather than link-time constants: they can remove declarations, resources and struct fields a
+  // feature needs, and a material only lists what it enables, where an extern constant needs a value in every permutation
+  std::vector<slang::PreprocessorMacroDesc> macros;
+  macros.reserve(keywords.size());
+  for (auto& keyword : keywords) macros.push_back({keyword.c_str(), "1"});
+
   slang::SessionDesc sessionDesc = {};
   sessionDesc.targets = &targetDesc;
   sessionDesc.targetCount = 1;
-  sessionDesc.preprocessorMacros = nullptr;
-  sessionDesc.preprocessorMacroCount = 0;
+  sessionDesc.preprocessorMacros = macros.data();
+  sessionDesc.preprocessorMacroCount = macros.size();
   sessionDesc.compilerOptionEntries = options.data();
   sessionDesc.compilerOptionEntryCount = options.size();
 
   Slang::ComPtr<slang::ISession> session;
   globalSession->createSession(sessionDesc, session.writeRef());
 
-  auto diagnoseIfNeeded = [](slang::IBlob* diagnosticsBlob) {
-    if (diagnosticsBlob != nullptr) MAPLE_WARN((const char*)diagnosticsBlob->getBufferPointer());
+  // a failure carries its diagnostics to whoever collects the result, warnings of a successful step are only logged
+  auto check = [&](bool succeeded, slang::IBlob* diagnosticsBlob, std::string_view step) {
+    std::string_view diagnostics;
+    if (diagnosticsBlob != nullptr) diagnostics = {static_cast<const char*>(diagnosticsBlob->getBufferPointer()), diagnosticsBlob->getBufferSize()};
+    if (!succeeded) throw ShaderCompileError(fmt::format("{}: failed to {}\n{}", fileName, step, diagnostics));
+    if (!diagnostics.empty()) MAPLE_WARN("{}", diagnostics);
   };
 
-  Slang::ComPtr<slang::IModule> slangModule;
+  // loaded first so `import maple;` resolves to the already loaded module
+  Slang::ComPtr<slang::IModule> mapleModule;
   {
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-    slangModule = session->loadModuleFromSourceString(fileName.c_str(), nullptr, code.c_str(), diagnosticsBlob.writeRef());
-    diagnoseIfNeeded(diagnosticsBlob);
-    if (!slangModule) MAPLE_FATAL("failed to load slang module");
+    mapleModule = session->loadModuleFromSourceString(
+      builtin_shaders::MAPLE_MODULE_NAME.data(), "maple.slang", builtin_shaders::MAPLE_MODULE.data(), diagnosticsBlob.writeRef());
+    check(mapleModule != nullptr, diagnosticsBlob, "load builtin maple slang module");
   }
 
-  Slang::ComPtr<slang::IEntryPoint> vertEntryPoint;
+  Slang::ComPtr<slang::IModule> slangModule;
   {
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-    slangModule->findEntryPointByName(vertEntryFuncName.c_str(), vertEntryPoint.writeRef());
-    diagnoseIfNeeded(diagnosticsBlob);
-    if (!vertEntryPoint) MAPLE_FATAL("failed to find vertex entry point '{}'", vertEntryFuncName);
+    slangModule = session->loadModuleFromSourceString(fileName.c_str(), nullptr, code.c_str(), diagnosticsBlob.writeRef());
+    check(slangModule != nullptr, diagnosticsBlob, "load slang module");
   }
 
-  Slang::ComPtr<slang::IEntryPoint> fragEntryPoint;
-  {
-    Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-    slangModule->findEntryPointByName(fragEntryFuncName.c_str(), fragEntryPoint.writeRef());
-    diagnoseIfNeeded(diagnosticsBlob);
-    if (!fragEntryPoint) MAPLE_FATAL("failed to find fragment entry point '{}'", fragEntryFuncName);
+  std::vector<Slang::ComPtr<slang::IEntryPoint>> entryPoints(entryFuncNames.size());
+  std::vector<slang::IComponentType*> componentTypes = {slangModule};
+  for (size_t i = 0; i < entryFuncNames.size(); i++) {
+    slangModule->findEntryPointByName(entryFuncNames[i].c_str(), entryPoints[i].writeRef());
+    check(entryPoints[i] != nullptr, nullptr, fmt::format("find entry point '{}'", entryFuncNames[i]));
+    componentTypes.push_back(entryPoints[i]);
   }
 
-  std::array<slang::IComponentType*, 3> componentTypes = {
-    slangModule,
-    vertEntryPoint,
-    fragEntryPoint,
-  };
-
   Slang::ComPtr<slang::IComponentType> composedProgram;
   {
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
     SlangResult result =
       session->createCompositeComponentType(componentTypes.data(), componentTypes.size(), composedProgram.writeRef(), diagnosticsBlob.writeRef());
-    diagnoseIfNeeded(diagnosticsBlob);
-    if (SLANG_FAILED(result)) MAPLE_FATAL("");
+    check(SLANG_SUCCEEDED(result), diagnosticsBlob, "compose program");
   }
 
   Slang::ComPtr<slang::IComponentType> linkedProgram;
   {
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
     SlangResult result = composedProgram->link(linkedProgram.writeRef(), diagnosticsBlob.writeRef());
-    diagnoseIfNeeded(diagnosticsBlob);
-    if (SLANG_FAILED(result)) MAPLE_FATAL("");
+    check(SLANG_SUCCEEDED(result), diagnosticsBlob, "link program");
   }
 
   Slang::ComPtr<slang::IBlob> spirvCode;
   {
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
     SlangResult result = linkedProgram->getTargetCode(0, spirvCode.writeRef(), diagnosticsBlob.writeRef());
-    diagnoseIfNeeded(diagnosticsBlob);
-    if (SLANG_FAILED(result)) MAPLE_FATAL("");
+    check(SLANG_SUCCEEDED(result), diagnosticsBlob, "generate spirv");
   }
 
-  std::vector<uint8_t> result(spirvCode->getBufferSize());
-  std::memcpy(result.data(), spirvCode->getBufferPointer(), spirvCode->getBufferSize());
+  CompiledShader result;
+  result.spirv.resize(spirvCode->getBufferSize());
+  std::memcpy(result.spirv.data(), spirvCode->getBufferPointer(), spirvCode->getBufferSize());
+
+  // every module reports the files it read, including the modules it imported. The two loaded from strings report
+  // placeholder paths, their sources are part of the cache key
+  for (SlangInt i = 0; i < session->getLoadedModuleCount(); i++) {
+    auto* module = session->getLoadedModule(i);
+    for (SlangInt32 j = 0; j < module->getDependencyFileCount(); j++) {
+      std::string_view dependency = module->getDependencyFilePath(j);
+      if (dependency != mapleModule->getFilePath() && dependency != slangModule->getFilePath()) result.dependencies.emplace_back(dependency);
+    }
+  }
+  std::ranges::sort(result.dependencies);
+  auto duplicates = std::ranges::unique(result.dependencies);
+  result.dependencies.erase(duplicates.begin(), duplicates.end());
 
   return result;
 }
-}  // namespace maple
\ No newline at end of file
+}  // namespace
+
+void SetShaderCacheDirectory(const std::filesystem::path& directory) {
+  std::lock_guard lock(gCacheDirectoryMutex);
+  gCacheDirectory = directory;
+}
+
+std::filesystem::path ShaderCacheDirectory() {
+  std::lock_guard lock(gCacheDirectoryMutex);
+  return gCacheDirectory;
+}
+
+uint64_t ShaderPermutationHash(const std::string& code,
+                               const std::string& fileName,
+                               std::span<const std::string> entryFuncNames,
+                               std::span<const std::string> keywords) {
+  CacheKey key;
+  key.Add(fileName);
+  key.Add(code);
+  for (auto& entryFuncName : entryFuncNames) key.Add(entryFuncName);
+  key.Add("keywords");  // entry points and keywords are both plain strings, keep them apart
+  for (auto& keyword : keywords) key.Add(keyword);
+  return key.hash;
+}
+
+std::vector<uint8_t> compileSlangToSpirv(const std::string& code,
+                                         const std::string& fileName,
+                                         std::span<const std::string> entryFuncNames,
+                                         std::span<const std::string> keywords) {
+  auto* globalSession = GlobalSession();
+
+  // TODO: on release enable shader optimizations
+
+  slang::TargetDesc targetDesc = {};
+  targetDesc.format = SLANG_SPIRV;
+  targetDesc.profile = globalSession->findProfile("spirv_1_4");
+  targetDesc.flags = 0;
+
+  std::array<slang::CompilerOptionEntry, 3> options = {
+    slang::CompilerOptionEntry{slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
+    slang::CompilerOptionEntry{slang::CompilerOptionName::VulkanUseEntryPointName, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
+    slang::CompilerOptionEntry{slang::CompilerOptionName::MatrixLayoutColumn, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
+  };
+
+  auto cacheDirectory = ShaderCacheDirectory();
+  if (cacheDirectory.empty()) return CompileUncached(globalSession, code, fileName, entryFuncNames, keywords, targetDesc, options).spirv;
+
+  // everything that changes the output: the compiler, the target, the options, the builtin module and the permutation.
+  // Files the shader imports or includes are validated against the entry itself
+  CacheKey key;
+  key.Add(&SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+  key.Add(globalSession->getBuildTagString());
+  key.Add(&targetDesc.format, sizeof(targetDesc.format));
+  key.Add(&targetDesc.profile, sizeof(targetDesc.profile));
+  key.Add(&targetDesc.flags, sizeof(targetDesc.flags));
+  for (auto& option : options) {
+    key.Add(&option.name, sizeof(option.name));
+    key.Add(&option.value.kind, sizeof(option.value.kind));
+    key.Add(&option.value.intValue0, sizeof(option.value.intValue0));
+    key.Add(&option.value.intValue1, sizeof(option.value.intValue1));
+  }
+  key.Add(builtin_shaders::MAPLE_MODULE);
+  uint64_t permutation = ShaderPermutationHash(code, fileName, entryFuncNames, keywords);
+  key.Add(&permutation, sizeof(permutation));
+
+  auto cachePath = cacheDirectory / fmt::format("{:016x}.spv", key.hash);
+  if (auto cached = ReadCachedSpirv(cachePath)) return std::move(*cached);
+
+  auto shader = CompileUncached(globalSession, code, fileName, entryFuncNames, keywords, targetDesc, options);
+  WriteCachedSpirv(cachePath, shader);
+  return std::move(shader.spirv);
+}
+
+ShaderCompileQueue::ShaderCompileQueue(uint32_t numThreads) {
+  for (uint32_t i = 0; i < numThreads; i++) mThreads.emplace_back([this] { workerLoop(); });
+}
+
+ShaderCompileQueue::~ShaderCompileQueue() {
+  {
+    std::lock_guard lock(mMutex);
+    mStop = true;
+    mJobs.clear();
+  }
+  mWakeCv.notify_all();
+  for (auto& thread : mThreads) thread.join();
+}
+
+std::future<std::vector<uint8_t>> ShaderCompileQueue::Submit(std::string code,
+                                                             std::string fileName,
+                                                             std::vector<std::string> entryFuncNames,
+                                                             std::vector<std::string> keywords) {
+  std::packaged_task<std::vector<uint8_t>()> job([code = std::move(code),
+                                                  fileName = std::move(fileName),
+                                                  entryFuncNames = std::move(entryFuncNames),
+                                                  keywords = std::move(keywords)] {
+    return compileSlangToSpirv(code, fileName, entryFuncNames, keywords);
+  });
+  auto future = job.get_future();
+  {
+    std::lock_guard lock(mMutex);
+    mJobs.push_back(std::move(job));
+  }
+  mWakeCv.notify_one();
+  return future;
+}
+
+void ShaderCompileQueue::workerLoop() {
+  while (true) {
+    std::packaged_task<std::vector<uint8_t>()> job;
+    {
+      std::unique_lock lock(mMutex);
+      mWakeCv.wait(lock, [&] { return mStop || !mJobs.empty(); });
+      if (mStop) return;
+      job = std::move(mJobs.front());
+      mJobs.pop_front();
+    }
+    job();
+  }
+}
+}  // namespace maple
@@ -1,12 +1,70 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace maple {
+// Compiled SPIR-V is cached in `directory`, keyed by the sources, entry points, compiler options and the slang version.
+// An entry is recompiled once a file the shader imported or included changes.
+// Defaults to "shader_cache" in the working directory, an empty path disables the cache
+void SetShaderCacheDirectory(const std::filesystem::path& directory);
+std::filesystem::path ShaderCacheDirectory();
+
+// Thrown by compileSlangToSpirv when a shader fails to compile, the message holds the slang diagnostics
+struct ShaderCompileError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// The builtin `maple` module is available to every shader through `import maple;`.
+// Every keyword is defined to 1 for the preprocessor, shaders select the features of a permutation with `#if KEYWORD`
+std::vector<uint8_t> compileSlangToSpirv(const std::string& code,
+                                         const std::string& fileName,
+                                         std::span<const std::string> entryFuncNames,
+                                         std::span<const std::string> keywords = {});
 std::vector<uint8_t> compileSlangToSpirv(const std::string& code,
                                          const std::string& fileName,
                                          const std::string& vertEntryFuncName,
                                          const std::string& fragEntryFuncName);
+
+// Identifies what compileSlangToSpirv produces for the same arguments within a run, keywords are expected sorted
+uint64_t ShaderPermutationHash(const std::string& code,
+                               const std::string& fileName,
+                               std::span<const std::string> entryFuncNames,
+                               std::span<const std::string> keywords);
+
+// Compiles shaders on background threads in the order they were submitted. Slang sessions aren't thread safe, every thread
+// compiling shaders has its own global session. A failed compilation is stored in its future as a ShaderCompileError, the
+// thread collecting the result reports it. Queued jobs are dropped on destruction, their futures report a broken promise
+class ShaderCompileQueue {
+ public:
+  explicit ShaderCompileQueue(uint32_t numThreads);
+  ~ShaderCompileQueue();
+
+  ShaderCompileQueue(const ShaderCompileQueue&) = delete;
+  ShaderCompileQueue& operator=(const ShaderCompileQueue&) = delete;
+
+  std::future<std::vector<uint8_t>> Submit(std::string code,
+                                           std::string fileName,
+                                           std::vector<std::string> entryFuncNames,
+                                           std::vector<std::string> keywords = {});
+
+ private:
+  std::vector<std::thread> mThreads;
+
+  std::mutex mMutex;
+  std::condition_variable mWakeCv;
+  std::deque<std::packaged_task<std::vector<uint8_t>()>> mJobs;
+  bool mStop = false;
+
+  void workerLoop();
+};
 }  // namespace maple
\ No newline at end of file
@@ -0,0 +1,402 @@
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+#include "log_macros.h"
+
+namespace maple {
+namespace {
+constexpr uint32_t BLOCK_EXTENT = 4;
+constexpr uint32_t BLOCK_TEXELS = BLOCK_EXTENT * BLOCK_EXTENT;
+constexpr uint32_t REFINE_ITERATIONS = 2;
+
+// Texels of a 4x4 block in 0..255, row major
+using Block = std::array<glm::vec4, BLOCK_TEXELS>;
+
+float SrgbToLinear(uint8_t value) {
+  static const auto table = [] {
+    std::array<float, 256> t;
+    for (uint32_t i = 0; i < t.size(); i++) {
+      float c = static_cast<float>(i) / 255.0f;
+      t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return t;
+  }();
+  return table[value];
+}
+
+uint8_t LinearToSrgb(float value) {
+  value = std::clamp(value, 0.0f, 1.0f);
+  float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(std::round(c * 255.0f));
+}
+
+uint8_t ToUnorm8(float value) { return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f)); }
+
+// Texels outside of the level repeat its last row and column, so partial blocks at the edges don't pull their endpoints away
+Block LoadBlock(const uint8_t* level, glm::uvec2 size, uint32_t blockX, uint32_t blockY) {
+  Block block;
+  for (uint32_t y = 0; y < BLOCK_EXTENT; y++) {
+    for (uint32_t x = 0; x < BLOCK_EXTENT; x++) {
+      uint32_t sx = std::min(blockX * BLOCK_EXTENT + x, size.x - 1);
+      uint32_t sy = std::min(blockY * BLOCK_EXTENT + y, size.y - 1);
+      const uint8_t* texel = level + (static_cast<size_t>(sy) * size.x + sx) * 4;
+      block[y * BLOCK_EXTENT + x] = glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+    }
+  }
+  return block;
+}
+
+float DistanceSq(glm::vec4 a, glm::vec4 b) {
+  glm::vec4 d = a - b;
+  return glm::dot(d, d);
+}
+
+// Line through the block's texels that fits them best, as the endpoints of the texels' projections onto it
+std::pair<glm::vec4, glm::vec4> PrincipalEndpoints(const Block& block) {
+  glm::vec4 mean(0.0f);
+  for (const auto& texel : block) mean += texel;
+  mean /= static_cast<float>(BLOCK_TEXELS);
+
+  glm::mat4 covariance(0.0f);
+  for (const auto& texel : block) covariance += glm::outerProduct(texel - mean, texel - mean);
+
+  // power iteration, starting from the column with the most variance so it can't start orthogonal to the axis
+  glm::vec4 axis = covariance[0];
+  for (int i = 1; i < 4; i++) {
+    if (glm::dot(covariance[i], covariance[i]) > glm::dot(axis, axis)) axis = covariance[i];
+  }
+  if (glm::dot(axis, axis) < 1e-6f) return {mean, mean};
+  for (int i = 0; i < 8; i++) {
+    axis = glm::normalize(covariance * axis);
+  }
+
+  float minT = 0.0f, maxT = 0.0f;
+  for (const auto& texel : block) {
+    float t = glm::dot(texel - mean, axis);
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+  return {glm::clamp(mean + axis * minT, 0.0f, 255.0f), glm::clamp(mean + axis * maxT, 0.0f, 255.0f)};
+}
+
+// Endpoints minimizing the squared error of the texels for fixed interpolation weights of the second endpoint, nullopt
+// when all weights are the same
+std::optional<std::pair<glm::vec4, glm::vec4>> LeastSquaresEndpoints(const Block& block, const std::array<float, BLOCK_TEXELS>& weights) {
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  glm::vec4 ax(0.0f), bx(0.0f);
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+    float a = 1.0f - weights[i], b = weights[i];
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    ax += a * block[i];
+    bx += b * block[i];
+  }
+  float det = aa * bb - ab * ab;
+  if (std::abs(det) < 1e-6f) return std::nullopt;
+  return std::pair{glm::clamp((bb * ax - ab * bx) / det, 0.0f, 255.0f), glm::clamp((aa * bx - ab * ax) / det, 0.0f, 255.0f)};
+}
+
+class BitWriter {
+ public:
+  void Write(uint32_t value, uint32_t bits) {
+    for (uint32_t i = 0; i < bits; i++, mPos++) {
+      if ((value >> i) & 1) mBytes[mPos / 8] |= static_cast<uint8_t>(1u << (mPos % 8));
+    }
+  }
+  const std::array<uint8_t, 16>& Bytes() const { return mBytes; }
+
+ private:
+  std::array<uint8_t, 16> mBytes{};
+  uint32_t mPos = 0;
+};
+
+// BC1 color
+
+struct Bc1Fit {
+  uint16_t color0 = 0, color1 = 0;
+  std::array<uint8_t, BLOCK_TEXELS> indices{};
+  float error = 0.0f;
+};
+
+uint16_t QuantizeRgb565(glm::vec4 color) {
+  auto r = static_cast<uint16_t>(std::round(color.r * 31.0f / 255.0f));
+  auto g = static_cast<uint16_t>(std::round(color.g * 63.0f / 255.0f));
+  auto b = static_cast<uint16_t>(std::round(color.b * 31.0f / 255.0f));
+  return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+glm::vec4 ExpandRgb565(uint16_t color) {
+  uint32_t r = color >> 11, g = (color >> 5) & 0x3F, b = color & 0x1F;
+  return glm::vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0.0f);
+}
+
+// weight of color1 per index in four color mode
+constexpr std::array<float, 4> BC1_WEIGHTS = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+// Alpha of `block` must be zero, it isn't part of the error
+Bc1Fit FitBc1(const Block& block, glm::vec4 endpoint0, glm::vec4 endpoint1) {
+  Bc1Fit fit{.color0 = QuantizeRgb565(endpoint0), .color1 = QuantizeRgb565(endpoint1)};
+  // color0 > color1 selects the four color mode, equal colors are three color mode but only ever use index 0
+  if (fit.color0 < fit.color1) std::swap(fit.color0, fit.color1);
+
+  glm::vec4 c0 = ExpandRgb565(fit.color0), c1 = ExpandRgb565(fit.color1);
+  std::array<glm::vec4, 4> palette;
+  for (size_t i = 0; i < palette.size(); i++) palette[i] = glm::mix(c0, c1, BC1_WEIGHTS[i]);
+
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+    float best = DistanceSq(block[i], palette[0]);
+    for (uint8_t p = 1; p < palette.size(); p++) {
+      float distance = DistanceSq(block[i], palette[p]);
+      if (distance < best) {
+        best = distance;
+        fit.indices[i] = p;
+      }
+    }
+    fit.error += best;
+  }
+  return fit;
+}
+
+void EncodeBc1(const Block& texels, uint8_t* dst) {
+  Block block = texels;
+  for (auto& texel : block) texel.a = 0.0f;
+
+  auto [endpoint0, endpoint1] = PrincipalEndpoints(block);
+  Bc1Fit best = FitBc1(block, endpoint0, endpoint1);
+  for (uint32_t iteration = 0; iteration < REFINE_ITERATIONS && best.error > 0.0f; iteration++) {
+    std::array<float, BLOCK_TEXELS> weights;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++) weights[i] = BC1_WEIGHTS[best.indices[i]];
+    auto refined = LeastSquaresEndpoints(block, weights);
+    if (!refined) break;
+    Bc1Fit fit = FitBc1(block, refined->first, refined->second);
+    if (fit.error >= best.error) break;
+    best = fit;
+  }
+
+  uint32_t indices = 0;
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) indices |= static_cast<uint32_t>(best.indices[i]) << (i * 2);
+  dst[0] = static_cast<uint8_t>(best.color0);
+  dst[1] = static_cast<uint8_t>(best.color0 >> 8);
+  dst[2] = static_cast<uint8_t>(best.color1);
+  dst[3] = static_cast<uint8_t>(best.color1 >> 8);
+  for (int i = 0; i < 4; i++) dst[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+// BC4 style single channel block, used for BC3 alpha and both BC5 channels. Always the eight value mode between the
+// channel's max and min, which also represents blocks of only 0 and 255 exactly
+void EncodeBc4(const Block& block, int channel, uint8_t* dst) {
+  float minValue = 255.0f, maxValue = 0.0f;
+  for (const auto& texel : block) {
+    minValue = std::min(minValue, texel[channel]);
+    maxValue = std::max(maxValue, texel[channel]);
+  }
+  auto value0 = static_cast<uint8_t>(maxValue), value1 = static_cast<uint8_t>(minValue);
+
+  std::array<float, 8> palette = {static_cast<float>(value0), static_cast<float>(value1)};
+  for (uint32_t i = 2; i < palette.size(); i++) palette[i] = static_cast<float>((8 - i) * value0 + (i - 1) * value1) / 7.0f;
+
+  uint64_t bits = static_cast<uint64_t>(value0) | static_cast<uint64_t>(value1) << 8;
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+    uint64_t index = 0;
+    float best = std::abs(block[i][channel] - palette[0]);
+    for (uint32_t p = 1; p < palette.size() && value0 != value1; p++) {
+      float distance = std::abs(block[i][channel] - palette[p]);
+      if (distance < best) {
+        best = distance;
+        index = p;
+      }
+    }
+    bits |= index << (16 + i * 3);
+  }
+  for (int i = 0; i < 8; i++) dst[i] = static_cast<uint8_t>(bits >> (i * 8));
+}
+
+// BC7 mode 6
+
+constexpr std::array<uint32_t, 16> BC7_WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Fit {
+  std::array<glm::uvec4, 2> endpoints{};  // 7 bits per channel
+  std::array<uint32_t, 2> pBits{};
+  std::array<uint8_t, BLOCK_TEXELS> indices{};
+  float error = 0.0f;
+};
+
+// Each endpoint shares its least significant bit across the channels, the one that lands closer wins
+std::pair<glm::uvec4, uint32_t> QuantizeBc7Endpoint(glm::vec4 endpoint) {
+  std::pair<glm::uvec4, uint32_t> best;
+  float bestError = INFINITY;
+  for (uint32_t pBit = 0; pBit < 2; pBit++) {
+    glm::uvec4 quantized = glm::uvec4(glm::clamp(glm::round((endpoint - static_cast<float>(pBit)) / 2.0f), 0.0f, 127.0f));
+    float error = DistanceSq(endpoint, glm::vec4(quantized * 2u + pBit));
+    if (error < bestError) {
+      bestError = error;
+      best = {quantized, pBit};
+    }
+  }
+  return best;
+}
+
+Bc7Fit FitBc7(const Block& block, glm::vec4 endpoint0, glm::vec4 endpoint1) {
+  Bc7Fit fit;
+  std::tie(fit.endpoints[0], fit.pBits[0]) = QuantizeBc7Endpoint(endpoint0);
+  std::tie(fit.endpoints[1], fit.pBits[1]) = QuantizeBc7Endpoint(endpoint1);
+
+  glm::uvec4 e0 = fit.endpoints[0] * 2u + fit.pBits[0], e1 = fit.endpoints[1] * 2u + fit.pBits[1];
+  std::array<glm::vec4, 16> palette;
+  for (size_t i = 0; i < palette.size(); i++) palette[i] = glm::vec4((e0 * (64 - BC7_WEIGHTS[i]) + e1 * BC7_WEIGHTS[i] + 32u) >> 6u);
+
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+    float best = DistanceSq(block[i], palette[0]);
+    for (uint8_t p = 1; p < palette.size(); p++) {
+      float distance = DistanceSq(block[i], palette[p]);
+      if (distance < best) {
+        best = distance;
+        fit.indices[i] = p;
+      }
+    }
+    fit.error += best;
+  }
+  return fit;
+}
+
+void EncodeBc7(const Block& block, uint8_t* dst) {
+  auto [endpoint0, endpoint1] = PrincipalEndpoints(block);
+  Bc7Fit best = FitBc7(block, endpoint0, endpoint1);
+  for (uint32_t iteration = 0; iteration < REFINE_ITERATIONS && best.error > 0.0f; iteration++) {
+    std::array<float, BLOCK_TEXELS> weights;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++) weights[i] = static_cast<float>(BC7_WEIGHTS[best.indices[i]]) / 64.0f;
+    auto refined = LeastSquaresEndpoints(block, weights);
+    if (!refined) break;
+    Bc7Fit fit = FitBc7(block, refined->first, refined->second);
+    if (fit.error >= best.error) break;
+    best = fit;
+  }
+
+  // the first texel's index has an implicit leading zero, swapping the endpoints mirrors the indices
+  if (best.indices[0] >= 8) {
+    std::swap(best.endpoints[0], best.endpoints[1]);
+    std::swap(best.pBits[0], best.pBits[1]);
+    for (auto& index : best.indices) index = static_cast<uint8_t>(15 - index);
+  }
+
+  BitWriter bits;
+  bits.Write(1u << 6, 7);  // mode 6
+  for (int channel = 0; channel < 4; channel++) {
+    bits.Write(best.endpoints[0][channel], 7);
+    bits.Write(best.endpoints[1][channel], 7);
+  }
+  bits.Write(best.pBits[0], 1);
+  bits.Write(best.pBits[1], 1);
+  bits.Write(best.indices[0], 3);
+  for (uint32_t i = 1; i < BLOCK_TEXELS; i++) bits.Write(best.indices[i], 4);
+  std::copy(bits.Bytes().begin(), bits.Bytes().end(), dst);
+}
+}  // namespace
+
+uint32_t NumMipLevels(glm::uvec2 size) { return std::bit_width(std::max(size.x, size.y)); }
+
+glm::uvec2 MipLevelSize(glm::uvec2 size, uint32_t level) { return glm::max(size >> level, glm::uvec2(1)); }
+
+size_t MipLevelBytes(glm::uvec2 size, Format format) {
+  uint32_t extent = FormatBlockExtent(format);
+  return static_cast<size_t>((size.x + extent - 1) / extent) * ((size.y + extent - 1) / extent) * FormatBlockSize(format);
+}
+
+TextureData GenerateMips(std::span<const uint8_t> rgba8, glm::uvec2 size, bool srgb) {
+  MAPLE_ASSERT(rgba8.size() == static_cast<size_t>(size.x) * size.y * 4, "texture of {}x{} texels has {} bytes", size.x, size.y, rgba8.size());
+
+  TextureData result{.size = size, .mipLevels = NumMipLevels(size), .format = srgb ? Format::R8G8B8A8_SRGB : Format::R8G8B8A8_UNORM};
+  size_t totalBytes = 0;
+  for (uint32_t level = 0; level < result.mipLevels; level++) totalBytes += MipLevelBytes(MipLevelSize(size, level), result.format);
+  result.bytes.reserve(totalBytes);
+  result.bytes.assign(rgba8.begin(), rgba8.end());
+
+  // every level is filtered from the previous one kept in float, so rounding doesn't accumulate down the chain
+  auto decode = [&](uint8_t value, int channel) { return srgb && channel < 3 ? SrgbToLinear(value) : static_cast<float>(value) / 255.0f; };
+  std::vector<glm::vec4> previous(static_cast<size_t>(size.x) * size.y);
+  for (size_t i = 0; i < previous.size(); i++) {
+    for (int channel = 0; channel < 4; channel++) previous[i][channel] = decode(rgba8[i * 4 + channel], channel);
+  }
+
+  for (uint32_t level = 1; level < result.mipLevels; level++) {
+    glm::uvec2 previousSize = MipLevelSize(size, level - 1);
+    glm::uvec2 levelSize = MipLevelSize(size, level);
+
+    std::vector<glm::vec4> current(static_cast<size_t>(levelSize.x) * levelSize.y);
+    for (uint32_t y = 0; y < levelSize.y; y++) {
+      uint32_t y0 = std::min(y * 2, previousSize.y - 1), y1 = std::min(y * 2 + 1, previousSize.y - 1);
+      for (uint32_t x = 0; x < levelSize.x; x++) {
+        uint32_t x0 = std::min(x * 2, previousSize.x - 1), x1 = std::min(x * 2 + 1, previousSize.x - 1);
+        auto texel = [&](uint32_t tx, uint32_t ty) { return previous[static_cast<size_t>(ty) * previousSize.x + tx]; };
+        glm::vec4 filtered = (texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1)) * 0.25f;
+        current[static_cast<size_t>(y) * levelSize.x + x] = filtered;
+
+        result.bytes.push_back(srgb ? LinearToSrgb(filtered.r) : ToUnorm8(filtered.r));
+        result.bytes.push_back(srgb ? LinearToSrgb(filtered.g) : ToUnorm8(filtered.g));
+        result.bytes.push_back(srgb ? LinearToSrgb(filtered.b) : ToUnorm8(filtered.b));
+        result.bytes.push_back(ToUnorm8(filtered.a));
+      }
+    }
+    previous = std::move(current);
+  }
+
+  return result;
+}
+
+TextureData CompressTexture(const TextureData& texture, Format format) {
+  MAPLE_ASSERT(texture.format == Format::R8G8B8A8_UNORM || texture.format == Format::R8G8B8A8_SRGB, "only RGBA8 textures can be compressed");
+  MAPLE_ASSERT(FormatIsBlockCompressed(format), "{} is not a block compressed format", static_cast<int>(format));
+
+  TextureData result{.size = texture.size, .mipLevels = texture.mipLevels, .format = format};
+  size_t totalBytes = 0;
+  for (uint32_t level = 0; level < texture.mipLevels; level++) totalBytes += MipLevelBytes(MipLevelSize(texture.size, level), format);
+  result.bytes.resize(totalBytes);
+
+  uint32_t blockSize = FormatBlockSize(format);
+  const uint8_t* src = texture.bytes.data();
+  uint8_t* dst = result.bytes.data();
+  for (uint32_t level = 0; level < texture.mipLevels; level++) {
+    glm::uvec2 levelSize = MipLevelSize(texture.size, level);
+    glm::uvec2 blocks = (levelSize + BLOCK_EXTENT - 1u) / BLOCK_EXTENT;
+
+    for (uint32_t by = 0; by < blocks.y; by++) {
+      for (uint32_t bx = 0; bx < blocks.x; bx++, dst += blockSize) {
+        Block block = LoadBlock(src, levelSize, bx, by);
+        switch (format) {
+          case Format::BC1_RGB_UNORM:
+          case Format::BC1_RGB_SRGB:
+            EncodeBc1(block, dst);
+            break;
+          case Format::BC3_UNORM:
+          case Format::BC3_SRGB:
+            EncodeBc4(block, 3, dst);
+            EncodeBc1(block, dst + 8);
+            break;
+          case Format::BC5_UNORM:
+            EncodeBc4(block, 0, dst);
+            EncodeBc4(block, 1, dst + 8);
+            break;
+          case Format::BC7_UNORM:
+          case Format::BC7_SRGB:
+            EncodeBc7(block, dst);
+            break;
+          default:
+            MAPLE_FATAL("no encoder for format {}", static_cast<int>(format));
+        }
+      }
+    }
+    src += MipLevelBytes(levelSize, texture.format);
+  }
+
+  return result;
+}
+}  // namespace maple
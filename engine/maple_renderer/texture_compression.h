@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+#include "enums.h"
+
+namespace maple {
+// Import time processing of a texture's texels, the result is handed to Renderer::CreateTexture. Mips are generated here
+// instead of on the GPU since uploads run on the transfer queue, which can't blit, and block compressed formats can't be
+// blitted at all.
+
+// Owns every mip level of a texture, largest first and tightly packed. Block compressed levels are rounded up to whole blocks
+struct TextureData {
+  std::vector<uint8_t> bytes;
+  glm::uvec2 size{};
+  uint32_t mipLevels = 1;
+  Format format = Format::R8G8B8A8_UNORM;
+};
+
+// Levels of a full mip chain down to 1x1
+uint32_t NumMipLevels(glm::uvec2 size);
+glm::uvec2 MipLevelSize(glm::uvec2 size, uint32_t level);
+// Bytes of a single level of `size` texels
+size_t MipLevelBytes(glm::uvec2 size, Format format);
+
+// Full mip chain of tightly packed RGBA8 texels, each level a 2x2 box filter of the previous one. Odd sizes clamp to the
+// edge. With `srgb` the color channels are averaged in linear space, alpha always is
+TextureData GenerateMips(std::span<const uint8_t> rgba8, glm::uvec2 size, bool srgb);
+
+// Encodes every level of an RGBA8 texture into one of the BC formats. The sRGB variants keep the texels' encoding, only the
+// format is tagged. BC1 drops alpha, BC5 keeps red and green only
+//   BC1  endpoints along the principal axis of the block's colors, refined by a least squares fit
+//   BC3  BC1 color and an 8 value alpha ramp between the block's min and max
+//   BC5  two alpha style ramps for red and green
+//   BC7  mode 6 only, a single RGBA line with 4 bit indices, which suits most color textures
+TextureData CompressTexture(const TextureData& texture, Format format);
+}  // namespace maple
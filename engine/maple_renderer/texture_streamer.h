@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "bindless_table.h"
+#include "log_macros.h"
+#include "pool.h"
+#include "render_target.h"
+#include "texture_compression.h"
+#include "upload_manager.h"
+#include "vk_enum_translation.h"
+#include "vkm/vkm_allocator.h"
+#include "vkm/vkm_image.h"
+
+namespace maple {
+// Sampled image holding `mipLevels` levels of `bytes`, laid out like TextureData, and the upload filling it
+inline std::pair<vkm::Image, UploadManager::Ticket> CreateTextureImage(vkm::Allocator& allocator,
+                                                                       UploadManager& uploads,
+                                                                       glm::uvec2 size,
+                                                                       std::span<const uint8_t> bytes,
+                                                                       Format format,
+                                                                       uint32_t mipLevels) {
+  MAPLE_ASSERT(mipLevels >= 1 && mipLevels <= NumMipLevels(size), "{} mip levels for a {}x{} texture", mipLevels, size.x, size.y);
+
+  std::vector<VkDeviceSize> levelOffsets(mipLevels);
+  VkDeviceSize totalBytes = 0;
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    levelOffsets[level] = totalBytes;
+    totalBytes += MipLevelBytes(MipLevelSize(size, level), format);
+  }
+  MAPLE_ASSERT(bytes.size() == totalBytes, "texture data has {} bytes, expected {}", bytes.size(), totalBytes);
+
+  auto img = allocator.CreateImage({
+    .format = ToVulkan(format),
+    .extent = {size.x, size.y, 1},
+    .mipLevels = mipLevels,
+    .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+    .initialLayout = vk::ImageLayout::eUndefined,
+  });
+  auto ticket = uploads.UploadImage(img, std::as_bytes(bytes), levelOffsets);
+  return {std::move(img), ticket};
+}
+
+// Keeps the mip levels of streamed textures on the GPU that their size on screen needs, within a memory budget.
+// The mip tail, every level of at most MIN_RESIDENT_EXTENT texels, is always resident. The renderer reports the finest
+// level each frame's draws need and the texture's image is rebuilt with the levels from there on down, uploaded from the
+// texture's data kept in system memory. The new image takes the old one's place in the same bindless slot once its upload
+// has completed, so draws never see a missing texture. When the requested levels don't fit the budget, the least recently
+// used textures drop their finest levels first.
+class TextureStreamer {
+ public:
+  static constexpr uint32_t MIN_RESIDENT_EXTENT = 64;
+  static constexpr VkDeviceSize DEFAULT_BUDGET = 256ull * 1024 * 1024;
+  static constexpr VkDeviceSize MAX_UPLOAD_PER_FRAME = 16ull * 1024 * 1024;  // of rebuilds started per frame, spreads out spikes
+
+  struct CreateInfo {
+    vkm::Allocator& allocator;
+    UploadManager& uploads;
+    BindlessTable& bindless;
+    Pool<RenderTarget>& textures;  // the renderer's texture pool, streamed textures live in it like any other
+    uint32_t framesInFlight;
+    VkDeviceSize budget = DEFAULT_BUDGET;
+  };
+
+  TextureStreamer() = default;
+  TextureStreamer(const CreateInfo& info)
+      : mAllocator(&info.allocator),
+        mUploads(&info.uploads),
+        mBindless(&info.bindless),
+        mTexturePool(&info.textures),
+        mFramesInFlight(info.framesInFlight),
+        mBudget(info.budget) {}
+
+  // Adds the texture to the pool with only its mip tail resident
+  [[nodiscard]]
+  uint32_t Add(TextureData data) {
+    Streamed texture{.data = std::move(data)};
+    auto& size = texture.data.size;
+    auto extent = [&](uint32_t level) { return std::max(MipLevelSize(size, level).x, MipLevelSize(size, level).y); };
+    while (texture.tailMip + 1 < texture.data.mipLevels && extent(texture.tailMip) > MIN_RESIDENT_EXTENT) texture.tailMip++;
+    texture.residentMip = texture.tailMip;
+    texture.lastUsedFrame = mFrame;
+
+    auto [img, ticket] = createImage(texture.data, texture.tailMip);
+    auto slot = mBindless->Allocate(*img.view, {});
+    auto hndl = mTexturePool->Add(RenderTarget{
+      .info =
+        {
+          .sizeType = SizeType::Absolute,
+          .size = size,
+          .format = texture.data.format,
+        },
+      .target = std::move(img),
+      .uploadTicket = ticket,
+      .bindlessSlot = slot,
+    });
+    mTextures.emplace(hndl, std::move(texture));
+    return hndl;
+  }
+
+  // Drops the streaming state, the texture itself is destroyed by the caller after the device went idle
+  void Remove(uint32_t texture) {
+    auto it = mTextures.find(texture);
+    if (it == mTextures.end()) return;
+    if (it->second.rebuild) mUploads->Discard(*it->second.rebuild->image.img);
+    mTextures.erase(it);
+  }
+
+  bool IsStreamed(uint32_t texture) const { return mTextures.contains(texture); }
+
+  // The finest level a draw of this frame needs, applied by the next Update()
+  void Request(uint32_t texture, uint32_t mipLevel) {
+    auto& streamed = mTextures.at(texture);
+    streamed.requestedMip = std::min(streamed.requestedMip, mipLevel);
+    streamed.lastUsedFrame = mFrame;
+  }
+
+  // Finest level a texture covering `pixels` texels across on screen needs, mapped once over the surface
+  uint32_t MipForScreenSize(uint32_t texture, float pixels) const {
+    auto& data = mTextures.at(texture).data;
+    float texels = static_cast<float>(std::max(data.size.x, data.size.y));
+    if (pixels >= texels) return 0;
+    if (pixels <= 1.0f) return data.mipLevels - 1;
+    return std::min(static_cast<uint32_t>(std::log2(texels / pixels)), data.mipLevels - 1);
+  }
+
+  // Swaps in rebuilt images whose upload completed, frees those replaced long enough ago and starts the rebuilds the last
+  // frame's requests and the budget ask for. Call once per frame before its descriptor sets are written, after
+  // UploadManager::Update()
+  void Update() {
+    mFrame++;
+
+    // every frame that could still sample a replaced image has finished once each frame in flight came around again
+    while (!mRetired.empty() && mRetired.front().first + mFramesInFlight <= mFrame) mRetired.pop_front();
+
+    for (auto& [hndl, texture] : mTextures) {
+      if (!texture.rebuild || !mUploads->IsComplete(texture.rebuild->ticket)) continue;
+      auto& rt = mTexturePool->Get(hndl);
+      mBindless->Update(rt.bindlessSlot, *texture.rebuild->image.view, {});
+      std::swap(rt.target, texture.rebuild->image);
+      rt.uploadTicket = texture.rebuild->ticket;
+      mRetired.emplace_back(mFrame, std::move(texture.rebuild->image));
+      texture.residentMip = texture.rebuild->firstMip;
+      texture.rebuild.reset();
+    }
+
+    // textures keep what they have while unused, until the budget needs it for others
+    std::vector<std::pair<Streamed*, uint32_t>> targets;  // the finest level each texture should have
+    targets.reserve(mTextures.size());
+    VkDeviceSize totalBytes = 0;
+    for (auto& [hndl, texture] : mTextures) {
+      uint32_t target = texture.requestedMip == UINT32_MAX ? texture.TargetMip() : std::min(texture.requestedMip, texture.tailMip);
+      targets.emplace_back(&texture, target);
+      totalBytes += levelBytes(texture.data, target);
+      texture.requestedMip = UINT32_MAX;
+    }
+
+    // least recently used first, each drops levels until everything fits or it's down to its tail
+    std::ranges::sort(targets, [](const auto& a, const auto& b) { return a.first->lastUsedFrame < b.first->lastUsedFrame; });
+    for (auto& [texture, target] : targets) {
+      while (totalBytes > mBudget && target < texture->tailMip) {
+        totalBytes -= levelBytes(texture->data, target) - levelBytes(texture->data, target + 1);
+        target++;
+      }
+    }
+
+    // dropping levels frees memory for the rest, so those go first. A texture changes again after its rebuild landed
+    std::ranges::stable_partition(targets, [](const auto& t) { return t.second > t.first->TargetMip(); });
+    VkDeviceSize uploaded = 0;
+    for (auto& [texture, target] : targets) {
+      if (texture->rebuild || target == texture->residentMip) continue;
+      VkDeviceSize bytes = levelBytes(texture->data, target);
+      if (uploaded > 0 && uploaded + bytes > MAX_UPLOAD_PER_FRAME) continue;
+      uploaded += bytes;
+      startRebuild(*texture, target);
+    }
+  }
+
+  void SetBudget(VkDeviceSize budget) { mBudget = budget; }
+
+  // Bytes of the levels streamed textures have in their bindless slot, images being built or replaced not included
+  VkDeviceSize ResidentBytes() const {
+    VkDeviceSize bytes = 0;
+    for (auto& [hndl, texture] : mTextures) bytes += levelBytes(texture.data, texture.residentMip);
+    return bytes;
+  }
+
+ private:
+  struct Rebuild {
+    vkm::Image image;
+    uint32_t firstMip = 0;
+    UploadManager::Ticket ticket = 0;
+  };
+
+  struct Streamed {
+    TextureData data;
+    uint32_t tailMip = 0;                // first level of the always resident mip tail
+    uint32_t residentMip = 0;            // finest level of the image in the bindless slot
+    uint32_t requestedMip = UINT32_MAX;  // finest level this frame's draws asked for, none while unused
+    uint64_t lastUsedFrame = 0;
+    std::optional<Rebuild> rebuild;
+
+    uint32_t TargetMip() const { return rebuild ? rebuild->firstMip : residentMip; }
+  };
+
+  vkm::Allocator* mAllocator = nullptr;
+  UploadManager* mUploads = nullptr;
+  BindlessTable* mBindless = nullptr;
+  Pool<RenderTarget>* mTexturePool = nullptr;
+  uint32_t mFramesInFlight = 0;
+  VkDeviceSize mBudget = DEFAULT_BUDGET;
+
+  uint64_t mFrame = 0;
+  std::unordered_map<uint32_t, Streamed> mTextures;       // by texture handle
+  std::deque<std::pair<uint64_t, vkm::Image>> mRetired;  // replaced images and the frame they were replaced in
+
+  // bytes of the texture's levels from `firstMip` on down
+  static VkDeviceSize levelBytes(const TextureData& data, uint32_t firstMip) {
+    VkDeviceSize bytes = 0;
+    for (uint32_t level = firstMip; level < data.mipLevels; level++) bytes += MipLevelBytes(MipLevelSize(data.size, level), data.format);
+    return bytes;
+  }
+
+  std::pair<vkm::Image, UploadManager::Ticket> createImage(const TextureData& data, uint32_t firstMip) {
+    VkDeviceSize offset = levelBytes(data, 0) - levelBytes(data, firstMip);
+    return CreateTextureImage(*mAllocator,
+                              *mUploads,
+                              MipLevelSize(data.size, firstMip),
+                              std::span(data.bytes).subspan(offset),
+                              data.format,
+                              data.mipLevels - firstMip);
+  }
+
+  void startRebuild(Streamed& texture, uint32_t firstMip) {
+    auto [img, ticket] = createImage(texture.data, firstMip);
+    texture.rebuild = Rebuild{.image = std::move(img), .firstMip = firstMip, .ticket = ticket};
+  }
+};
+}  // namespace maple
@@ -0,0 +1,273 @@
+#include "upload_manager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "log_macros.h"
+
+namespace maple {
+
+static VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize alignment) { return (v + alignment - 1) / alignment * alignment; }
+
+UploadManager::UploadManager(const CreateInfo& info)
+    : mDevice(&info.device),
+      mAllocator(&info.allocator),
+      mCommandPool(&info.commandPool),
+      mTransferFamily(info.queueFamilies.transfer),
+      mGraphicsFamily(info.queueFamilies.graphics) {
+  mStaging = info.allocator.CreateBuffer(info.stagingSize, vkm::Allocator::Stage);
+
+  vk::SemaphoreTypeCreateInfo typeInfo{.semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = 0};
+  mTimeline = vk::raii::Semaphore(info.device.device, vk::SemaphoreCreateInfo{.pNext = &typeInfo});
+}
+
+UploadManager::Ticket UploadManager::UploadBuffer(const vkm::Buffer& dst, std::span<const std::byte> data, VkDeviceSize dstOffset) {
+  MAPLE_ASSERT(dstOffset + data.size() <= dst.size, "upload of {} bytes at offset {} exceeds buffer size {}", data.size(), dstOffset, dst.size);
+  auto [src, srcOffset] = stage(data);
+  auto& batch = recording();
+
+  batch.cmd.copyBuffer(src, *dst.buffer, vk::BufferCopy{.srcOffset = srcOffset, .dstOffset = dstOffset, .size = data.size()});
+
+  vk::BufferMemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = *dst.buffer,
+    .offset = dstOffset,
+    .size = data.size(),
+  };
+
+  if (ownershipTransfer()) {
+    barrier.srcQueueFamilyIndex = mTransferFamily;
+    barrier.dstQueueFamilyIndex = mGraphicsFamily;
+
+    auto acquire = barrier;
+    acquire.srcStageMask = vk::PipelineStageFlagBits2::eNone;
+    acquire.srcAccessMask = vk::AccessFlagBits2::eNone;
+    batch.bufferAcquires.push_back(acquire);
+
+    barrier.dstStageMask = vk::PipelineStageFlagBits2::eNone;
+    barrier.dstAccessMask = vk::AccessFlagBits2::eNone;
+  }
+  batch.bufferReleases.push_back(barrier);
+
+  return batch.ticket;
+}
+
+UploadManager::Ticket UploadManager::UploadImage(const vkm::Image& dst,
+                                                 std::span<const std::byte> data,
+                                                 std::span<const VkDeviceSize> levelOffsets,
+                                                 vk::ImageAspectFlags aspectMask) {
+  static constexpr VkDeviceSize BASE_LEVEL_OFFSET = 0;
+  if (levelOffsets.empty()) levelOffsets = {&BASE_LEVEL_OFFSET, 1};
+  MAPLE_ASSERT(levelOffsets.size() <= dst.mipLevels, "{} mip levels uploaded to an image with {}", levelOffsets.size(), dst.mipLevels);
+
+  auto [src, srcOffset] = stage(data);
+  auto& batch = recording();
+
+  auto levelCount = static_cast<uint32_t>(levelOffsets.size());
+  vk::ImageSubresourceRange range{.aspectMask = aspectMask, .baseMipLevel = 0, .levelCount = levelCount, .baseArrayLayer = 0, .layerCount = 1};
+
+  vk::ImageMemoryBarrier2 toTransferDst{
+    .srcStageMask = vk::PipelineStageFlagBits2::eNone,
+    .srcAccessMask = vk::AccessFlagBits2::eNone,
+    .dstStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .oldLayout = vk::ImageLayout::eUndefined,
+    .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = *dst.img,
+    .subresourceRange = range,
+  };
+  batch.cmd.pipelineBarrier2(vk::DependencyInfo{.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toTransferDst});
+
+  std::vector<vk::BufferImageCopy> regions;
+  regions.reserve(levelCount);
+  for (uint32_t level = 0; level < levelCount; level++) {
+    regions.push_back({
+      .bufferOffset = srcOffset + levelOffsets[level],
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = {.aspectMask = aspectMask, .mipLevel = level, .baseArrayLayer = 0, .layerCount = 1},
+      .imageOffset = {0, 0, 0},
+      .imageExtent = {std::max(dst.extent.width >> level, 1u), std::max(dst.extent.height >> level, 1u), std::max(dst.extent.depth >> level, 1u)},
+    });
+  }
+  batch.cmd.copyBufferToImage(src, *dst.img, vk::ImageLayout::eTransferDstOptimal, regions);
+
+  vk::ImageMemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = *dst.img,
+    .subresourceRange = range,
+  };
+
+  if (ownershipTransfer()) {
+    // the layout transition is part of the transfer, release and acquire must specify identical layouts
+    barrier.srcQueueFamilyIndex = mTransferFamily;
+    barrier.dstQueueFamilyIndex = mGraphicsFamily;
+
+    auto acquire = barrier;
+    acquire.srcStageMask = vk::PipelineStageFlagBits2::eNone;
+    acquire.srcAccessMask = vk::AccessFlagBits2::eNone;
+    batch.imageAcquires.push_back(acquire);
+
+    barrier.dstStageMask = vk::PipelineStageFlagBits2::eNone;
+    barrier.dstAccessMask = vk::AccessFlagBits2::eNone;
+  }
+  batch.imageReleases.push_back(barrier);
+
+  return batch.ticket;
+}
+
+void UploadManager::Flush() {
+  if (!mRecording.has_value()) return;
+  auto& batch = *mRecording;
+
+  batch.cmd.pipelineBarrier2(vk::DependencyInfo{
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(batch.bufferReleases.size()),
+    .pBufferMemoryBarriers = batch.bufferReleases.data(),
+    .imageMemoryBarrierCount = static_cast<uint32_t>(batch.imageReleases.size()),
+    .pImageMemoryBarriers = batch.imageReleases.data(),
+  });
+  batch.cmd.end();
+
+  vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = *batch.cmd};
+  vk::SemaphoreSubmitInfo signalInfo{.semaphore = *mTimeline, .value = batch.ticket, .stageMask = vk::PipelineStageFlagBits2::eAllCommands};
+  mDevice->queues.transfer.submit2(vk::SubmitInfo2{
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &cmdInfo,
+    .signalSemaphoreInfoCount = 1,
+    .pSignalSemaphoreInfos = &signalInfo,
+  });
+
+  batch.ringEnd = mRingHead;
+  batch.bufferReleases.clear();
+  batch.imageReleases.clear();
+  mInFlight.push_back(std::move(batch));
+  mRecording.reset();
+  mNextTicket++;
+}
+
+void UploadManager::Update() {
+  mCompletedValue = mTimeline.getCounterValue();
+  while (!mInFlight.empty() && mInFlight.front().ticket <= mCompletedValue) retireOldest();
+}
+
+void UploadManager::WaitIdle() {
+  Flush();
+  if (mInFlight.empty()) return;
+
+  uint64_t value = mInFlight.back().ticket;
+  vk::SemaphoreWaitInfo waitInfo{.semaphoreCount = 1, .pSemaphores = &*mTimeline, .pValues = &value};
+  if (mDevice->device.waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+    MAPLE_FATAL("failed to wait for upload completion");
+  Update();
+}
+
+void UploadManager::RecordAcquireBarriers(const vk::raii::CommandBuffer& cmd) {
+  if (mPendingBufferAcquires.empty() && mPendingImageAcquires.empty()) return;
+
+  cmd.pipelineBarrier2(vk::DependencyInfo{
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(mPendingBufferAcquires.size()),
+    .pBufferMemoryBarriers = mPendingBufferAcquires.data(),
+    .imageMemoryBarrierCount = static_cast<uint32_t>(mPendingImageAcquires.size()),
+    .pImageMemoryBarriers = mPendingImageAcquires.data(),
+  });
+  mPendingBufferAcquires.clear();
+  mPendingImageAcquires.clear();
+}
+
+vk::SemaphoreSubmitInfo UploadManager::GraphicsWaitInfo() const {
+  return vk::SemaphoreSubmitInfo{.semaphore = *mTimeline, .value = mCompletedValue, .stageMask = vk::PipelineStageFlagBits2::eAllCommands};
+}
+
+void UploadManager::Discard(vk::Buffer buffer) {
+  std::erase_if(mPendingBufferAcquires, [&](const auto& barrier) { return barrier.buffer == buffer; });
+}
+
+void UploadManager::Discard(vk::Image image) {
+  std::erase_if(mPendingImageAcquires, [&](const auto& barrier) { return barrier.image == image; });
+}
+
+UploadManager::Batch& UploadManager::recording() {
+  if (mRecording.has_value()) return *mRecording;
+
+  vk::raii::CommandBuffer cmd = nullptr;
+  if (!mFreeCommandBuffers.empty()) {
+    cmd = std::move(mFreeCommandBuffers.back());
+    mFreeCommandBuffers.pop_back();
+  } else {
+    vk::CommandBufferAllocateInfo allocInfo{.commandPool = **mCommandPool, .level = vk::CommandBufferLevel::ePrimary, .commandBufferCount = 1};
+    cmd = std::move(vk::raii::CommandBuffers(mDevice->device, allocInfo).front());
+  }
+  cmd.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+  mRecording = Batch{.cmd = std::move(cmd), .ticket = mNextTicket};
+  return *mRecording;
+}
+
+std::pair<vk::Buffer, VkDeviceSize> UploadManager::stage(std::span<const std::byte> data) {
+  VkDeviceSize size = alignUp(std::max<VkDeviceSize>(data.size(), 1), STAGING_ALIGNMENT);
+
+  if (size > mStaging.size) {
+    // too large for the ring, it gets a staging buffer of its own that lives until the batch retires
+    auto buffer = mAllocator->CreateBuffer(data.size(), vkm::Allocator::Stage);
+    buffer.Upload(data.data(), data.size());
+    vk::Buffer handle = *buffer.buffer;
+    recording().overflowStaging.push_back(std::move(buffer));
+    return {handle, 0};
+  }
+
+  auto offset = ringAllocate(size);
+  if (!offset.has_value()) {
+    // ring is full, submit what was recorded so far and wait for the oldest batches to hand their staging memory back
+    Flush();
+    while (!(offset = ringAllocate(size)).has_value()) {
+      MAPLE_ASSERT(!mInFlight.empty(), "staging ring exhausted with no uploads in flight");
+      uint64_t value = mInFlight.front().ticket;
+      vk::SemaphoreWaitInfo waitInfo{.semaphoreCount = 1, .pSemaphores = &*mTimeline, .pValues = &value};
+      if (mDevice->device.waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        MAPLE_FATAL("failed to wait for upload completion");
+      mCompletedValue = std::max(mCompletedValue, value);
+      retireOldest();
+    }
+  }
+
+  std::memcpy(static_cast<std::byte*>(mStaging.mapped) + *offset, data.data(), data.size());
+  return {*mStaging.buffer, *offset};
+}
+
+std::optional<VkDeviceSize> UploadManager::ringAllocate(VkDeviceSize size) {
+  uint64_t start = mRingHead;
+  // never split an allocation across the end of the ring, skip to the start instead
+  if (start % mStaging.size + size > mStaging.size) start = alignUp(start, mStaging.size);
+  if (start + size - mRingTail > mStaging.size) return std::nullopt;
+
+  mRingHead = start + size;
+  return start % mStaging.size;
+}
+
+void UploadManager::retireOldest() {
+  auto& batch = mInFlight.front();
+  mRingTail = batch.ringEnd;
+
+  mPendingBufferAcquires.insert(mPendingBufferAcquires.end(), batch.bufferAcquires.begin(), batch.bufferAcquires.end());
+  mPendingImageAcquires.insert(mPendingImageAcquires.end(), batch.imageAcquires.begin(), batch.imageAcquires.end());
+
+  batch.cmd.reset();
+  mFreeCommandBuffers.push_back(std::move(batch.cmd));
+  mInFlight.pop_front();
+}
+}  // namespace maple
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "vk_logical_device.h"
+#include "vk_queue_family_indices.h"
+#include "vkm/vkm_allocator.h"
+#include "vkm/vkm_buffer.h"
+#include "vkm/vkm_image.h"
+
+namespace maple {
+// Streams buffer and image contents to the GPU on the transfer queue.
+// Data is copied into a persistently mapped staging ring and the copies are batched into one command buffer, which is
+// submitted by Flush() (once per frame, or early when the ring fills up). Every batch signals a timeline semaphore with
+// its ticket, so completion is polled instead of waited on. When the transfer queue lives in its own family, ownership of
+// the uploaded resources is released at the end of the batch and acquired by the graphics queue in RecordAcquireBarriers().
+class UploadManager {
+ public:
+  using Ticket = uint64_t;  // timeline value the upload is complete at, resources uploaded in the same batch share a ticket
+  static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 64ull * 1024 * 1024;
+
+  struct CreateInfo {
+    const VulkanLogicalDevice& device;
+    const QueueFamilyIndices& queueFamilies;
+    vkm::Allocator& allocator;
+    const vk::raii::CommandPool& commandPool;  // must belong to the transfer family
+    VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE;
+  };
+
+  UploadManager() = default;
+  UploadManager(const CreateInfo& info);
+
+  // Contents of data are copied before returning, the caller may free it immediately
+  [[nodiscard]]
+  Ticket UploadBuffer(const vkm::Buffer& dst, std::span<const std::byte> data, VkDeviceSize dstOffset = 0);
+  // Fills the image's mip levels and leaves them in ShaderReadOnlyOptimal. Level i starts at levelOffsets[i] in data and is
+  // tightly packed, no offsets means data only holds mip 0
+  [[nodiscard]]
+  Ticket UploadImage(const vkm::Image& dst,
+                     std::span<const std::byte> data,
+                     std::span<const VkDeviceSize> levelOffsets = {},
+                     vk::ImageAspectFlags aspectMask = vk::ImageAspectFlagBits::eColor);
+
+  // Submits the batch being recorded, if there is one
+  void Flush();
+  // Polls the timeline semaphore and retires finished batches, recycling their command buffers and staging memory
+  void Update();
+  // Blocks until everything uploaded so far has completed
+  void WaitIdle();
+
+  // A completed upload may be used by graphics work recorded after the next RecordAcquireBarriers()
+  bool IsComplete(Ticket ticket) const { return ticket <= mCompletedValue; }
+
+  // Records the graphics side of the ownership transfer for every batch completed since the last call
+  void RecordAcquireBarriers(const vk::raii::CommandBuffer& cmd);
+  // Wait for the graphics submission that contains the acquire barriers, it is already signaled so it never stalls
+  vk::SemaphoreSubmitInfo GraphicsWaitInfo() const;
+
+  // Drops pending acquires of a resource that is about to be destroyed
+  void Discard(vk::Buffer buffer);
+  void Discard(vk::Image image);
+
+ private:
+  static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;  // covers the texel and block size alignment copyBufferToImage needs for all color formats
+
+  struct Batch {
+    vk::raii::CommandBuffer cmd = nullptr;
+    Ticket ticket = 0;
+    uint64_t ringEnd = 0;                     // staging ring head when the batch was submitted
+    std::vector<vkm::Buffer> overflowStaging;  // uploads larger than the ring get their own staging buffer
+    std::vector<vk::BufferMemoryBarrier2> bufferReleases;
+    std::vector<vk::ImageMemoryBarrier2> imageReleases;
+    std::vector<vk::BufferMemoryBarrier2> bufferAcquires;
+    std::vector<vk::ImageMemoryBarrier2> imageAcquires;
+  };
+
+  const VulkanLogicalDevice* mDevice = nullptr;
+  vkm::Allocator* mAllocator = nullptr;
+  const vk::raii::CommandPool* mCommandPool = nullptr;
+  uint32_t mTransferFamily = VK_QUEUE_FAMILY_IGNORED;
+  uint32_t mGraphicsFamily = VK_QUEUE_FAMILY_IGNORED;
+
+  vkm::Buffer mStaging;
+  // monotonic byte positions into the ring, the physical offset is position % mStaging.size
+  uint64_t mRingHead = 0;
+  uint64_t mRingTail = 0;
+
+  vk::raii::Semaphore mTimeline = nullptr;
+  Ticket mNextTicket = 1;
+  uint64_t mCompletedValue = 0;
+
+  std::optional<Batch> mRecording;
+  std::deque<Batch> mInFlight;
+  std::vector<vk::raii::CommandBuffer> mFreeCommandBuffers;
+
+  std::vector<vk::BufferMemoryBarrier2> mPendingBufferAcquires;
+  std::vector<vk::ImageMemoryBarrier2> mPendingImageAcquires;
+
+  bool ownershipTransfer() const { return mTransferFamily != mGraphicsFamily; }
+
+  Batch& recording();
+  std::pair<vk::Buffer, VkDeviceSize> stage(std::span<const std::byte> data);
+  std::optional<VkDeviceSize> ringAllocate(VkDeviceSize size);
+  void retireOldest();
+};
+}  // namespace maple
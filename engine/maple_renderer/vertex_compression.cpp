@@ -0,0 +1,161 @@
+#include "vertex_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <span>
+
+#include "mesh_optimizer.h"
+
+namespace maple {
+namespace {
+constexpr float QUANTIZED_POSITION_MAX = 65535.0f;
+
+template <typename T>
+T ReadAttribute(const std::byte* vertex, uint32_t offset) {
+  T value;
+  std::memcpy(&value, vertex + offset, sizeof(value));
+  return value;
+}
+
+uint32_t PackSnorm16(float x, float y) {
+  auto snorm = [](float v) { return static_cast<uint32_t>(static_cast<int16_t>(std::round(std::clamp(v, -1.0f, 1.0f) * 32767.0f))) & 0xFFFF; };
+  return snorm(x) | snorm(y) << 16;
+}
+
+float UnpackSnorm16(uint32_t bits) { return std::max(static_cast<float>(static_cast<int16_t>(bits & 0xFFFF)) / 32767.0f, -1.0f); }
+
+// IEEE half with round to nearest even, values out of range become infinity
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t absBits = bits & 0x7FFFFFFF;
+
+  if (absBits >= 0x7F800000) return static_cast<uint16_t>(sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0));  // inf, nan
+  if (absBits >= 0x477FF000) return static_cast<uint16_t>(sign | 0x7C00);  // rounds above the largest half
+  if (absBits < 0x38800000) {
+    // subnormal half, shift the implicit one into the mantissa and round what falls off
+    if (absBits < 0x33000000) return static_cast<uint16_t>(sign);
+    uint32_t exponent = absBits >> 23;
+    uint32_t mantissa = (absBits & 0x7FFFFF) | 0x800000;
+    uint32_t shift = 126 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  uint32_t half = ((absBits - 0x38000000) >> 13);
+  uint32_t rest = absBits & 0x1FFF;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;  // a carry into the exponent is still correct
+  return static_cast<uint16_t>(sign | half);
+}
+}  // namespace
+
+uint32_t EncodeOctahedral(glm::vec3 normal) {
+  normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  glm::vec2 encoded(normal.x, normal.y);
+  if (normal.z < 0.0f) {
+    // fold the lower half over the diagonals
+    encoded = glm::vec2((1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+                        (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return PackSnorm16(encoded.x, encoded.y);
+}
+
+glm::vec3 DecodeOctahedral(uint32_t packed) {
+  glm::vec3 normal(UnpackSnorm16(packed), UnpackSnorm16(packed >> 16), 0.0f);
+  normal.z = 1.0f - std::abs(normal.x) - std::abs(normal.y);
+  float fold = std::max(-normal.z, 0.0f);
+  normal.x += normal.x >= 0.0f ? -fold : fold;
+  normal.y += normal.y >= 0.0f ? -fold : fold;
+  return glm::normalize(normal);
+}
+
+CompressedVertices CompressVertices(const MeshData& mesh, const VertexAttributes& attributes) {
+  CompressedVertices result;
+  if (mesh.numVerts == 0) return result;
+
+  uint32_t sourceStride = mesh.GetStride();
+  auto sourceVertex = [&](uint32_t i) { return mesh.verts.data() + static_cast<size_t>(i) * sourceStride; };
+
+  glm::vec3 min = ReadAttribute<glm::vec3>(sourceVertex(0), attributes.position), max = min;
+  for (uint32_t i = 1; i < mesh.numVerts; i++) {
+    auto pos = ReadAttribute<glm::vec3>(sourceVertex(i), attributes.position);
+    min = glm::min(min, pos);
+    max = glm::max(max, pos);
+  }
+
+  // flat axes keep a scale of 0, every vertex decodes to the offset there
+  result.quantization.positionOffset = min;
+  result.quantization.positionScale = (max - min) / QUANTIZED_POSITION_MAX;
+
+  // the sphere is computed from the exact positions, rounding moves them by up to half a step on every axis
+  if (mesh.boundingSphere.has_value()) {
+    result.boundingSphere = *mesh.boundingSphere;
+  } else {
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < mesh.numVerts; i++) {
+      radius = std::max(radius, glm::distance(center, ReadAttribute<glm::vec3>(sourceVertex(i), attributes.position)));
+    }
+    result.boundingSphere = glm::vec4(center, radius);
+  }
+  result.boundingSphere.w += glm::length(result.quantization.positionScale) * 0.5f;
+
+  result.stride = 4 * sizeof(uint16_t);
+  if (attributes.normal) result.stride += sizeof(uint32_t);
+  if (attributes.tangent) result.stride += sizeof(uint32_t);
+  if (attributes.uv) result.stride += sizeof(uint32_t);
+  result.verts.resize(static_cast<size_t>(result.stride) * mesh.numVerts);
+
+  // only needed to bound the meshlets, see below
+  std::vector<glm::vec3> decoded(mesh.meshlets.empty() ? 0 : mesh.numVerts);
+
+  for (uint32_t i = 0; i < mesh.numVerts; i++) {
+    auto* src = sourceVertex(i);
+    auto* dst = result.verts.data() + static_cast<size_t>(i) * result.stride;
+    auto write = [&](const auto& value) {
+      std::memcpy(dst, &value, sizeof(value));
+      dst += sizeof(value);
+    };
+
+    auto pos = ReadAttribute<glm::vec3>(src, attributes.position);
+    uint16_t position[4] = {};
+    for (int axis = 0; axis < 3; axis++) {
+      float scale = result.quantization.positionScale[axis];
+      float quantized = scale > 0.0f ? std::round((pos[axis] - min[axis]) / scale) : 0.0f;
+      position[axis] = static_cast<uint16_t>(std::clamp(quantized, 0.0f, QUANTIZED_POSITION_MAX));
+    }
+    if (!decoded.empty()) {
+      decoded[i] = result.quantization.positionOffset + glm::vec3(position[0], position[1], position[2]) * result.quantization.positionScale;
+    }
+    if (attributes.tangent) position[3] = ReadAttribute<glm::vec4>(src, *attributes.tangent).w < 0.0f ? 1 : 0;
+    write(position);
+
+    if (attributes.normal) write(EncodeOctahedral(ReadAttribute<glm::vec3>(src, *attributes.normal)));
+    if (attributes.tangent) write(EncodeOctahedral(glm::vec3(ReadAttribute<glm::vec4>(src, *attributes.tangent))));
+    if (attributes.uv) {
+      auto uv = ReadAttribute<glm::vec2>(src, *attributes.uv);
+      write(static_cast<uint32_t>(FloatToHalf(uv.x)) | static_cast<uint32_t>(FloatToHalf(uv.y)) << 16);
+    }
+  }
+
+  // meshlet bounds were computed from the exact positions. Rounding tilts triangles as well as moving them, which can put
+  // one behind its cone apex, so unlike the mesh's sphere they're recomputed from the positions the vertex shader decodes
+  if (!mesh.meshlets.empty()) {
+    MeshData decodedMesh{.verts = std::as_bytes(std::span(decoded)), .indices = mesh.indices, .numVerts = mesh.numVerts};
+    result.meshlets.reserve(mesh.meshlets.size());
+    for (auto& meshlet : mesh.meshlets) {
+      auto bounded = ComputeMeshletBounds(mesh.indices.subspan(meshlet.firstIndex, meshlet.numTriangles * 3), decodedMesh);
+      bounded.firstIndex = meshlet.firstIndex;
+      bounded.numTriangles = meshlet.numTriangles;
+      result.meshlets.push_back(bounded);
+    }
+  }
+
+  return result;
+}
+}  // namespace maple
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <optional>
+#include <vector>
+
+#include "mesh_data.h"
+
+namespace maple {
+// Import time compression of a mesh's vertices, the last step before Renderer::CreateMesh. Every other import step expects
+// float positions, so meshes are optimized first and compressed afterwards.
+//
+// Compressed vertices are packed in this order, attributes the source doesn't have are left out:
+//   position  4 x uint16  xyz quantized to the mesh bounds, decoded with the mesh's VertexQuantization. w is the bitangent
+//                         sign, 1 for negative, when there is a tangent
+//   normal    2 x snorm16 octahedral
+//   tangent   2 x snorm16 octahedral
+//   uv        2 x half
+// The maple shader module decodes them with mapleDecodePosition, mapleDecodeOctahedral, mapleDecodeTangent and mapleDecodeHalf2
+
+// Byte offsets of the attributes in a source vertex
+struct VertexAttributes {
+  uint32_t position = 0;            // float3
+  std::optional<uint32_t> normal;   // float3, normalized
+  std::optional<uint32_t> tangent;  // float4, xyz normalized and w the bitangent sign
+  std::optional<uint32_t> uv;       // float2
+};
+
+// Owns the compressed vertices, views of the rest of the mesh stay with the source
+struct CompressedVertices {
+  std::vector<std::byte> verts;
+  uint32_t stride = 0;
+  VertexQuantization quantization;
+  glm::vec4 boundingSphere{};  // of the source positions, grown by the quantization error
+  std::vector<Meshlet> meshlets;  // the source's meshlets with bounds of the decoded positions
+
+  // `mesh` with its vertices replaced by the compressed ones, valid as long as both are
+  MeshData Apply(MeshData mesh) const {
+    mesh.verts = verts;
+    mesh.quantization = quantization;
+    mesh.boundingSphere = boundingSphere;
+    mesh.meshlets = meshlets;
+    return mesh;
+  }
+};
+
+CompressedVertices CompressVertices(const MeshData& mesh, const VertexAttributes& attributes);
+
+// Unit vector on the octahedron unfolded into the -1..1 square, as two snorm16 with x in the low half
+uint32_t EncodeOctahedral(glm::vec3 normal);
+glm::vec3 DecodeOctahedral(uint32_t packed);
+}  // namespace maple
@@ -14,19 +14,22 @@ enum DeviceFeature : uint64_t {
   DescriptorIndexing = 1ull << 6,
   ShaderInt64 = 1ull << 7,
   ScalarBlockLayout = 1ull << 8,
+  TimelineSemaphore = 1ull << 9,
+  DescriptorUpdateAfterBind = 1ull << 10,
+  DrawIndirectCount = 1ull << 11,
+  StorageImageWithoutFormat = 1ull << 12,  // compute passes write render targets through RWTexture2D<float4>
 };
 
 using DeviceFeatureMask = uint64_t;
 
 struct DeviceFeatures {
-  vk::StructureChain<vk::PhysicalDeviceFeatures2,
-                     vk::PhysicalDeviceVulkan11Features,
-                     vk::PhysicalDeviceVulkan13Features,
-                     vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
-                     vk::PhysicalDeviceBufferDeviceAddressFeatures,
-                     vk::PhysicalDeviceDescriptorIndexingFeatures,
-                     vk::PhysicalDeviceScalarBlockLayoutFeatures>
-    chain{};
+  // Vulkan 1.2 features all come from the core struct, chaining it together with the promoted per-feature structs is invalid
+  using Chain = vk::StructureChain<vk::PhysicalDeviceFeatures2,
+                                   vk::PhysicalDeviceVulkan11Features,
+                                   vk::PhysicalDeviceVulkan12Features,
+                                   vk::PhysicalDeviceVulkan13Features,
+                                   vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>;
+  Chain chain{};
 
   DeviceFeatures() {}
 
@@ -47,18 +50,29 @@ struct DeviceFeatures {
       if (!getExtDynState().extendedDynamicState) return false;
 
     if (mask & (uint64_t)DeviceFeature::BufferDeviceAddress)
-      if (!getBufferAddressFeatures().bufferDeviceAddress) return false;
+      if (!getVk12().bufferDeviceAddress) return false;
 
     if (mask & (uint64_t)DeviceFeature::DescriptorIndexing)
-      if (!getDescriptorIndexingFeatures().shaderSampledImageArrayNonUniformIndexing ||
-          !getDescriptorIndexingFeatures().descriptorBindingPartiallyBound || !getDescriptorIndexingFeatures().runtimeDescriptorArray)
+      if (!getVk12().shaderSampledImageArrayNonUniformIndexing || !getVk12().descriptorBindingPartiallyBound || !getVk12().runtimeDescriptorArray)
         return false;
 
     if (mask & (uint64_t)DeviceFeature::ShaderInt64)
       if (!getCore().features.shaderInt64) return false;
 
     if (mask & (uint64_t)DeviceFeature::ScalarBlockLayout)
-      if (!getScalarBlockLayoutFeatures().scalarBlockLayout) return false;
+      if (!getVk12().scalarBlockLayout) return false;
+
+    if (mask & (uint64_t)DeviceFeature::TimelineSemaphore)
+      if (!getVk12().timelineSemaphore) return false;
+
+    if (mask & (uint64_t)DeviceFeature::DescriptorUpdateAfterBind)
+      if (!getVk12().descriptorBindingSampledImageUpdateAfterBind || !getVk12().descriptorBindingStorageImageUpdateAfterBind) return false;
+
+    if (mask & (uint64_t)DeviceFeature::DrawIndirectCount)
+      if (!getVk12().drawIndirectCount) return false;
+
+    if (mask & (uint64_t)DeviceFeature::StorageImageWithoutFormat)
+      if (!getCore().features.shaderStorageImageReadWithoutFormat || !getCore().features.shaderStorageImageWriteWithoutFormat) return false;
 
     return true;
   }
@@ -74,17 +88,31 @@ struct DeviceFeatures {
 
     if (mask & (uint64_t)DeviceFeature::ExtendedDynamicState) getExtDynState().extendedDynamicState = VK_TRUE;
 
-    if (mask & (uint64_t)DeviceFeature::BufferDeviceAddress) getBufferAddressFeatures().bufferDeviceAddress = VK_TRUE;
+    if (mask & (uint64_t)DeviceFeature::BufferDeviceAddress) getVk12().bufferDeviceAddress = VK_TRUE;
 
     if (mask & (uint64_t)DeviceFeature::DescriptorIndexing) {
-      getDescriptorIndexingFeatures().shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
-      getDescriptorIndexingFeatures().descriptorBindingPartiallyBound = VK_TRUE;
-      getDescriptorIndexingFeatures().runtimeDescriptorArray = VK_TRUE;
+      getVk12().shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+      getVk12().descriptorBindingPartiallyBound = VK_TRUE;
+      getVk12().runtimeDescriptorArray = VK_TRUE;
     }
 
     if (mask & (uint64_t)DeviceFeature::ShaderInt64) getCore().features.shaderInt64 = VK_TRUE;
 
-    if (mask & (uint64_t)DeviceFeature::ScalarBlockLayout) getScalarBlockLayoutFeatures().scalarBlockLayout = true;
+    if (mask & (uint64_t)DeviceFeature::ScalarBlockLayout) getVk12().scalarBlockLayout = VK_TRUE;
+
+    if (mask & (uint64_t)DeviceFeature::TimelineSemaphore) getVk12().timelineSemaphore = VK_TRUE;
+
+    if (mask & (uint64_t)DeviceFeature::DescriptorUpdateAfterBind) {
+      getVk12().descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+      getVk12().descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+    }
+
+    if (mask & (uint64_t)DeviceFeature::DrawIndirectCount) getVk12().drawIndirectCount = VK_TRUE;
+
+    if (mask & (uint64_t)DeviceFeature::StorageImageWithoutFormat) {
+      getCore().features.shaderStorageImageReadWithoutFormat = VK_TRUE;
+      getCore().features.shaderStorageImageWriteWithoutFormat = VK_TRUE;
+    }
   }
 
   vk::PhysicalDeviceFeatures2& getCore() { return chain.get<vk::PhysicalDeviceFeatures2>(); }
@@ -95,6 +123,9 @@ struct DeviceFeatures {
   vk::PhysicalDeviceVulkan11Features& getVk11() { return chain.get<vk::PhysicalDeviceVulkan11Features>(); }
   const vk::PhysicalDeviceVulkan11Features& getVk11() const { return chain.get<vk::PhysicalDeviceVulkan11Features>(); }
 
+  vk::PhysicalDeviceVulkan12Features& getVk12() { return chain.get<vk::PhysicalDeviceVulkan12Features>(); }
+  const vk::PhysicalDeviceVulkan12Features& getVk12() const { return chain.get<vk::PhysicalDeviceVulkan12Features>(); }
+
   vk::PhysicalDeviceVulkan13Features& getVk13() { return chain.get<vk::PhysicalDeviceVulkan13Features>(); }
   const vk::PhysicalDeviceVulkan13Features& getVk13() const { return chain.get<vk::PhysicalDeviceVulkan13Features>(); }
 
@@ -102,20 +133,5 @@ struct DeviceFeatures {
   const vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT& getExtDynState() const {
     return chain.get<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>();
   }
-
-  vk::PhysicalDeviceBufferDeviceAddressFeatures& getBufferAddressFeatures() { return chain.get<vk::PhysicalDeviceBufferDeviceAddressFeatures>(); }
-  const vk::PhysicalDeviceBufferDeviceAddressFeatures& getBufferAddressFeatures() const {
-    return chain.get<vk::PhysicalDeviceBufferDeviceAddressFeatures>();
-  }
-
-  vk::PhysicalDeviceDescriptorIndexingFeatures& getDescriptorIndexingFeatures() { return chain.get<vk::PhysicalDeviceDescriptorIndexingFeatures>(); }
-  const vk::PhysicalDeviceDescriptorIndexingFeatures& getDescriptorIndexingFeatures() const {
-    return chain.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
-  }
-
-  vk::PhysicalDeviceScalarBlockLayoutFeatures& getScalarBlockLayoutFeatures() { return chain.get<vk::PhysicalDeviceScalarBlockLayoutFeatures>(); }
-  const vk::PhysicalDeviceScalarBlockLayoutFeatures& getScalarBlockLayoutFeatures() const {
-    return chain.get<vk::PhysicalDeviceScalarBlockLayoutFeatures>();
-  }
 };
 }  // namespace maple
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <utility>
 #include <vulkan/vulkan_raii.hpp>
 
 #include "enums.h"
@@ -12,6 +14,8 @@ vk::ImageLayout ToVulkan(ImageLayout layout) {
   switch (layout) {
     case ImageLayout::Undefined:
       return vk::ImageLayout::eUndefined;
+    case ImageLayout::General:
+      return vk::ImageLayout::eGeneral;
     case ImageLayout::AttachmentOptimal:
       return vk::ImageLayout::eAttachmentOptimal;
     case ImageLayout::ShaderReadOnlyOptimal:
@@ -30,12 +34,47 @@ vk::AccessFlags2 ToVulkan(AccessMask access) {
       return vk::AccessFlagBits2::eColorAttachmentWrite;
     case AccessMask::DepthStencilAttachmentWrite:
       return vk::AccessFlagBits2::eDepthStencilAttachmentWrite;
+    case AccessMask::ColorAttachmentReadWrite:
+      return vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite;
+    case AccessMask::DepthStencilAttachmentReadWrite:
+      return vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite;
     case AccessMask::ShaderRead:
       return vk::AccessFlagBits2::eShaderSampledRead;  // sampled image read
+    case AccessMask::ShaderWrite:
+      return vk::AccessFlagBits2::eShaderStorageWrite;
+    case AccessMask::ShaderReadWrite:
+      return vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite;
   }
   MAPLE_FATAL("Unknown AccessMask");
 }
 
+// the render graph resolves Auto before anything gets recorded
+vk::AttachmentLoadOp ToVulkan(LoadOp op) {
+  switch (op) {
+    case LoadOp::Clear:
+      return vk::AttachmentLoadOp::eClear;
+    case LoadOp::Load:
+      return vk::AttachmentLoadOp::eLoad;
+    case LoadOp::DontCare:
+      return vk::AttachmentLoadOp::eDontCare;
+    case LoadOp::Auto:
+      break;
+  }
+  MAPLE_FATAL("Unknown LoadOp");
+}
+
+vk::AttachmentStoreOp ToVulkan(StoreOp op) {
+  switch (op) {
+    case StoreOp::Store:
+      return vk::AttachmentStoreOp::eStore;
+    case StoreOp::DontCare:
+      return vk::AttachmentStoreOp::eDontCare;
+    case StoreOp::Auto:
+      break;
+  }
+  MAPLE_FATAL("Unknown StoreOp");
+}
+
 vk::ShaderStageFlags ToVulkan(ShaderStage stage) {
   switch (stage) {
     case ShaderStage::Vertex:
@@ -52,32 +91,25 @@ vk::ShaderStageFlags ToVulkan(ShaderStage stage) {
   MAPLE_FATAL("Unknown ShaderStage");
 }
 
-vk::PipelineStageFlags2 ToVulkan(PipelineStage stage) {
-  switch (stage) {
-    case PipelineStage::TopOfPipe:
-      return vk::PipelineStageFlagBits2::eTopOfPipe;
-    case PipelineStage::BottomOfPipe:
-      return vk::PipelineStageFlagBits2::eBottomOfPipe;
-    case PipelineStage::ColorAttachmentOutput:
-      return vk::PipelineStageFlagBits2::eColorAttachmentOutput;
-    case PipelineStage::EarlyFragmentTests:
-      return vk::PipelineStageFlagBits2::eEarlyFragmentTests;
-    case PipelineStage::LateFragmentTests:
-      return vk::PipelineStageFlagBits2::eLateFragmentTests;
-    case PipelineStage::EarlyAndLateFragmentTests:
-      return vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests;
-    case PipelineStage::VertexShader:
-      return vk::PipelineStageFlagBits2::eVertexShader;
-    case PipelineStage::FragmentShader:
-      return vk::PipelineStageFlagBits2::eFragmentShader;
-    case PipelineStage::ComputeShader:
-      return vk::PipelineStageFlagBits2::eComputeShader;
-    case PipelineStage::AllGraphics:
-      return vk::PipelineStageFlagBits2::eAllGraphics;
-    case PipelineStage::AllGraphicsAndCompute:
-      return vk::PipelineStageFlagBits2::eAllCommands;
-  }
-  MAPLE_FATAL("Unknown PipelineStage");
+vk::PipelineStageFlags2 ToVulkan(PipelineStage stages) {
+  static const std::array<std::pair<PipelineStage, vk::PipelineStageFlags2>, 10> translation = {{
+    {PipelineStage::TopOfPipe, vk::PipelineStageFlagBits2::eTopOfPipe},
+    {PipelineStage::BottomOfPipe, vk::PipelineStageFlagBits2::eBottomOfPipe},
+    {PipelineStage::ColorAttachmentOutput, vk::PipelineStageFlagBits2::eColorAttachmentOutput},
+    {PipelineStage::EarlyFragmentTests, vk::PipelineStageFlagBits2::eEarlyFragmentTests},
+    {PipelineStage::LateFragmentTests, vk::PipelineStageFlagBits2::eLateFragmentTests},
+    {PipelineStage::VertexShader, vk::PipelineStageFlagBits2::eVertexShader},
+    {PipelineStage::FragmentShader, vk::PipelineStageFlagBits2::eFragmentShader},
+    {PipelineStage::ComputeShader, vk::PipelineStageFlagBits2::eComputeShader},
+    {PipelineStage::AllGraphics, vk::PipelineStageFlagBits2::eAllGraphics},
+    {PipelineStage::AllGraphicsAndCompute, vk::PipelineStageFlagBits2::eAllCommands},
+  }};
+
+  vk::PipelineStageFlags2 flags = vk::PipelineStageFlagBits2::eNone;
+  for (auto [stage, vkStage] : translation) {
+    if (HasStages(stages, stage)) flags |= vkStage;
+  }
+  return flags;
 }
 
 vk::Format ToVulkan(Format format) {
@@ -106,6 +138,20 @@ vk::Format ToVulkan(Format format) {
       return vk::Format::eR16Sfloat;
     case Format::R32_SFLOAT:
       return vk::Format::eR32Sfloat;
+    case Format::BC1_RGB_UNORM:
+      return vk::Format::eBc1RgbUnormBlock;
+    case Format::BC1_RGB_SRGB:
+      return vk::Format::eBc1RgbSrgbBlock;
+    case Format::BC3_UNORM:
+      return vk::Format::eBc3UnormBlock;
+    case Format::BC3_SRGB:
+      return vk::Format::eBc3SrgbBlock;
+    case Format::BC5_UNORM:
+      return vk::Format::eBc5UnormBlock;
+    case Format::BC7_UNORM:
+      return vk::Format::eBc7UnormBlock;
+    case Format::BC7_SRGB:
+      return vk::Format::eBc7SrgbBlock;
     case Format::D16_UNORM:
       return vk::Format::eD16Unorm;
     case Format::D16_UNORM_S8:
@@ -185,6 +231,28 @@ vk::CompareOp ToVulkan(MaterialBuilderData::CompareOp depthCompareOp) {
   MAPLE_FATAL("failed to find CompareOp");
 }
 
+vk::CompareOp ToVulkan(CompareOp compareOp) {
+  switch (compareOp) {
+    case CompareOp::Never:
+      return vk::CompareOp::eNever;
+    case CompareOp::Less:
+      return vk::CompareOp::eLess;
+    case CompareOp::Equal:
+      return vk::CompareOp::eEqual;
+    case CompareOp::LessOrEqual:
+      return vk::CompareOp::eLessOrEqual;
+    case CompareOp::Greater:
+      return vk::CompareOp::eGreater;
+    case CompareOp::NotEqual:
+      return vk::CompareOp::eNotEqual;
+    case CompareOp::GreaterOrEqual:
+      return vk::CompareOp::eGreaterOrEqual;
+    case CompareOp::Always:
+      return vk::CompareOp::eAlways;
+  }
+  MAPLE_FATAL("failed to find CompareOp");
+}
+
 vk::Filter ToVulkan(SamplerFilter filter) {
   switch (filter) {
     case maple::SamplerFilter::Nearest:
@@ -160,11 +160,9 @@ struct VulkanPhysicalDevice {
 
     features.chain = device.getFeatures2<vk::PhysicalDeviceFeatures2,
                                          vk::PhysicalDeviceVulkan11Features,
+                                         vk::PhysicalDeviceVulkan12Features,
                                          vk::PhysicalDeviceVulkan13Features,
-                                         vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
-                                         vk::PhysicalDeviceBufferDeviceAddressFeatures,
-                                         vk::PhysicalDeviceDescriptorIndexingFeatures,
-                                         vk::PhysicalDeviceScalarBlockLayoutFeatures>();
+                                         vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>();
 
     if (!features.supports(featureMask)) return false;
 
@@ -35,7 +35,8 @@ namespace maple {
 static std::vector<const char*> requiredDeviceExtensions = {vk::KHRSwapchainExtensionName, vk::KHRBufferDeviceAddressExtensionName};
 auto requiredFeatures = DeviceFeature::SamplerAnisotropy | DeviceFeature::ShaderDrawParameters | DeviceFeature::Synchronization2 |
   DeviceFeature::DynamicRendering | DeviceFeature::ExtendedDynamicState | DeviceFeature::BufferDeviceAddress | DeviceFeature::DescriptorIndexing |
-  DeviceFeature::ShaderInt64 | DeviceFeature::ScalarBlockLayout;
+  DeviceFeature::ShaderInt64 | DeviceFeature::ScalarBlockLayout | DeviceFeature::TimelineSemaphore |
+  DeviceFeature::DescriptorUpdateAfterBind | DeviceFeature::DrawIndirectCount | DeviceFeature::StorageImageWithoutFormat;
 
 void VkRendererCtx::Init(const std::vector<const char*>& glfwExtensions, SurfaceCreateCallback surfaceCallback, FrameBufferSizeCallback fbCallback) {
   mFrameBufferSizeCallback = fbCallback;
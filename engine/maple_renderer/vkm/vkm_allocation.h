@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "log_macros.h"
+#include "vkm/vkm_tlsf.h"
+
+namespace vkm {
+class MemoryHeap;
+
+// A range of device memory, either sub-allocated from a shared block or a dedicated vkAllocateMemory for large resources.
+// Returns its range to the MemoryHeap it came from when destroyed.
+class Allocation {
+ public:
+  Allocation() = default;
+  Allocation(Allocation&& other) noexcept { *this = std::move(other); }
+  Allocation& operator=(Allocation&& other) noexcept;
+  Allocation(const Allocation&) = delete;
+  Allocation& operator=(const Allocation&) = delete;
+  ~Allocation() { release(); }
+
+  vk::DeviceMemory Memory() const { return mMemory; }
+  VkDeviceSize Offset() const { return mOffset; }
+  VkDeviceSize Size() const { return mSize; }
+  void* Mapped() const { return mMapped; }
+  bool IsDedicated() const { return *mDedicated != nullptr; }
+  explicit operator bool() const { return mMemory != nullptr; }
+
+ private:
+  friend class MemoryHeap;
+
+  MemoryHeap* mHeap = nullptr;
+  vk::DeviceMemory mMemory = nullptr;
+  VkDeviceSize mOffset = 0;
+  VkDeviceSize mSize = 0;
+  VkDeviceSize mAlignment = 1;
+  void* mMapped = nullptr;
+
+  uint32_t mPool = 0;
+  uint32_t mBlock = 0;
+  Tlsf::NodeIdx mNode = Tlsf::INVALID_NODE;
+  vk::raii::DeviceMemory mDedicated = nullptr;
+
+  void release();
+};
+
+// Owns every VkDeviceMemory the renderer allocates. Resources are grouped into pools by memory type and by whether they
+// are linear (buffers) or optimal tiling (images), keeping buffer/image granularity out of the picture.
+// Each pool is a list of large blocks sub-allocated with a TLSF allocator.
+class MemoryHeap {
+ public:
+  enum class ResourceKind : uint8_t { Linear, Optimal };
+
+  struct Stats {
+    uint32_t deviceAllocationCount = 0;  // live vkAllocateMemory calls, blocks + dedicated allocations
+    uint32_t blockCount = 0;
+    uint32_t dedicatedAllocationCount = 0;
+    uint32_t allocationCount = 0;  // live sub-allocations, excluding dedicated ones
+    VkDeviceSize blockBytes = 0;   // memory reserved by blocks
+    VkDeviceSize usedBytes = 0;    // of blockBytes, the amount handed out
+    VkDeviceSize dedicatedBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+  };
+
+  // Called for each allocation the defragmenter wants to relocate. `destination` is a fresh allocation in a fuller block,
+  // the callback must copy the resource's contents, re-create/rebind it to `destination` and take ownership of it.
+  // Return false to leave the allocation where it is.
+  using DefragmentCallback = std::function<bool(Allocation& current, Allocation&& destination)>;
+
+  static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+  MemoryHeap(const vk::raii::Device& device, const vk::PhysicalDeviceMemoryProperties& properties) : mDevice(&device), mProperties(properties) {}
+  MemoryHeap(const MemoryHeap&) = delete;
+  MemoryHeap& operator=(const MemoryHeap&) = delete;
+
+  [[nodiscard]]
+  Allocation Allocate(const vk::MemoryRequirements& requirements, uint32_t memoryTypeIdx, ResourceKind kind, bool deviceAddress) {
+    std::scoped_lock lock(mMutex);
+
+    auto blockSize = preferredBlockSize(memoryTypeIdx);
+    if (requirements.size > blockSize / 2) return allocateDedicated(requirements, memoryTypeIdx, deviceAddress);
+
+    uint32_t poolIdx = memoryTypeIdx * 2 + static_cast<uint32_t>(kind);
+    auto& pool = mPools[poolIdx];
+
+    Allocation result;
+    if (tryAllocate(poolIdx, 0, static_cast<uint32_t>(pool.blocks.size()), requirements.size, requirements.alignment, result)) return result;
+
+    // no space in the existing blocks, reuse an empty slot or append a new block
+    uint32_t blockIdx = static_cast<uint32_t>(pool.blocks.size());
+    for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+      if (!pool.blocks[i]) {
+        blockIdx = i;
+        break;
+      }
+    }
+    if (blockIdx == pool.blocks.size()) pool.blocks.emplace_back();
+    // linear blocks always get the device address flag, bindless meshes need it and it is free to set on the rest
+    pool.blocks[blockIdx] = createBlock(blockSize, memoryTypeIdx, kind == ResourceKind::Linear);
+
+    if (!tryAllocate(poolIdx, blockIdx, blockIdx + 1, requirements.size, requirements.alignment, result))
+      MAPLE_FATAL("failed to sub-allocate {} bytes from a fresh memory block", requirements.size);
+    return result;
+  }
+
+  Stats GetStats() const {
+    std::scoped_lock lock(mMutex);
+    Stats stats{.deviceAllocationCount = mDedicatedCount, .dedicatedAllocationCount = mDedicatedCount, .dedicatedBytes = mDedicatedBytes};
+    for (const auto& pool : mPools) {
+      for (const auto& block : pool.blocks) {
+        if (!block) continue;
+        auto blockStats = block->tlsf.GetStats();
+        stats.deviceAllocationCount++;
+        stats.blockCount++;
+        stats.allocationCount += blockStats.allocationCount;
+        stats.blockBytes += blockStats.size;
+        stats.usedBytes += blockStats.usedBytes;
+        stats.largestFreeRange = std::max(stats.largestFreeRange, blockStats.largestFreeRange);
+      }
+    }
+    return stats;
+  }
+
+  // Frees blocks with no live allocations, keeping at most one empty block per pool around to absorb churn
+  void ReleaseEmptyBlocks() {
+    std::scoped_lock lock(mMutex);
+    for (auto& pool : mPools) {
+      bool keptOne = false;
+      for (auto& block : pool.blocks) {
+        if (!block || !block->tlsf.Empty()) continue;
+        if (!keptOne) {
+          keptOne = true;
+          continue;
+        }
+        block.reset();
+      }
+    }
+  }
+
+  // Tries to empty the last blocks of each pool by moving their allocations into free space of earlier blocks.
+  // Returns the number of bytes moved. The GPU must not be using the moved resources while the callback runs.
+  VkDeviceSize Defragment(const DefragmentCallback& callback, VkDeviceSize maxBytesToMove = UINT64_MAX) {
+    VkDeviceSize moved = 0;
+    for (uint32_t poolIdx = 0; poolIdx < mPools.size(); poolIdx++) {
+      auto& pool = mPools[poolIdx];
+      for (uint32_t blockIdx = static_cast<uint32_t>(pool.blocks.size()); blockIdx-- > 1;) {
+        std::vector<Allocation*> candidates;
+        {
+          std::scoped_lock lock(mMutex);
+          if (!pool.blocks[blockIdx]) continue;
+          for (auto* owner : pool.blocks[blockIdx]->owners)
+            if (owner) candidates.push_back(owner);
+        }
+
+        for (auto* current : candidates) {
+          if (moved + current->mSize > maxBytesToMove) return moved;
+
+          Allocation destination;
+          {
+            std::scoped_lock lock(mMutex);
+            if (!tryAllocate(poolIdx, 0, blockIdx, current->mSize, current->mAlignment, destination)) continue;
+          }
+
+          VkDeviceSize size = current->mSize;
+          if (callback(*current, std::move(destination))) moved += size;
+        }
+      }
+    }
+
+    ReleaseEmptyBlocks();
+    return moved;
+  }
+
+ private:
+  friend class Allocation;
+
+  struct Block {
+    vk::raii::DeviceMemory memory = nullptr;
+    void* mapped = nullptr;
+    Tlsf tlsf;
+    std::vector<Allocation*> owners;  // indexed by tlsf node, used to find allocations to relocate when defragmenting
+  };
+
+  struct Pool {
+    std::vector<std::unique_ptr<Block>> blocks;
+  };
+
+  const vk::raii::Device* mDevice = nullptr;
+  vk::PhysicalDeviceMemoryProperties mProperties;
+  std::array<Pool, VK_MAX_MEMORY_TYPES * 2> mPools;
+  uint32_t mDedicatedCount = 0;
+  VkDeviceSize mDedicatedBytes = 0;
+  mutable std::recursive_mutex mMutex;
+
+  bool isHostVisible(uint32_t memoryTypeIdx) const {
+    return static_cast<bool>(mProperties.memoryTypes[memoryTypeIdx].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+  }
+
+  VkDeviceSize preferredBlockSize(uint32_t memoryTypeIdx) const {
+    // small heaps (e.g. the 256MB BAR heap) would be exhausted by a few 64MB blocks
+    auto heapSize = mProperties.memoryHeaps[mProperties.memoryTypes[memoryTypeIdx].heapIndex].size;
+    return heapSize <= 1024ull * 1024 * 1024 ? std::min(DEFAULT_BLOCK_SIZE, heapSize / 8) : DEFAULT_BLOCK_SIZE;
+  }
+
+  vk::raii::DeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryTypeIdx, bool deviceAddress) const {
+    vk::MemoryAllocateFlagsInfo flagsInfo{.flags = vk::MemoryAllocateFlagBits::eDeviceAddress};
+    return vk::raii::DeviceMemory(*mDevice,
+                                  vk::MemoryAllocateInfo{
+                                    .pNext = deviceAddress ? &flagsInfo : nullptr,
+                                    .allocationSize = size,
+                                    .memoryTypeIndex = memoryTypeIdx,
+                                  });
+  }
+
+  std::unique_ptr<Block> createBlock(VkDeviceSize size, uint32_t memoryTypeIdx, bool deviceAddress) {
+    auto block = std::make_unique<Block>();
+    block->memory = allocateMemory(size, memoryTypeIdx, deviceAddress);
+    block->tlsf = Tlsf(size);
+    // host visible blocks are mapped once for their whole lifetime, sub-allocations just offset into it
+    if (isHostVisible(memoryTypeIdx)) block->mapped = block->memory.mapMemory(0, VK_WHOLE_SIZE);
+    return block;
+  }
+
+  Allocation allocateDedicated(const vk::MemoryRequirements& requirements, uint32_t memoryTypeIdx, bool deviceAddress) {
+    Allocation result;
+    result.mHeap = this;
+    result.mDedicated = allocateMemory(requirements.size, memoryTypeIdx, deviceAddress);
+    result.mMemory = *result.mDedicated;
+    result.mSize = requirements.size;
+    result.mAlignment = requirements.alignment;
+    if (isHostVisible(memoryTypeIdx)) result.mMapped = result.mDedicated.mapMemory(0, VK_WHOLE_SIZE);
+
+    mDedicatedCount++;
+    mDedicatedBytes += requirements.size;
+    return result;
+  }
+
+  // first fit over blocks [firstBlock, lastBlock) of a pool, expects mMutex to be held
+  bool tryAllocate(uint32_t poolIdx, uint32_t firstBlock, uint32_t lastBlock, VkDeviceSize size, VkDeviceSize alignment, Allocation& out) {
+    auto& pool = mPools[poolIdx];
+    for (uint32_t blockIdx = firstBlock; blockIdx < lastBlock; blockIdx++) {
+      auto& block = pool.blocks[blockIdx];
+      if (!block) continue;
+
+      auto range = block->tlsf.Allocate(size, alignment);
+      if (!range.has_value()) continue;
+
+      out.mHeap = this;
+      out.mMemory = *block->memory;
+      out.mOffset = range->offset;
+      out.mSize = size;
+      out.mAlignment = alignment;
+      out.mMapped = block->mapped ? static_cast<std::byte*>(block->mapped) + range->offset : nullptr;
+      out.mPool = poolIdx;
+      out.mBlock = blockIdx;
+      out.mNode = range->node;
+
+      if (block->owners.size() <= range->node) block->owners.resize(range->node + 1, nullptr);
+      block->owners[range->node] = &out;
+      return true;
+    }
+    return false;
+  }
+
+  void free(Allocation& allocation) {
+    std::scoped_lock lock(mMutex);
+    if (allocation.IsDedicated()) {
+      mDedicatedCount--;
+      mDedicatedBytes -= allocation.mSize;
+      return;
+    }
+
+    auto& block = mPools[allocation.mPool].blocks[allocation.mBlock];
+    block->owners[allocation.mNode] = nullptr;
+    block->tlsf.Free(allocation.mNode);
+  }
+
+  void retarget(Allocation& allocation) {
+    if (allocation.IsDedicated()) return;
+    std::scoped_lock lock(mMutex);
+    mPools[allocation.mPool].blocks[allocation.mBlock]->owners[allocation.mNode] = &allocation;
+  }
+};
+
+inline Allocation& Allocation::operator=(Allocation&& other) noexcept {
+  if (this == &other) return *this;
+  release();
+
+  mHeap = std::exchange(other.mHeap, nullptr);
+  mMemory = std::exchange(other.mMemory, nullptr);
+  mOffset = std::exchange(other.mOffset, 0);
+  mSize = std::exchange(other.mSize, 0);
+  mAlignment = std::exchange(other.mAlignment, 1);
+  mMapped = std::exchange(other.mMapped, nullptr);
+  mPool = std::exchange(other.mPool, 0);
+  mBlock = std::exchange(other.mBlock, 0);
+  mNode = std::exchange(other.mNode, Tlsf::INVALID_NODE);
+  mDedicated = std::move(other.mDedicated);
+
+  if (mHeap) mHeap->retarget(*this);
+  return *this;
+}
+
+inline void Allocation::release() {
+  if (!mHeap) return;
+  mHeap->free(*this);
+  mHeap = nullptr;
+  mMemory = nullptr;
+  mMapped = nullptr;
+  mNode = Tlsf::INVALID_NODE;
+  mDedicated = nullptr;  // frees dedicated memory, sub-allocations just go back to their block
+}
+}  // namespace vkm
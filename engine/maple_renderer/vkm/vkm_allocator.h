@@ -1,29 +1,36 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <utility>
 #include <vulkan/vulkan_raii.hpp>
 
+#include "log_macros.h"
+#include "vkm/vkm_allocation.h"
 #include "vkm/vkm_buffer.h"
 #include "vkm/vkm_image.h"
-#include "log_macros.h"
 
 namespace vkm {
 
 class Allocator {
  public:
   Allocator() : device(nullptr), physicalDevice(nullptr) {}
-  Allocator(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice) : device(&device), physicalDevice(&physicalDevice) {}
+  Allocator(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice)
+      : device(&device),
+        physicalDevice(&physicalDevice),
+        memoryProperties(physicalDevice.getMemoryProperties()),
+        heap(std::make_unique<MemoryHeap>(device, memoryProperties)) {}
 
   enum BufType {
     Mesh,
     UBO,
     SSBO,
     Stage,
+    Indirect,  // device local storage buffer written by compute and consumed as indirect draw arguments
   };
 
   [[nodiscard]]
-  Buffer CreateBuffer(uint32_t size, BufType type, vk::SharingMode sharingMode = vk::SharingMode::eExclusive) {
+  Buffer CreateBuffer(vk::DeviceSize size, BufType type, vk::SharingMode sharingMode = vk::SharingMode::eExclusive) {
     auto [bufferUsageFlags, memoryPropertyFlags] = vkBufferUsageFlagBitsFromBufType(type);
 
     vk::raii::Buffer buffer(*device,
@@ -33,18 +40,17 @@ class Allocator {
                               .sharingMode = sharingMode,
                             });
 
-    auto memTypeIdx = findProperties(physicalDevice->getMemoryProperties(), buffer.getMemoryRequirements().memoryTypeBits, memoryPropertyFlags);
+    auto memRequirements = buffer.getMemoryRequirements();
+    auto memTypeIdx = findProperties(memoryProperties, memRequirements.memoryTypeBits, memoryPropertyFlags);
     if (memTypeIdx == -1) MAPLE_FATAL("failed to find required memory type idx");
-    VkMemoryAllocateFlagsInfo next{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
-    next.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
-    vk::raii::DeviceMemory memory(*device,
-                                  vk::MemoryAllocateInfo{
-                                    .pNext = (bufferUsageFlags & vk::BufferUsageFlagBits::eShaderDeviceAddress) ? &next : nullptr,
-                                    .allocationSize = buffer.getMemoryRequirements().size,
-                                    .memoryTypeIndex = static_cast<uint32_t>(memTypeIdx),
-                                  });
-    buffer.bindMemory(memory, 0);
-    return {.buffer = std::move(buffer), .memory = std::move(memory), .size = size};
+
+    bool deviceAddress = static_cast<bool>(bufferUsageFlags & vk::BufferUsageFlagBits::eShaderDeviceAddress);
+    auto memory = heap->Allocate(memRequirements, static_cast<uint32_t>(memTypeIdx), MemoryHeap::ResourceKind::Linear, deviceAddress);
+    buffer.bindMemory(memory.Memory(), memory.Offset());
+
+    // host visible memory blocks stay mapped for their whole lifetime, writes go straight through Buffer::mapped
+    void* mapped = memory.Mapped();
+    return {.buffer = std::move(buffer), .memory = std::move(memory), .size = size, .mapped = mapped};
   }
 
   struct ImageCreateInfo {
@@ -64,45 +70,68 @@ class Allocator {
 
   [[nodiscard]]
   Image CreateImage(const ImageCreateInfo& info) {
-    vk::raii::Image img(*device,
-                        vk::ImageCreateInfo{
-                          .imageType = info.imageType,
-                          .format = info.format,
-                          .extent = info.extent,
-                          .mipLevels = info.mipLevels,
-                          .arrayLayers = info.arrayLayers,
-                          .samples = info.samples,
-                          .tiling = info.tiling,
-                          .usage = info.usage,
-                          .sharingMode = info.sharingMode,
-                          .initialLayout = info.initialLayout,
-                        });
+    auto img = CreateUnboundImage(info);
+    auto memory = AllocateImageMemory(img.getMemoryRequirements(), vk::MemoryPropertyFlagBits::eDeviceLocal);
+    if (!memory) MAPLE_FATAL("failed to find required memory type idx");
+    img.bindMemory(memory.Memory(), memory.Offset());
+
+    auto view = CreateImageView(img, info);
+    return {.img = std::move(img), .memory = std::move(memory), .view = std::move(view), .extent = info.extent, .mipLevels = info.mipLevels};
+  }
+
+  // Image without memory bound, for callers placing several images into the same memory (e.g. aliased render targets)
+  [[nodiscard]]
+  vk::raii::Image CreateUnboundImage(const ImageCreateInfo& info) {
     // TODO: add vkGetPhysicalDeviceFormatProperties format checks
-    auto memRequirements = img.getMemoryRequirements();
-    auto memoryTypeIdx =
-      findProperties(physicalDevice->getMemoryProperties(), memRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-    if (memoryTypeIdx == -1) MAPLE_FATAL("failed to find required memory type idx");
+    return vk::raii::Image(*device,
+                           vk::ImageCreateInfo{
+                             .imageType = info.imageType,
+                             .format = info.format,
+                             .extent = info.extent,
+                             .mipLevels = info.mipLevels,
+                             .arrayLayers = info.arrayLayers,
+                             .samples = info.samples,
+                             .tiling = info.tiling,
+                             .usage = info.usage,
+                             .sharingMode = info.sharingMode,
+                             .initialLayout = info.initialLayout,
+                           });
+  }
+
+  // Returns an empty Allocation if none of the allowed memory types has `properties`
+  [[nodiscard]]
+  Allocation AllocateImageMemory(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties) {
+    auto memoryTypeIdx = findProperties(memoryProperties, requirements.memoryTypeBits, properties);
+    if (memoryTypeIdx == -1) return {};
 
-    vk::raii::DeviceMemory memory(
-      *device, vk::MemoryAllocateInfo{.allocationSize = memRequirements.size, .memoryTypeIndex = static_cast<uint32_t>(memoryTypeIdx)});
-    img.bindMemory(memory, 0);
+    return heap->Allocate(requirements, static_cast<uint32_t>(memoryTypeIdx), MemoryHeap::ResourceKind::Optimal, false);
+  }
 
+  [[nodiscard]]
+  vk::raii::ImageView CreateImageView(const vk::raii::Image& img, const ImageCreateInfo& info) {
     vk::ImageSubresourceRange subresourceRange{
       .aspectMask = info.aspectMask,
       .baseMipLevel = 0,
-      .levelCount = 1,
+      .levelCount = info.mipLevels,
       .baseArrayLayer = 0,
       .layerCount = 1,
     };
-    vk::raii::ImageView view(
+    return vk::raii::ImageView(
       *device,
       vk::ImageViewCreateInfo{.image = img, .viewType = vk::ImageViewType::e2D, .format = info.format, .subresourceRange = subresourceRange});
-    return {.img = std::move(img), .memory = std::move(memory), .view = std::move(view), .extent = info.extent};
+  }
+
+  MemoryHeap::Stats GetStats() const { return heap->GetStats(); }
+  void ReleaseEmptyBlocks() { heap->ReleaseEmptyBlocks(); }
+  VkDeviceSize Defragment(const MemoryHeap::DefragmentCallback& callback, VkDeviceSize maxBytesToMove = UINT64_MAX) {
+    return heap->Defragment(callback, maxBytesToMove);
   }
 
  private:
   const vk::raii::Device* device = nullptr;
   const vk::raii::PhysicalDevice* physicalDevice = nullptr;
+  vk::PhysicalDeviceMemoryProperties memoryProperties;
+  std::unique_ptr<MemoryHeap> heap;  // heap allocated so live Allocations keep a stable pointer when the Allocator is moved
 
   static std::pair<vk::BufferUsageFlags, vk::MemoryPropertyFlags> vkBufferUsageFlagBitsFromBufType(BufType t) {
     vk::MemoryPropertyFlags mappableMemFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
@@ -118,6 +147,9 @@ class Allocator {
         return {vk::BufferUsageFlagBits::eStorageBuffer, mappableMemFlags};
       case Stage:
         return {vk::BufferUsageFlagBits::eTransferSrc, mappableMemFlags};
+      case Indirect:
+        return {vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                deviceLocalMemFlags};
       default:
         MAPLE_FATAL("unknown mvk allocator BufType");
     }
@@ -1,23 +1,27 @@
 #pragma once
+#include <cstring>
 #include <vulkan/vulkan_raii.hpp>
 
 #include "log_macros.h"
+#include "vkm/vkm_allocation.h"
 
 namespace vkm {
 
 struct Buffer {
   vk::raii::Buffer buffer = nullptr;
-  vk::raii::DeviceMemory memory = nullptr;
+  Allocation memory;
   VkDeviceSize size = 0;
+  void* mapped = nullptr;  // persistently mapped host pointer, null for device local buffers
 
   // Convenience: copy data into buffer
   void Upload(const void* src, VkDeviceSize bytes, VkDeviceSize offset = 0) {
     MAPLE_ASSERT(offset + bytes <= size, "Upload size exceeds buffer");
-    void* dst = memory.mapMemory(0, size);
-    std::memcpy(static_cast<char*>(dst) + offset, src, static_cast<size_t>(bytes));
-    memory.unmapMemory();
+    if (!mapped) MAPLE_FATAL("Upload requires a host visible buffer");
+    std::memcpy(static_cast<char*>(mapped) + offset, src, static_cast<size_t>(bytes));
   }
 
+  bool IsMapped() const { return mapped != nullptr; }
+
   struct CopyRegion {
     VkDeviceSize size;
     VkDeviceSize srcOffset = 0;
@@ -30,4 +34,4 @@ struct Buffer {
   }
 };
 
-};  // namespace vkm
\ No newline at end of file
+};  // namespace vkm
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "vkm/vkm_pipeline_layout.h"
+
+namespace vkm {
+class ComputePipeline {
+ public:
+  struct CreateInfo {
+    const vk::raii::Device& device;
+    const vkm::PipelineLayout& layout;
+    std::span<const uint8_t> shaderCode;
+    const std::string& entryFuncName;
+    vk::PipelineCache cache = nullptr;
+  };
+
+  ComputePipeline() = default;
+  ComputePipeline(const CreateInfo& info) {
+    vk::raii::ShaderModule shaderModule(info.device,
+                                        vk::ShaderModuleCreateInfo{
+                                          .codeSize = info.shaderCode.size(),
+                                          .pCode = reinterpret_cast<const uint32_t*>(info.shaderCode.data()),
+                                        });
+
+    vk::ComputePipelineCreateInfo pipelineInfo{
+      .stage = {.stage = vk::ShaderStageFlagBits::eCompute, .module = shaderModule, .pName = info.entryFuncName.c_str()},
+      .layout = info.layout.GetLayout(),
+    };
+
+    pipeline = vk::raii::Pipeline(info.device, info.cache, pipelineInfo);
+  }
+
+  const vk::raii::Pipeline& GetPipeline() const { return pipeline; }
+  vk::raii::Pipeline& GetPipeline() { return pipeline; }
+
+ private:
+  vk::raii::Pipeline pipeline = nullptr;
+};
+}  // namespace vkm
@@ -13,6 +13,7 @@ struct DescriptorPool {
     uint32_t maxSets;
     const std::vector<std::pair<vk::DescriptorType, uint32_t>>& resourceSizes;
     bool freeDescriptorSet = true;
+    bool updateAfterBind = false;  // required to allocate sets whose layout has update-after-bind bindings
   };
 
   DescriptorPool() : pool(nullptr) {}
@@ -22,10 +23,13 @@ struct DescriptorPool {
     for (const auto& v : info.resourceSizes) {
       poolSizes.push_back(vk::DescriptorPoolSize(v.first, v.second));
     }
+    vk::DescriptorPoolCreateFlags flags{};
+    if (info.freeDescriptorSet) flags |= vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    if (info.updateAfterBind) flags |= vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
     pool = vk::raii::DescriptorPool(
       info.device,
       vk::DescriptorPoolCreateInfo{
-        .flags = info.freeDescriptorSet ? vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet : (vk::DescriptorPoolCreateFlagBits)0,
+        .flags = flags,
         .maxSets = info.maxSets,
         .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
         .pPoolSizes = poolSizes.data(),
@@ -17,6 +17,9 @@ struct DescriptorSets {
     Uniform,
     SSBO,
     CombinedImageSampler,
+    SampledImage,
+    Sampler,
+    StorageImage,
   };
 
   vk::raii::DescriptorSetLayout layout;
@@ -28,6 +31,7 @@ struct DescriptorSets {
     Type type;
     maple::ShaderStage usedStages;
     uint16_t arrayCount = 1;
+    vk::DescriptorBindingFlags bindingFlags = {};  // e.g. partially bound / update after bind for bindless arrays
   };
 
   struct CreateInfo {
@@ -40,7 +44,26 @@ struct DescriptorSets {
   DescriptorSets() : layout(nullptr) {}
   DescriptorSets(const CreateInfo& info) : layout(nullptr) {
     auto vkFormat = layoutToVk(info.description);
-    vk::DescriptorSetLayoutCreateInfo layoutInfo{.bindingCount = static_cast<uint32_t>(vkFormat.size()), .pBindings = vkFormat.data()};
+
+    std::vector<vk::DescriptorBindingFlags> bindingFlags;
+    bindingFlags.reserve(info.description.size());
+    vk::DescriptorBindingFlags allFlags{};
+    for (const auto& v : info.description) {
+      bindingFlags.push_back(v.bindingFlags);
+      allFlags |= v.bindingFlags;
+    }
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{
+      .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+      .pBindingFlags = bindingFlags.data(),
+    };
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{
+      .pNext = allFlags ? &bindingFlagsInfo : nullptr,
+      .flags = (allFlags & vk::DescriptorBindingFlagBits::eUpdateAfterBind) ? vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool
+                                                                             : vk::DescriptorSetLayoutCreateFlags{},
+      .bindingCount = static_cast<uint32_t>(vkFormat.size()),
+      .pBindings = vkFormat.data(),
+    };
 
     layout = vk::raii::DescriptorSetLayout(info.device, layoutInfo);
 
@@ -84,6 +107,12 @@ struct DescriptorSets {
         return vk::DescriptorType::eStorageBuffer;
       case Type::CombinedImageSampler:
         return vk::DescriptorType::eCombinedImageSampler;
+      case Type::SampledImage:
+        return vk::DescriptorType::eSampledImage;
+      case Type::Sampler:
+        return vk::DescriptorType::eSampler;
+      case Type::StorageImage:
+        return vk::DescriptorType::eStorageImage;
       default:
         MAPLE_FATAL("unknown vk::DescriptorType for descriptor set");
     }
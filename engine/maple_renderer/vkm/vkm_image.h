@@ -3,13 +3,15 @@
 #include <vulkan/vulkan_raii.hpp>
 
 #include "log_macros.h"
+#include "vkm/vkm_allocation.h"
 
 namespace vkm {
 struct Image {
   vk::raii::Image img = nullptr;
-  vk::raii::DeviceMemory memory = nullptr;
+  Allocation memory;
   vk::raii::ImageView view = nullptr;
   vk::Extent3D extent;
+  uint32_t mipLevels = 1;
 
   // Helper: transition image layout (requires command buffer)
   void TransitionLayout(const vk::raii::CommandBuffer& cmd,
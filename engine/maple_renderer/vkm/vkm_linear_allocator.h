@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "log_macros.h"
+#include "vkm/vkm_buffer.h"
+
+namespace vkm {
+// Bump allocator over a persistently mapped buffer.
+// One is kept per frame in flight and reset once that frame's fence has signaled,
+// so together they form a ring where the CPU writes per-frame data directly into GPU visible memory.
+class LinearAllocator {
+ public:
+  template <typename T>
+  struct Allocation {
+    std::span<T> data;
+    VkDeviceSize offset = 0;  // byte offset from the start of the buffer
+
+    // index of the first element, when the buffer is viewed as an array of T
+    uint32_t Index() const { return static_cast<uint32_t>(offset / sizeof(T)); }
+  };
+
+  LinearAllocator() = default;
+  explicit LinearAllocator(Buffer& buffer) : mBuffer(&buffer) {
+    MAPLE_ASSERT(buffer.IsMapped(), "linear allocator requires a persistently mapped buffer");
+  }
+
+  // Reserve `count` elements of T, the returned offset is always a multiple of sizeof(T)
+  template <typename T>
+  [[nodiscard]]
+  Allocation<T> Allocate(size_t count) {
+    VkDeviceSize offset = (mHead + sizeof(T) - 1) / sizeof(T) * sizeof(T);
+    VkDeviceSize bytes = count * sizeof(T);
+    if (offset + bytes > mBuffer->size) MAPLE_FATAL("linear allocator out of memory, requested {} bytes with {} remaining", bytes, Remaining());
+
+    mHead = offset + bytes;
+    return {.data = std::span<T>(reinterpret_cast<T*>(static_cast<std::byte*>(mBuffer->mapped) + offset), count), .offset = offset};
+  }
+
+  void Reset() { mHead = 0; }
+
+  VkDeviceSize Used() const { return mHead; }
+  VkDeviceSize Remaining() const { return mBuffer->size - mHead; }
+
+ private:
+  Buffer* mBuffer = nullptr;
+  VkDeviceSize mHead = 0;
+};
+}  // namespace vkm
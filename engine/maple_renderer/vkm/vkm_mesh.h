@@ -1,28 +1,72 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <glm/glm.hpp>
+
 #include "mesh_data.h"
 #include "vkm/vkm_allocator.h"
 
 namespace vkm {
 class Mesh {
  public:
+  // range of a LOD in the index data
+  struct Lod {
+    uint32_t firstIndex = 0;
+    uint32_t numIndices = 0;
+    float error = 0.0f;  // object space
+  };
+
   vkm::Buffer meshBuffer;
+  uint64_t uploadTicket = 0;  // ticket of the upload that fills meshBuffer
+  glm::vec4 boundingSphere{};  // object space center & radius
+  maple::VertexQuantization quantization;  // decodes the positions of compressed vertices, see vertex_compression.h
 
   Mesh() = default;
   Mesh(Allocator& allocator, const maple::MeshData& mesh) {
-    meshBuffer =
-      allocator.CreateBuffer(mesh.verts.size() + mesh.indices.size() * sizeof(decltype(mesh.indices)::value_type), Allocator::BufType::Mesh);
+    MAPLE_ASSERT(mesh.lods.size() < maple::MeshData::MAX_LODS, "mesh has {} LODs, at most {} are supported", mesh.lods.size() + 1, maple::MeshData::MAX_LODS);
     numVerts = mesh.numVerts;
     numIndices = mesh.indices.size();
-    indexBufferOffset = mesh.GetStride() * numVerts;
+    numLods = 1;
+    lods[0] = {.firstIndex = 0, .numIndices = numIndices};
+    for (auto& lod : mesh.lods) {
+      lods[numLods++] = {.firstIndex = numIndices, .numIndices = static_cast<uint32_t>(lod.indices.size()), .error = lod.error};
+      numIndices += lod.indices.size();
+    }
+
+    // 16 bit indices halve the index data whenever every vertex can be addressed with them
+    indexType = numVerts <= UINT16_MAX + 1 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+    // the index data follows the vertices, aligned and padded so shaders can read it as whole uints
+    indexBufferOffset = (mesh.verts.size() + 3) / 4 * 4;
+    // meshlets follow the indices, aligned for the cull shader to read them as structs
+    numMeshlets = mesh.meshlets.size();
+    meshletOffset = (indexBufferOffset + numIndices * GetIndexSize() + 15) / 16 * 16;
+    auto size = numMeshlets > 0 ? meshletOffset + mesh.meshlets.size_bytes() : (indexBufferOffset + numIndices * GetIndexSize() + 3) / 4 * 4;
+    meshBuffer = allocator.CreateBuffer(size, Allocator::BufType::Mesh);
+    boundingSphere = mesh.boundingSphere.has_value() ? mesh.boundingSphere.value() : mesh.ComputeBoundingSphere();
+    quantization = mesh.quantization;
   }
 
   uint32_t GetNumVertices() const { return numVerts; }
-  uint32_t GetNumIndices() const { return numIndices; }
+  uint32_t GetNumIndices() const { return numIndices; }  // of every LOD together
+  uint32_t GetNumLods() const { return numLods; }
+  const Lod& GetLod(uint32_t lod) const { return lods[lod]; }
+
+  // The coarsest LOD whose error stays below one unit when scaled by `errorScale`, e.g. the pixels an object space unit
+  // covers on screen divided by the acceptable error in pixels
+  uint32_t SelectLod(float errorScale) const {
+    uint32_t lod = 0;
+    while (lod + 1 < numLods && lods[lod + 1].error * errorScale <= 1.0f) lod++;
+    return lod;
+  }
   uint32_t GetIndexBufferOffset() const { return indexBufferOffset; }
 
-  static vk::IndexType GetVkIndexType() { return vk::IndexType::eUint32; }
+  // meshlets over the full detail LOD, 0 when the mesh is culled as a whole
+  uint32_t GetNumMeshlets() const { return numMeshlets; }
+  uint32_t GetMeshletOffset() const { return meshletOffset; }  // in bytes from the start of the buffer
+
+  vk::IndexType GetVkIndexType() const { return indexType; }
+  uint32_t GetIndexSize() const { return indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t); }
 
   uint32_t AddRef() { return ++numRefs; }
   uint32_t RemoveRef() { return --numRefs; }
@@ -32,6 +76,11 @@ class Mesh {
   uint32_t numVerts = 0;
   uint32_t numIndices = 0;
   uint32_t indexBufferOffset = 0;
+  uint32_t numMeshlets = 0;
+  uint32_t meshletOffset = 0;
+  std::array<Lod, maple::MeshData::MAX_LODS> lods;
+  uint32_t numLods = 0;
+  vk::IndexType indexType = vk::IndexType::eUint32;
   uint32_t numRefs = 0;
 };
 }  // namespace vkm
\ No newline at end of file
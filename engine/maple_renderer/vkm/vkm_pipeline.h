@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
+#include <span>
+#include <vector>
 #include <vulkan/vulkan_raii.hpp>
 
 #include "material_builder_data.h"
@@ -21,25 +25,159 @@ class Pipeline {
     std::optional<vk::Format> depthFormat;
   };
 
+  // Everything a material's pipeline is built for besides the material itself, materials keep one pipeline per variant
+  struct Variant {
+    AttachmentFormats formats;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+    const maple::MaterialBuilderData::RasterizerState* rasterizerOverride = nullptr;  // replaces the material's rasterizer state
+    // added to the material's, replacing those with the same id
+    std::span<const maple::MaterialBuilderData::SpecializationConstant> specializationConstants;
+
+    // compares what the spans and the override point to
+    bool operator==(const Variant& rhs) const {
+      bool sameRasterizer = rasterizerOverride && rhs.rasterizerOverride ? *rasterizerOverride == *rhs.rasterizerOverride
+                                                                         : rasterizerOverride == rhs.rasterizerOverride;
+      return std::ranges::equal(formats.colorFormats, rhs.formats.colorFormats) && formats.depthFormat == rhs.formats.depthFormat &&
+             samples == rhs.samples && sameRasterizer && std::ranges::equal(specializationConstants, rhs.specializationConstants);
+    }
+
+    // FNV-1a over every field
+    uint64_t Hash() const {
+      uint64_t hash = 14695981039346656037ull;
+      auto add = [&](const auto& value) {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        for (size_t i = 0; i < sizeof(value); i++) {
+          hash ^= bytes[i];
+          hash *= 1099511628211ull;  // FNV-1a prime
+        }
+      };
+
+      add(formats.colorFormats.size());
+      for (auto format : formats.colorFormats) add(format);
+      add(formats.depthFormat.value_or(vk::Format::eUndefined));
+      add(samples);
+      add(rasterizerOverride != nullptr);
+      if (rasterizerOverride) {
+        auto& rasterizer = *rasterizerOverride;
+        add(rasterizer.depthClampEnable);
+        add(rasterizer.rasterizerDiscardEnable);
+        add(rasterizer.polygonMode);
+        add(rasterizer.cullMode);
+        add(rasterizer.frontFace);
+        add(rasterizer.depthBiasEnable);
+      }
+      add(specializationConstants.size());
+      for (auto& constant : specializationConstants) {
+        add(constant.id);
+        add(constant.value);
+      }
+      return hash;
+    }
+  };
+
+  // Owning copy of a Variant, kept next to the pipeline built for it so variants with colliding hashes are told apart
+  struct StoredVariant {
+    std::vector<vk::Format> colorFormats;
+    std::optional<vk::Format> depthFormat;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+    std::optional<maple::MaterialBuilderData::RasterizerState> rasterizerOverride;
+    std::vector<maple::MaterialBuilderData::SpecializationConstant> specializationConstants;
+
+    StoredVariant() = default;
+    explicit StoredVariant(const Variant& variant)
+        : colorFormats(variant.formats.colorFormats.begin(), variant.formats.colorFormats.end()),
+          depthFormat(variant.formats.depthFormat),
+          samples(variant.samples),
+          specializationConstants(variant.specializationConstants.begin(), variant.specializationConstants.end()) {
+      if (variant.rasterizerOverride) rasterizerOverride = *variant.rasterizerOverride;
+    }
+
+    Variant View() const {
+      return {
+        .formats = {.colorFormats = colorFormats, .depthFormat = depthFormat},
+        .samples = samples,
+        .rasterizerOverride = rasterizerOverride ? &*rasterizerOverride : nullptr,
+        .specializationConstants = specializationConstants,
+      };
+    }
+  };
+
   struct CreateInfo {
     const vk::raii::Device& device;
     std::optional<VertexLayoutDescription> vertexLayoutDescription = std::nullopt;
     const vkm::PipelineLayout& layout;
-    AttachmentFormats formats;
+    Variant variant;
 
     const maple::MaterialBuilderData& materialData;
+    vk::PipelineCache cache = nullptr;
   };
 
   Pipeline(const CreateInfo& info) {
     auto shaderModule = createShaderModule(info.device, info.materialData.shaderCode);
 
+    using SpecializationConstant = maple::MaterialBuilderData::SpecializationConstant;
+    std::vector<SpecializationConstant> constants = info.materialData.specializationConstants;
+    for (auto& constant : info.variant.specializationConstants) {
+      auto it = std::ranges::find(constants, constant.id, &SpecializationConstant::id);
+      if (it != constants.end()) {
+        it->value = constant.value;
+      } else {
+        constants.push_back(constant);
+      }
+    }
+
+    std::vector<vk::SpecializationMapEntry> specializationEntries;
+    specializationEntries.reserve(constants.size());
+    for (uint32_t i = 0; i < constants.size(); i++) {
+      specializationEntries.push_back({
+        .constantID = constants[i].id,
+        .offset = static_cast<uint32_t>(i * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value)),
+        .size = sizeof(uint32_t),
+      });
+    }
+    vk::SpecializationInfo specializationInfo{
+      .mapEntryCount = static_cast<uint32_t>(specializationEntries.size()),
+      .pMapEntries = specializationEntries.data(),
+      .dataSize = constants.size() * sizeof(SpecializationConstant),
+      .pData = constants.data(),
+    };
+    auto* specialization = constants.empty() ? nullptr : &specializationInfo;
+
+    // compute materials only use the layout, the attachment formats don't matter to them
+    if (info.materialData.IsCompute()) {
+      vk::ComputePipelineCreateInfo pipelineInfo{
+        .stage =
+          {
+            .stage = vk::ShaderStageFlagBits::eCompute,
+            .module = shaderModule,
+            .pName = info.materialData.computeEntryFuncName.c_str(),
+            .pSpecializationInfo = specialization,
+          },
+        .layout = info.layout.GetLayout(),
+      };
+      pipeline = vk::raii::Pipeline(info.device, info.cache, pipelineInfo);
+      bindPoint = vk::PipelineBindPoint::eCompute;
+      return;
+    }
+
     std::array shaderStages = {
       vk::PipelineShaderStageCreateInfo{
-        .stage = vk::ShaderStageFlagBits::eVertex, .module = shaderModule, .pName = info.materialData.vertEntryFuncName.c_str()},
+        .stage = vk::ShaderStageFlagBits::eVertex,
+        .module = shaderModule,
+        .pName = info.materialData.vertEntryFuncName.c_str(),
+        .pSpecializationInfo = specialization,
+      },
       vk::PipelineShaderStageCreateInfo{
-        .stage = vk::ShaderStageFlagBits::eFragment, .module = shaderModule, .pName = info.materialData.fragEntryFuncName.c_str()},
+        .stage = vk::ShaderStageFlagBits::eFragment,
+        .module = shaderModule,
+        .pName = info.materialData.fragEntryFuncName.c_str(),
+        .pSpecializationInfo = specialization,
+      },
     };
 
+    auto& formats = info.variant.formats;
+    auto& rasterizerState = info.variant.rasterizerOverride ? *info.variant.rasterizerOverride : info.materialData.rasterizer;
+
     auto& vertDesc = info.vertexLayoutDescription;
     bool hasVertDesc = vertDesc.has_value();
 
@@ -51,9 +189,9 @@ class Pipeline {
     };
 
     vk::PipelineRenderingCreateInfo pipelineRenderingCreateInfo{
-      .colorAttachmentCount = static_cast<uint32_t>(info.formats.colorFormats.size()),
-      .pColorAttachmentFormats = info.formats.colorFormats.empty() ? nullptr : info.formats.colorFormats.data(),
-      .depthAttachmentFormat = info.formats.depthFormat.value_or(vk::Format{}),
+      .colorAttachmentCount = static_cast<uint32_t>(formats.colorFormats.size()),
+      .pColorAttachmentFormats = formats.colorFormats.empty() ? nullptr : formats.colorFormats.data(),
+      .depthAttachmentFormat = formats.depthFormat.value_or(vk::Format{}),
     };
 
     vk::PipelineInputAssemblyStateCreateInfo inputAssembly{.topology = vk::PrimitiveTopology::eTriangleList};
@@ -64,37 +202,40 @@ class Pipeline {
     };
 
     vk::PipelineRasterizationStateCreateInfo rasterizer{
-      .depthClampEnable = info.materialData.rasterizer.depthClampEnable,
-      .rasterizerDiscardEnable = info.materialData.rasterizer.rasterizerDiscardEnable,
-      .polygonMode = maple::ToVulkan(info.materialData.rasterizer.polygonMode),
-      .cullMode = maple::ToVulkan(info.materialData.rasterizer.cullMode),
-      .frontFace = maple::ToVulkan(info.materialData.rasterizer.frontFace),
-      .depthBiasEnable = info.materialData.rasterizer.depthBiasEnable,
+      .depthClampEnable = rasterizerState.depthClampEnable,
+      .rasterizerDiscardEnable = rasterizerState.rasterizerDiscardEnable,
+      .polygonMode = maple::ToVulkan(rasterizerState.polygonMode),
+      .cullMode = maple::ToVulkan(rasterizerState.cullMode),
+      .frontFace = maple::ToVulkan(rasterizerState.frontFace),
+      .depthBiasEnable = rasterizerState.depthBiasEnable,
       .depthBiasSlopeFactor = 1.0f,
       .lineWidth = 1.0f,
     };
 
-    vk::PipelineMultisampleStateCreateInfo multisampling{.rasterizationSamples = vk::SampleCountFlagBits::e1, .sampleShadingEnable = vk::False};
+    vk::PipelineMultisampleStateCreateInfo multisampling{.rasterizationSamples = info.variant.samples, .sampleShadingEnable = vk::False};
 
     vk::PipelineDepthStencilStateCreateInfo depthStencil{
-      .depthTestEnable = info.formats.depthFormat.has_value() && info.materialData.depthStencil.depthTest ? vk::True : vk::False,
-      .depthWriteEnable = info.formats.depthFormat.has_value() && info.materialData.depthStencil.depthWrite ? vk::True : vk::False,
+      .depthTestEnable = formats.depthFormat.has_value() && info.materialData.depthStencil.depthTest ? vk::True : vk::False,
+      .depthWriteEnable = formats.depthFormat.has_value() && info.materialData.depthStencil.depthWrite ? vk::True : vk::False,
       .depthCompareOp = maple::ToVulkan(info.materialData.depthStencil.depthCompareOp),
       .depthBoundsTestEnable = info.materialData.depthStencil.depthBoundsTestEnable,
       .stencilTestEnable = info.materialData.depthStencil.stencilTestEnable,
     };
 
-    vk::PipelineColorBlendAttachmentState colorBlendAttachment{
-      .blendEnable = info.materialData.blendingState.blendEnable,
-      .colorWriteMask =
-        vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-    };
+    // one blend state per color attachment of the variant, none for depth only passes
+    std::vector<vk::PipelineColorBlendAttachmentState> colorBlendAttachments(
+      formats.colorFormats.size(),
+      {
+        .blendEnable = info.materialData.blendingState.blendEnable,
+        .colorWriteMask =
+          vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+      });
 
     vk::PipelineColorBlendStateCreateInfo colorBlending{
       .logicOpEnable = vk::False,
       .logicOp = vk::LogicOp::eCopy,
-      .attachmentCount = 1,
-      .pAttachments = &colorBlendAttachment,
+      .attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size()),
+      .pAttachments = colorBlendAttachments.empty() ? nullptr : colorBlendAttachments.data(),
     };
 
     std::vector dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
@@ -119,14 +260,16 @@ class Pipeline {
       .renderPass = nullptr,
     };
 
-    pipeline = vk::raii::Pipeline(info.device, nullptr, pipelineInfo);
+    pipeline = vk::raii::Pipeline(info.device, info.cache, pipelineInfo);
   };
 
   const vk::raii::Pipeline& GetPipeline() const { return pipeline; }
   vk::raii::Pipeline& GetPipeline() { return pipeline; }
+  vk::PipelineBindPoint BindPoint() const { return bindPoint; }
 
  private:
   vk::raii::Pipeline pipeline = nullptr;
+  vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eGraphics;
 
   [[nodiscard]]
   static vk::raii::ShaderModule createShaderModule(const vk::raii::Device& device, std::span<const uint8_t> code) {
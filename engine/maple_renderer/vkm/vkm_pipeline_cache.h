@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "log_macros.h"
+
+namespace vkm {
+// Pipeline cache shared by every pipeline the renderer builds, persisted to a file between runs.
+// The file starts with a header identifying the device and driver that wrote it, a cache written by another GPU or driver
+// version is discarded instead of handed to the driver
+class PipelineCache {
+ public:
+  struct CreateInfo {
+    const vk::raii::Device& device;
+    const vk::PhysicalDeviceProperties& properties;
+    std::filesystem::path path;  // empty to not persist the cache
+  };
+
+  PipelineCache() = default;
+  PipelineCache(const CreateInfo& info) : path(info.path) {
+    header = Header{
+      .vendorID = info.properties.vendorID,
+      .deviceID = info.properties.deviceID,
+      .driverVersion = info.properties.driverVersion,
+    };
+    std::ranges::copy(info.properties.pipelineCacheUUID, header.pipelineCacheUUID);
+
+    auto initialData = Load();
+    cache = vk::raii::PipelineCache(info.device,
+                                    vk::PipelineCacheCreateInfo{
+                                      .initialDataSize = initialData.size(),
+                                      .pInitialData = initialData.empty() ? nullptr : initialData.data(),
+                                    });
+  }
+
+  // Writes the cache to its file, through a temporary file so an interrupted save never leaves a broken cache behind
+  void Save() const {
+    if (path.empty() || cache == nullptr) return;
+
+    auto data = cache.getData();
+    Header fileHeader = header;
+    fileHeader.dataSize = data.size();
+    fileHeader.dataHash = Hash(data);
+
+    std::error_code ec;
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), ec);
+
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    {
+      std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+      file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+      file.write(reinterpret_cast<const char*>(data.data()), data.size());
+      if (!file) {
+        MAPLE_WARN("failed to write pipeline cache {}", tmpPath.string());
+        return;
+      }
+    }
+
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) MAPLE_WARN("failed to write pipeline cache {}: {}", path.string(), ec.message());
+  }
+
+  vk::PipelineCache Get() const { return *cache; }
+
+ private:
+  static constexpr uint32_t MAGIC = 0x4d504c43;  // "MPLC"
+  static constexpr uint32_t VERSION = 1;
+
+  struct Header {
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t vendorID = 0;
+    uint32_t deviceID = 0;
+    uint32_t driverVersion = 0;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
+    uint32_t padding = 0;  // spelled out so the bytes written are always zero
+    uint64_t dataSize = 0;
+    uint64_t dataHash = 0;
+
+    bool SameDevice(const Header& rhs) const {
+      return magic == rhs.magic && version == rhs.version && vendorID == rhs.vendorID && deviceID == rhs.deviceID &&
+             driverVersion == rhs.driverVersion && std::memcmp(pipelineCacheUUID, rhs.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+  };
+  static_assert(std::has_unique_object_representations_v<Header>, "the header is written as is, it can't have implicit padding");
+
+  vk::raii::PipelineCache cache = nullptr;
+  std::filesystem::path path;
+  Header header;
+
+  // FNV-1a, catches a cache truncated or otherwise damaged on disk
+  static uint64_t Hash(std::span<const uint8_t> data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (auto byte : data) {
+      hash ^= byte;
+      hash *= 1099511628211ull;  // FNV-1a prime
+    }
+    return hash;
+  }
+
+  // the cached data, or nothing if there is no usable cache for this device
+  std::vector<uint8_t> Load() const {
+    if (path.empty()) return {};
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return {};
+
+    Header fileHeader{};
+    file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+    if (!file || !fileHeader.SameDevice(header)) {
+      MAPLE_INFO("discarding pipeline cache {}, it was written by another device or driver", path.string());
+      return {};
+    }
+
+    // the size is checked against the file before it is trusted with an allocation
+    std::error_code ec;
+    auto fileSize = std::filesystem::file_size(path, ec);
+    if (ec || fileSize < sizeof(fileHeader) || fileHeader.dataSize != fileSize - sizeof(fileHeader)) {
+      MAPLE_WARN("discarding damaged pipeline cache {}", path.string());
+      return {};
+    }
+
+    std::vector<uint8_t> data(fileHeader.dataSize);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (!file || Hash(data) != fileHeader.dataHash) {
+      MAPLE_WARN("discarding damaged pipeline cache {}", path.string());
+      return {};
+    }
+    return data;
+  }
+};
+}  // namespace vkm
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <vulkan/vulkan_raii.hpp>
 
 namespace vkm {
@@ -19,14 +21,46 @@ class Sampler {
     vk::Bool32 compareEnable = vk::False;
     vk::CompareOp compareOp = vk::CompareOp::eAlways;
     float minLod = 0.0f;
-    float maxLod = 1.0f;
+    float maxLod = VK_LOD_CLAMP_NONE;  // every mip level the image view has
     vk::BorderColor borderColor = vk::BorderColor::eIntOpaqueBlack;
     vk::Bool32 unnormalizedCoordinates = vk::False;
+
+    bool operator==(const Info&) const = default;
   };
 
-  // static uint64_t HashInfo(const Info& info) {
-  //   // TODO: fill
-  // };
+  // FNV-1a over every field
+  static uint64_t HashInfo(const Info& info) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](const auto& value) {
+      auto bytes = reinterpret_cast<const uint8_t*>(&value);
+      for (size_t i = 0; i < sizeof(value); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;  // FNV-1a prime
+      }
+    };
+
+    add(info.magFilter);
+    add(info.minFilter);
+    add(info.mipmapMode);
+    add(info.addressModeU);
+    add(info.addressModeV);
+    add(info.addressModeW);
+    add(info.mipLodBias);
+    add(info.anisotropyEnable);
+    add(info.maxAnisotropy);
+    add(info.compareEnable);
+    add(info.compareOp);
+    add(info.minLod);
+    add(info.maxLod);
+    add(info.borderColor);
+    add(info.unnormalizedCoordinates);
+    return hash;
+  }
+
+  // for hash maps keyed by Info
+  struct InfoHash {
+    size_t operator()(const Info& info) const { return HashInfo(info); }
+  };
 
   Sampler() = default;
   Sampler(const vk::raii::Device& device, const Info& info) {
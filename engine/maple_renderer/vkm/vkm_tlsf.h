@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace vkm {
+// Two-level segregated fit allocator over an abstract [0, size) range.
+// It never touches the memory it manages, it only hands out offsets, so the same code sub-allocates
+// VkDeviceMemory blocks of any memory type. Allocation and free are O(1), neighbouring free ranges are merged on free.
+class Tlsf {
+ public:
+  using NodeIdx = uint32_t;
+  static constexpr NodeIdx INVALID_NODE = UINT32_MAX;
+
+  struct Allocation {
+    NodeIdx node = INVALID_NODE;
+    uint64_t offset = 0;  // aligned offset of the allocation
+  };
+
+  struct Stats {
+    uint64_t size = 0;
+    uint64_t usedBytes = 0;
+    uint64_t largestFreeRange = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRangeCount = 0;
+  };
+
+  Tlsf() = default;
+  explicit Tlsf(uint64_t size) : mSize(size) {
+    auto node = newNode();
+    mNodes[node].offset = 0;
+    mNodes[node].size = size;
+    insertFree(node);
+  }
+
+  [[nodiscard]]
+  std::optional<Allocation> Allocate(uint64_t size, uint64_t alignment) {
+    if (size == 0) size = 1;
+    size = alignUp(size, GRANULARITY);
+    alignment = std::max<uint64_t>(alignment, 1);
+
+    // over-request so any range found can fit the allocation after aligning its start
+    uint64_t searchSize = alignment > GRANULARITY ? size + alignment - 1 : size;
+    auto node = findFree(searchSize);
+    if (node == INVALID_NODE) return std::nullopt;
+    removeFree(node);
+
+    // split off the alignment padding at the front as its own free range
+    uint64_t alignedOffset = alignUp(mNodes[node].offset, alignment);
+    uint64_t padding = alignedOffset - mNodes[node].offset;
+    if (padding > 0) {
+      auto front = newNode();
+      mNodes[front].offset = mNodes[node].offset;
+      mNodes[front].size = padding;
+      mNodes[front].prevPhys = mNodes[node].prevPhys;
+      mNodes[front].nextPhys = node;
+      if (mNodes[node].prevPhys != INVALID_NODE) mNodes[mNodes[node].prevPhys].nextPhys = front;
+      mNodes[node].prevPhys = front;
+      mNodes[node].offset = alignedOffset;
+      mNodes[node].size -= padding;
+      insertFree(front);
+    }
+
+    // return the unused tail to the free lists
+    if (mNodes[node].size - size >= GRANULARITY) {
+      auto back = newNode();
+      mNodes[back].offset = mNodes[node].offset + size;
+      mNodes[back].size = mNodes[node].size - size;
+      mNodes[back].prevPhys = node;
+      mNodes[back].nextPhys = mNodes[node].nextPhys;
+      if (mNodes[node].nextPhys != INVALID_NODE) mNodes[mNodes[node].nextPhys].prevPhys = back;
+      mNodes[node].nextPhys = back;
+      mNodes[node].size = size;
+      insertFree(back);
+    }
+
+    mUsedBytes += mNodes[node].size;
+    mAllocationCount++;
+    return Allocation{.node = node, .offset = alignedOffset};
+  }
+
+  void Free(NodeIdx node) {
+    mUsedBytes -= mNodes[node].size;
+    mAllocationCount--;
+
+    auto prev = mNodes[node].prevPhys;
+    if (prev != INVALID_NODE && mNodes[prev].free) {
+      removeFree(prev);
+      mNodes[prev].size += mNodes[node].size;
+      unlinkPhys(node);
+      releaseNode(node);
+      node = prev;
+    }
+
+    auto next = mNodes[node].nextPhys;
+    if (next != INVALID_NODE && mNodes[next].free) {
+      removeFree(next);
+      mNodes[node].size += mNodes[next].size;
+      unlinkPhys(next);
+      releaseNode(next);
+    }
+
+    insertFree(node);
+  }
+
+  uint64_t AllocationSize(NodeIdx node) const { return mNodes[node].size; }
+
+  bool Empty() const { return mAllocationCount == 0; }
+  uint64_t Size() const { return mSize; }
+
+  Stats GetStats() const {
+    Stats stats{.size = mSize, .usedBytes = mUsedBytes, .allocationCount = mAllocationCount};
+    for (const auto& node : mNodes) {
+      if (!node.free || node.size == 0) continue;
+      stats.freeRangeCount++;
+      stats.largestFreeRange = std::max(stats.largestFreeRange, node.size);
+    }
+    return stats;
+  }
+
+ private:
+  static constexpr uint32_t SL_BITS = 5;
+  static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+  static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+  static constexpr uint64_t GRANULARITY = 16;
+
+  struct Node {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    NodeIdx prevPhys = INVALID_NODE, nextPhys = INVALID_NODE;
+    NodeIdx prevFree = INVALID_NODE, nextFree = INVALID_NODE;
+    bool free = false;
+  };
+
+  uint64_t mSize = 0;
+  uint64_t mUsedBytes = 0;
+  uint32_t mAllocationCount = 0;
+
+  std::vector<Node> mNodes;
+  std::vector<NodeIdx> mUnusedNodes;
+
+  uint64_t mFlBitmap = 0;
+  std::array<uint32_t, FL_COUNT> mSlBitmaps{};
+  std::array<std::array<NodeIdx, SL_COUNT>, FL_COUNT> mFreeHeads = [] {
+    std::array<std::array<NodeIdx, SL_COUNT>, FL_COUNT> heads;
+    for (auto& fl : heads) fl.fill(INVALID_NODE);
+    return heads;
+  }();
+
+  static uint64_t alignUp(uint64_t v, uint64_t alignment) { return (v + alignment - 1) / alignment * alignment; }
+
+  // size -> (first level, second level) list the size belongs to
+  static std::pair<uint32_t, uint32_t> mapping(uint64_t size) {
+    if (size < SL_COUNT) return {0, static_cast<uint32_t>(size)};
+    uint32_t msb = 63 - std::countl_zero(size);
+    uint32_t sl = static_cast<uint32_t>(size >> (msb - SL_BITS)) - SL_COUNT;
+    return {msb - SL_BITS + 1, sl};
+  }
+
+  NodeIdx findFree(uint64_t size) const {
+    // round up to the next list boundary so every range in the found list is large enough
+    if (size >= SL_COUNT) {
+      uint32_t msb = 63 - std::countl_zero(size);
+      uint64_t round = (uint64_t(1) << (msb - SL_BITS)) - 1;
+      if (size > UINT64_MAX - round) return INVALID_NODE;
+      size += round;
+    }
+    auto [fl, sl] = mapping(size);
+    if (fl >= FL_COUNT) return INVALID_NODE;
+
+    uint32_t slMap = mSlBitmaps[fl] & (~0u << sl);
+    if (slMap == 0) {
+      uint64_t flMap = fl + 1 < 64 ? mFlBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+      if (flMap == 0) return INVALID_NODE;
+      fl = std::countr_zero(flMap);
+      slMap = mSlBitmaps[fl];
+    }
+    sl = std::countr_zero(slMap);
+    return mFreeHeads[fl][sl];
+  }
+
+  void insertFree(NodeIdx node) {
+    auto& n = mNodes[node];
+    auto [fl, sl] = mapping(n.size);
+    n.free = true;
+    n.prevFree = INVALID_NODE;
+    n.nextFree = mFreeHeads[fl][sl];
+    if (n.nextFree != INVALID_NODE) mNodes[n.nextFree].prevFree = node;
+    mFreeHeads[fl][sl] = node;
+    mFlBitmap |= uint64_t(1) << fl;
+    mSlBitmaps[fl] |= 1u << sl;
+  }
+
+  void removeFree(NodeIdx node) {
+    auto& n = mNodes[node];
+    auto [fl, sl] = mapping(n.size);
+    if (n.prevFree != INVALID_NODE) mNodes[n.prevFree].nextFree = n.nextFree;
+    if (n.nextFree != INVALID_NODE) mNodes[n.nextFree].prevFree = n.prevFree;
+    if (mFreeHeads[fl][sl] == node) {
+      mFreeHeads[fl][sl] = n.nextFree;
+      if (n.nextFree == INVALID_NODE) {
+        mSlBitmaps[fl] &= ~(1u << sl);
+        if (mSlBitmaps[fl] == 0) mFlBitmap &= ~(uint64_t(1) << fl);
+      }
+    }
+    n.free = false;
+    n.prevFree = n.nextFree = INVALID_NODE;
+  }
+
+  void unlinkPhys(NodeIdx node) {
+    auto& n = mNodes[node];
+    if (n.prevPhys != INVALID_NODE) mNodes[n.prevPhys].nextPhys = n.nextPhys;
+    if (n.nextPhys != INVALID_NODE) mNodes[n.nextPhys].prevPhys = n.prevPhys;
+  }
+
+  NodeIdx newNode() {
+    if (!mUnusedNodes.empty()) {
+      auto node = mUnusedNodes.back();
+      mUnusedNodes.pop_back();
+      mNodes[node] = Node{};
+      return node;
+    }
+    mNodes.push_back(Node{});
+    return static_cast<NodeIdx>(mNodes.size() - 1);
+  }
+
+  void releaseNode(NodeIdx node) {
+    mNodes[node] = Node{};
+    mUnusedNodes.push_back(node);
+  }
+};
+}  // namespace vkm
@@ -0,0 +1,63 @@
+#include "worker_pool.h"
+
+namespace maple {
+
+WorkerPool::WorkerPool(uint32_t numWorkers) {
+  for (uint32_t i = 1; i < numWorkers; i++) mThreads.emplace_back([this, i] { workerLoop(i); });
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard lock(mMutex);
+    mStop = true;
+  }
+  mWakeCv.notify_all();
+  for (auto& thread : mThreads) thread.join();
+}
+
+void WorkerPool::ParallelFor(uint32_t numTasks, const Task& task) {
+  if (mThreads.empty() || numTasks <= 1) {
+    for (uint32_t i = 0; i < numTasks; i++) task(i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard lock(mMutex);
+    mTask = &task;
+    mNumTasks = numTasks;
+    mNextTask = 0;
+    mFinishedWorkers = 0;
+    mGeneration++;
+  }
+  mWakeCv.notify_all();
+
+  runTasks(task, 0);
+
+  std::unique_lock lock(mMutex);
+  mDoneCv.wait(lock, [&] { return mFinishedWorkers == mThreads.size(); });
+  mTask = nullptr;
+}
+
+void WorkerPool::workerLoop(uint32_t workerIdx) {
+  uint64_t seenGeneration = 0;
+  while (true) {
+    const Task* task = nullptr;
+    {
+      std::unique_lock lock(mMutex);
+      mWakeCv.wait(lock, [&] { return mStop || mGeneration != seenGeneration; });
+      if (mStop) return;
+      seenGeneration = mGeneration;
+      task = mTask;
+    }
+
+    runTasks(*task, workerIdx);
+
+    std::lock_guard lock(mMutex);
+    if (++mFinishedWorkers == mThreads.size()) mDoneCv.notify_one();
+  }
+}
+
+void WorkerPool::runTasks(const Task& task, uint32_t workerIdx) {
+  for (uint32_t i = mNextTask.fetch_add(1); i < mNumTasks; i = mNextTask.fetch_add(1)) task(i, workerIdx);
+}
+}  // namespace maple
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace maple {
+// Fixed set of threads that run parallel-for jobs, the calling thread takes part as worker 0.
+// Every worker joins every job, so a job's function is never touched after ParallelFor() returns.
+class WorkerPool {
+ public:
+  using Task = std::function<void(uint32_t taskIdx, uint32_t workerIdx)>;
+
+  explicit WorkerPool(uint32_t numWorkers);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  // Runs task for every index in [0, numTasks) and returns once all of them completed
+  void ParallelFor(uint32_t numTasks, const Task& task);
+
+  uint32_t NumWorkers() const { return static_cast<uint32_t>(mThreads.size()) + 1; }
+
+ private:
+  std::vector<std::thread> mThreads;
+
+  std::mutex mMutex;
+  std::condition_variable mWakeCv;
+  std::condition_variable mDoneCv;
+  uint64_t mGeneration = 0;  // bumped for every job
+  uint32_t mFinishedWorkers = 0;
+  bool mStop = false;
+
+  const Task* mTask = nullptr;
+  uint32_t mNumTasks = 0;
+  std::atomic<uint32_t> mNextTask = 0;
+
+  void workerLoop(uint32_t workerIdx);
+  void runTasks(const Task& task, uint32_t workerIdx);
+};
+}  // namespace maple